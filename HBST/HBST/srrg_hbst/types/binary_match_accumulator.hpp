@@ -0,0 +1,179 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "binary_match.hpp"
+
+namespace srrg_hbst {
+
+  //! @class reusable best match storage (per image) for a single query matchable: a flat, open
+  //! addressing table keyed by image identifier whose entries are invalidated in O(1) per query
+  //! (epoch stamp) - no exceptions, no node allocations and no per-query construction
+  //! @param BinaryMatchType_ match type (class) to accumulate
+  template <typename BinaryMatchType_>
+  class BinaryMatchAccumulator {
+    // ds exports
+  public:
+    using Match      = BinaryMatchType_;
+    using Matchable  = typename Match::Matchable;
+    using ObjectType = typename Match::ObjectType;
+    using real_type  = typename Match::real_type;
+
+    //! @brief table entry: best match(es) of the current query for one image
+    struct Entry {
+      uint64_t identifier = 0;
+      uint32_t epoch      = 0; // ds entry is only valid if equal to the accumulator epoch
+      Match match;
+    };
+
+    // ds ctor/dtor
+  public:
+    //! @brief constructs an accumulator for a database with number_of_images_ images
+    BinaryMatchAccumulator(const size_t& number_of_images_ = 0) {
+      reserve(number_of_images_);
+    }
+
+    // ds access
+  public:
+    //! @brief sizes the table for number_of_images_ distinct image identifiers per query (the
+    //! table only grows and keeps at least half of its entries free)
+    void reserve(const size_t& number_of_images_) {
+      size_t capacity = 16;
+      while (capacity < 2 * number_of_images_) {
+        capacity *= 2;
+      }
+      if (capacity > _entries.size()) {
+        _rehash(capacity);
+      }
+    }
+
+    //! @brief invalidates all matches (to be called before every query matchable)
+    void reset() {
+      _touched.clear();
+      ++_epoch;
+
+      // ds on wrap-around the stamps have to be cleared once
+      if (_epoch == 0) {
+        for (Entry& entry : _entries) {
+          entry.epoch = 0;
+        }
+        _epoch = 1;
+      }
+    }
+
+    //! @brief registers a match candidate: keeps the best (minimum distance) matches per image
+    //! @param[in] identifier_reference_ image identifier of the reference object
+    //! @param[in] matchable_query_
+    //! @param[in] matchable_reference_
+    //! @param[in] object_query_
+    //! @param[in] object_reference_
+    //! @param[in] distance_ matching distance between query and reference
+    void add(const uint64_t& identifier_reference_,
+             const Matchable* matchable_query_,
+             const Matchable* matchable_reference_,
+             const ObjectType& object_query_,
+             const ObjectType& object_reference_,
+             const uint32_t& distance_) {
+      size_t index = _getIndex(identifier_reference_);
+      while (true) {
+        Entry& entry = _entries[index];
+
+        // ds first match for this image - reuse the entry storage
+        if (entry.epoch != _epoch) {
+          entry.identifier                 = identifier_reference_;
+          entry.epoch                      = _epoch;
+          entry.match.matchable_query      = matchable_query_;
+          entry.match.object_query         = object_query_;
+          entry.match.distance             = distance_;
+          entry.match.matchable_references.assign(1, matchable_reference_);
+          entry.match.object_references.assign(1, object_reference_);
+          _touched.push_back(index);
+
+          // ds keep probing sequences short
+          if (2 * _touched.size() > _entries.size()) {
+            _rehash(2 * _entries.size());
+          }
+          return;
+        }
+
+        if (entry.identifier == identifier_reference_) {
+          // ds replace the best with this match on the spot - we don't have to update the query
+          // information
+          if (distance_ < entry.match.distance) {
+            entry.match.matchable_references.assign(1, matchable_reference_);
+            entry.match.object_references.assign(1, object_reference_);
+            entry.match.distance = distance_;
+          }
+
+          // ds if the match is equal to the last (multiple candidates)
+          else if (distance_ == entry.match.distance) {
+            entry.match.matchable_references.push_back(matchable_reference_);
+            entry.match.object_references.push_back(object_reference_);
+          }
+          return;
+        }
+        index = (index + 1) & (_entries.size() - 1);
+      }
+    }
+
+    //! @brief number of images with a match for the current query
+    size_t size() const {
+      return _touched.size();
+    }
+
+    //! @brief image identifier of the i-th matched image (in order of first match)
+    const uint64_t& identifier(const size_t& index_) const {
+      return _entries[_touched[index_]].identifier;
+    }
+
+    //! @brief best match(es) for the i-th matched image (in order of first match)
+    const Match& match(const size_t& index_) const {
+      return _entries[_touched[index_]].match;
+    }
+
+    // ds helpers
+  protected:
+    size_t _getIndex(const uint64_t& identifier_) const {
+      // ds fibonacci hashing to spread consecutive identifiers
+      return static_cast<size_t>((identifier_ * 0x9E3779B97F4A7C15ULL) >> _shift);
+    }
+
+    void _rehash(const size_t& capacity_) {
+      std::vector<Entry> entries(capacity_);
+      _shift = 64;
+      for (size_t capacity = capacity_; capacity > 1; capacity /= 2) {
+        --_shift;
+      }
+
+      // ds move valid entries of the current query
+      std::vector<size_t> touched;
+      touched.reserve(_touched.size());
+      for (const size_t& index_old : _touched) {
+        Entry& entry_old = _entries[index_old];
+        size_t index     = _getIndex(entry_old.identifier);
+        while (entries[index].epoch == _epoch) {
+          index = (index + 1) & (capacity_ - 1);
+        }
+        entries[index] = entry_old;
+        touched.push_back(index);
+      }
+      _entries.swap(entries);
+      _touched.swap(touched);
+    }
+
+    // ds attributes
+  protected:
+    //! @brief open addressing table (capacity is a power of two)
+    std::vector<Entry> _entries;
+
+    //! @brief indices of valid entries for the current query
+    std::vector<size_t> _touched;
+
+    //! @brief current query stamp (0 marks never used entries)
+    uint32_t _epoch = 1;
+
+    //! @brief hash shift corresponding to the table capacity
+    uint32_t _shift = 64;
+  };
+
+} // namespace srrg_hbst
@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <assert.h>
+#include <map>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "binary_distance.hpp"
+
+namespace srrg_hbst {
+
+  //! @class arena for matchables: objects are constructed in place in large slabs, which are
+  //! released in bulk - freed slots are recycled by later allocations
+  //! @param MatchableType_ matchable type (class) stored in the pool
+  template <typename MatchableType_>
+  class BinaryMatchablePool {
+    // ds exports
+  public:
+    using Matchable = MatchableType_;
+
+    //! @brief a contiguous block of matchable slots
+    struct Slab {
+      Matchable* data         = nullptr;
+      size_t capacity         = 0;
+      size_t number_of_used   = 0; // ds bump pointer (slots after this were never constructed)
+      size_t number_of_alive  = 0;
+      std::vector<bool> alive = std::vector<bool>(); // ds liveness for bulk destruction
+    };
+
+    // ds ctor/dtor
+  public:
+    //! @brief constructs an empty pool
+    //! @param[in] slab_size_ default number of matchables per slab
+    BinaryMatchablePool(const size_t& slab_size_ = 4096) : _slab_size(slab_size_) {
+    }
+
+    //! @brief destroys all matchables that are still alive
+    ~BinaryMatchablePool() {
+      clear();
+    }
+
+    //! @brief the pool owns raw memory
+    BinaryMatchablePool(const BinaryMatchablePool&) = delete;
+    BinaryMatchablePool& operator=(const BinaryMatchablePool&) = delete;
+
+    // ds access
+  public:
+    //! @brief guarantees that the next number_of_matchables_ allocations are served from
+    //! consecutive slots of a single slab (e.g. all matchables of one image)
+    void reserve(const size_t& number_of_matchables_) {
+      if (_slabs.empty() || _slabs.back().capacity - _slabs.back().number_of_used <
+                              number_of_matchables_) {
+        _addSlab(std::max(_slab_size, number_of_matchables_));
+      }
+      _number_of_reserved = number_of_matchables_;
+    }
+
+    //! @brief constructs a matchable in the pool, forwarding the constructor arguments
+    //! @returns the matchable (owned by the pool until recycle or clear)
+    template <typename... Arguments_>
+    Matchable* create(Arguments_&&... arguments_) {
+      size_t index_slab = 0;
+      size_t index_slot = 0;
+
+      // ds prefer free slots unless a contiguous range has been reserved
+      if (_number_of_reserved == 0 && !_free_slots.empty()) {
+        index_slab = _free_slots.back().first;
+        index_slot = _free_slots.back().second;
+        _free_slots.pop_back();
+      } else {
+        if (_slabs.empty() || _slabs.back().number_of_used == _slabs.back().capacity) {
+          _addSlab(_slab_size);
+        }
+        index_slab = _slabs.size() - 1;
+        index_slot = _slabs.back().number_of_used;
+        ++_slabs.back().number_of_used;
+        if (_number_of_reserved > 0) {
+          --_number_of_reserved;
+        }
+      }
+
+      // ds construct in place
+      Slab& slab           = _slabs[index_slab];
+      Matchable* matchable = new (slab.data + index_slot)
+        Matchable(std::forward<Arguments_>(arguments_)...);
+      slab.alive[index_slot] = true;
+      ++slab.number_of_alive;
+      ++_number_of_alive;
+      return matchable;
+    }
+
+    //! @brief checks if a matchable has been allocated by this pool
+    bool owns(const Matchable* matchable_) const {
+      size_t index_slab = 0;
+      size_t index_slot = 0;
+      return _locate(matchable_, index_slab, index_slot);
+    }
+
+    //! @brief destroys a matchable of this pool and makes its slot available again
+    //! @returns false if the matchable is not owned by this pool
+    bool recycle(const Matchable* matchable_) {
+      size_t index_slab = 0;
+      size_t index_slot = 0;
+      if (!_locate(matchable_, index_slab, index_slot)) {
+        return false;
+      }
+      Slab& slab = _slabs[index_slab];
+      assert(slab.alive[index_slot]);
+      slab.data[index_slot].~Matchable();
+      slab.alive[index_slot] = false;
+      --slab.number_of_alive;
+      --_number_of_alive;
+      _free_slots.push_back(std::make_pair(index_slab, index_slot));
+      return true;
+    }
+
+    //! @brief destroys all alive matchables and releases all slabs at once
+    void clear() {
+      AlignedAllocator<Matchable> allocator;
+      for (Slab& slab : _slabs) {
+        if (slab.number_of_alive > 0) {
+          for (size_t index_slot = 0; index_slot < slab.number_of_used; ++index_slot) {
+            if (slab.alive[index_slot]) {
+              slab.data[index_slot].~Matchable();
+            }
+          }
+        }
+        allocator.deallocate(slab.data, slab.capacity);
+      }
+      _slabs.clear();
+      _slab_per_address.clear();
+      _free_slots.clear();
+      _number_of_alive    = 0;
+      _number_of_reserved = 0;
+    }
+
+    //! @brief number of alive matchables
+    size_t size() const {
+      return _number_of_alive;
+    }
+
+    //! @brief number of slots in all slabs
+    size_t capacity() const {
+      size_t number_of_slots = 0;
+      for (const Slab& slab : _slabs) {
+        number_of_slots += slab.capacity;
+      }
+      return number_of_slots;
+    }
+
+    // ds helpers
+  protected:
+    void _addSlab(const size_t& capacity_) {
+      Slab slab;
+      slab.capacity = capacity_;
+      slab.data     = AlignedAllocator<Matchable>().allocate(capacity_);
+      slab.alive.resize(capacity_, false);
+      _slab_per_address.insert(std::make_pair(slab.data, _slabs.size()));
+      _slabs.push_back(std::move(slab));
+    }
+
+    bool _locate(const Matchable* matchable_, size_t& index_slab_, size_t& index_slot_) const {
+      if (_slabs.empty()) {
+        return false;
+      }
+
+      // ds find the slab with the highest start address not above the matchable
+      typename std::map<const Matchable*, size_t>::const_iterator iterator =
+        _slab_per_address.upper_bound(matchable_);
+      if (iterator == _slab_per_address.begin()) {
+        return false;
+      }
+      --iterator;
+      const Slab& slab = _slabs[iterator->second];
+      if (matchable_ >= slab.data + slab.capacity) {
+        return false;
+      }
+      index_slab_ = iterator->second;
+      index_slot_ = matchable_ - slab.data;
+      return true;
+    }
+
+    // ds attributes
+  protected:
+    //! @brief default number of matchables per slab
+    size_t _slab_size;
+
+    //! @brief all slabs in allocation order
+    std::vector<Slab> _slabs;
+
+    //! @brief slab lookup by start address (ownership queries)
+    std::map<const Matchable*, size_t> _slab_per_address;
+
+    //! @brief recycled slots (slab, slot)
+    std::vector<std::pair<size_t, size_t>> _free_slots;
+
+    //! @brief number of remaining slots reserved for contiguous allocation
+    size_t _number_of_reserved = 0;
+
+    //! @brief number of constructed, not yet destroyed matchables
+    size_t _number_of_alive = 0;
+  };
+
+} // namespace srrg_hbst
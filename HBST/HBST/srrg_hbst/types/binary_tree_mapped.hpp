@@ -0,0 +1,585 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "binary_distance.hpp"
+#include "binary_match_accumulator.hpp"
+
+namespace srrg_hbst {
+
+  //! @brief packed node of a mapped database: leafs reference a contiguous range of entries
+  struct MappedNode {
+    //! @brief inner node: index of the left child (the right child follows), leaf: first entry
+    uint64_t index_first = 0;
+
+    //! @brief number of entries (leafs only)
+    uint32_t number_of_entries = 0;
+
+    //! @brief split bit of inner nodes, -1 for leafs
+    int32_t index_split_bit = -1;
+  };
+
+  //! @brief on-disk layout of a mapped database (written by BinaryTree::writeMapped): a header
+  //! followed by 64-byte aligned sections, all offsets in bytes from the beginning of the file
+  //! - identifiers:      number_of_identifiers uint64_t (trained image identifiers, sorted)
+  //! - nodes:            number_of_nodes MappedNode (breadth first, children stored as pairs)
+  //! - descriptor words: number_of_entries packed descriptors (contiguous per leaf)
+  //! - object ranges:    number_of_entries + 1 uint64_t offsets into the objects per entry
+  //! - objects:          number_of_objects MappedObject (image identifier, object)
+  struct MappedHeader {
+    //! @brief current format version (files of other versions are rejected)
+    static constexpr uint32_t current_version = 1;
+
+    //! @brief endianness marker as written on the creating architecture
+    static constexpr uint32_t endianness = 0x01020304;
+
+    char magic[8]             = {'S', 'R', 'R', 'G', 'H', 'B', 'S', 'T'};
+    uint32_t version          = current_version;
+    uint32_t endianness_check = endianness;
+
+    //! @brief type compatibility (descriptor length and object record size)
+    uint32_t descriptor_size_bits = 0;
+    uint32_t object_record_size   = 0;
+
+    //! @brief database identifier and section sizes (number of elements)
+    uint64_t identifier            = 0;
+    uint64_t number_of_identifiers = 0;
+    uint64_t number_of_nodes       = 0;
+    uint64_t number_of_entries     = 0;
+    uint64_t number_of_objects     = 0;
+
+    //! @brief section offsets
+    uint64_t offset_identifiers      = 0;
+    uint64_t offset_nodes            = 0;
+    uint64_t offset_descriptor_words = 0;
+    uint64_t offset_object_ranges    = 0;
+    uint64_t offset_objects          = 0;
+    uint64_t file_size               = 0;
+
+    //! @brief section alignment in bytes (cache lines)
+    static constexpr uint64_t alignment = 64;
+
+    //! @brief aligns an offset to the section alignment
+    static uint64_t align(const uint64_t& offset_) {
+      return (offset_ + alignment - 1) / alignment * alignment;
+    }
+
+    //! @brief computes all section offsets from the section sizes
+    void computeOffsets(const uint32_t& descriptor_size_words_) {
+      offset_identifiers = align(sizeof(MappedHeader));
+      offset_nodes = align(offset_identifiers + number_of_identifiers * sizeof(uint64_t));
+      offset_descriptor_words = align(offset_nodes + number_of_nodes * sizeof(MappedNode));
+      offset_object_ranges    = align(offset_descriptor_words +
+                                   number_of_entries * descriptor_size_words_ * sizeof(uint64_t));
+      offset_objects = align(offset_object_ranges + (number_of_entries + 1) * sizeof(uint64_t));
+      file_size      = offset_objects + number_of_objects * object_record_size;
+    }
+  };
+
+  //! @brief object record of a mapped database
+  template <typename ObjectType_>
+  struct MappedObject {
+    uint64_t image_identifier;
+    ObjectType_ object;
+  };
+
+  //! @class read-only memory mapping of a complete file (pages are loaded lazily on access and
+  //! shared between all processes mapping the same file)
+  class MappedFile {
+  public:
+    MappedFile() {
+    }
+
+    ~MappedFile() {
+      close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    //! @brief maps the file at file_path_ (replacing the current mapping)
+    //! @returns false if the file cannot be mapped
+    bool open(const std::string& file_path_) {
+      close();
+#ifdef _WIN32
+      _file = CreateFileA(file_path_.c_str(),
+                          GENERIC_READ,
+                          FILE_SHARE_READ,
+                          nullptr,
+                          OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                          nullptr);
+      if (_file == INVALID_HANDLE_VALUE) {
+        return false;
+      }
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+      }
+      _size    = static_cast<size_t>(size.QuadPart);
+      _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (!_mapping) {
+        close();
+        return false;
+      }
+      _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+      const int file = ::open(file_path_.c_str(), O_RDONLY);
+      if (file < 0) {
+        return false;
+      }
+      struct stat status;
+      if (fstat(file, &status) != 0 || status.st_size == 0) {
+        ::close(file);
+        return false;
+      }
+      _size = static_cast<size_t>(status.st_size);
+      void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, file, 0);
+      ::close(file); // ds the mapping keeps the file referenced
+      if (data == MAP_FAILED) {
+        _size = 0;
+        return false;
+      }
+
+      // ds queries touch few, scattered pages - avoid read-ahead
+      madvise(data, _size, MADV_RANDOM);
+      _data = static_cast<const char*>(data);
+#endif
+      if (!_data) {
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    //! @brief releases the mapping
+    void close() {
+#ifdef _WIN32
+      if (_data) {
+        UnmapViewOfFile(_data);
+      }
+      if (_mapping) {
+        CloseHandle(_mapping);
+      }
+      if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+      }
+      _mapping = nullptr;
+      _file    = INVALID_HANDLE_VALUE;
+#else
+      if (_data) {
+        munmap(const_cast<char*>(_data), _size);
+      }
+#endif
+      _data = nullptr;
+      _size = 0;
+    }
+
+    //! @brief mapped bytes (nullptr if not mapped)
+    const char* data() const {
+      return _data;
+    }
+
+    //! @brief number of mapped bytes
+    size_t size() const {
+      return _size;
+    }
+
+  protected:
+    const char* _data = nullptr;
+    size_t _size      = 0;
+#ifdef _WIN32
+    HANDLE _file    = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+#endif
+  };
+
+  //! @class read-only database queried in place from a memory mapped file written by
+  //! BinaryTree::writeMapped or from an in-memory image created by BinaryTree::freeze - opening
+  //! only validates the header, no matchables are created
+  //! @param BinaryTreeType_ tree type (class) that wrote the file
+  template <typename BinaryTreeType_>
+  class BinaryTreeMapped {
+    // ds exports
+  public:
+    using Tree            = BinaryTreeType_;
+    using Matchable       = typename Tree::Matchable;
+    using MatchableVector = typename Tree::MatchableVector;
+    using Match           = typename Tree::Match;
+    using MatchVectorMap  = typename Tree::MatchVectorMap;
+    using Score           = typename Tree::Score;
+    using ScoreVector     = typename Tree::ScoreVector;
+    using ObjectType      = typename Tree::ObjectType;
+    using real_type       = typename Tree::real_type;
+    using Object          = MappedObject<ObjectType>;
+    using MatchAccumulator = BinaryMatchAccumulator<Match>;
+    static constexpr uint32_t descriptor_size_words = Matchable::descriptor_size_words;
+    static constexpr uint32_t scan_block_size       = 32;
+    static_assert(std::is_trivially_copyable<ObjectType>::value,
+                  "mapped databases require trivially copyable objects");
+
+    // ds ctor/dtor
+  public:
+    BinaryTreeMapped() {
+    }
+
+    //! @brief maps the database at file_path_ (see open)
+    BinaryTreeMapped(const std::string& file_path_) {
+      open(file_path_);
+    }
+
+    // ds access
+  public:
+    //! @brief maps a database file and validates its header and section bounds in constant time
+    //! @param[in] file_path_
+    //! @param[in] verify_structure_ additionally checks all nodes (touches the node section)
+    //! @returns false if the file is not a compatible mapped database
+    bool open(const std::string& file_path_, const bool& verify_structure_ = false) {
+      close();
+      if (!_file.open(file_path_)) {
+        std::cerr << "BinaryTreeMapped::open|ERROR: unable to map file: " << file_path_
+                  << std::endl;
+        return false;
+      }
+      _data = _file.data();
+      _size = _file.size();
+      if (!_isValid(verify_structure_)) {
+        std::cerr << "BinaryTreeMapped::open|ERROR: invalid or incompatible database: "
+                  << file_path_ << std::endl;
+        close();
+        return false;
+      }
+      _resolveSections();
+      return true;
+    }
+
+    //! @brief takes ownership of a database image in memory (see BinaryTree::freeze)
+    //! @param[in] image_ complete database image as written by BinaryTree::writeMapped
+    //! @param[in] verify_structure_ additionally checks all nodes
+    //! @returns false if the image is not a compatible database
+    bool open(std::vector<uint64_t>&& image_, const bool& verify_structure_ = false) {
+      close();
+      _image = std::move(image_);
+      _data  = reinterpret_cast<const char*>(_image.data());
+      _size  = _image.size() * sizeof(uint64_t);
+      if (_size >= sizeof(MappedHeader)) {
+        // ds the image is word padded, its valid size is the one of the corresponding file
+        _size = std::min(_size, reinterpret_cast<const MappedHeader*>(_data)->file_size);
+      }
+      if (!_isValid(verify_structure_)) {
+        std::cerr << "BinaryTreeMapped::open|ERROR: invalid or incompatible database image"
+                  << std::endl;
+        close();
+        return false;
+      }
+      _resolveSections();
+      return true;
+    }
+
+    //! @brief unmaps the database (releases an owned image)
+    void close() {
+      _file.close();
+      std::vector<uint64_t>().swap(_image);
+      _data             = nullptr;
+      _size             = 0;
+      _header           = nullptr;
+      _identifiers      = nullptr;
+      _nodes            = nullptr;
+      _descriptor_words = nullptr;
+      _object_ranges    = nullptr;
+      _objects          = nullptr;
+    }
+
+    //! @brief true if a database is mapped
+    bool isOpen() const {
+      return _header != nullptr;
+    }
+
+    //! @brief number of images in the database
+    size_t size() const {
+      return _header ? _header->number_of_identifiers : 0;
+    }
+
+    //! @brief number of stored descriptors
+    size_t numberOfMatchables() const {
+      return _header ? _header->number_of_entries : 0;
+    }
+
+    //! @brief database identifier
+    uint64_t identifier() const {
+      return _header ? _header->identifier : 0;
+    }
+
+    //! @brief number of query matchables with at least one reference within maximum_distance_
+    const uint64_t getNumberOfMatches(const MatchableVector& matchables_query_,
+                                      const uint32_t& maximum_distance_ = 25) const {
+      if (!_header || matchables_query_.empty()) {
+        return 0;
+      }
+      uint64_t number_of_matches = 0;
+      for (const Matchable* matchable_query : matchables_query_) {
+        _scan(matchable_query->descriptor,
+              maximum_distance_,
+              [&number_of_matches](const uint64_t& /*index_entry*/, const uint32_t& /*distance*/) {
+                ++number_of_matches;
+                return false;
+              });
+      }
+      return number_of_matches;
+    }
+
+    //! @brief number of matches and matching ratio for each image in the database
+    const ScoreVector getScorePerImage(const MatchableVector& matchables_query_,
+                                       const bool sort_output           = false,
+                                       const uint32_t maximum_distance_ = 25) const {
+      if (!_header || matchables_query_.empty()) {
+        return ScoreVector(0);
+      }
+      ScoreVector scores_per_image(_header->number_of_identifiers);
+      for (uint64_t index_image = 0; index_image < _header->number_of_identifiers; ++index_image) {
+        scores_per_image[index_image].identifier_reference = _identifiers[index_image];
+      }
+
+      // ds a query matchable counts only once per reference image
+      std::vector<uint64_t> indices_image_matched;
+      for (const Matchable* matchable_query : matchables_query_) {
+        indices_image_matched.clear();
+        _scan(matchable_query->descriptor,
+              maximum_distance_,
+              [&](const uint64_t& index_entry, const uint32_t& /*distance*/) {
+                for (uint64_t index_object = _object_ranges[index_entry];
+                     index_object < _object_ranges[index_entry + 1];
+                     ++index_object) {
+                  indices_image_matched.push_back(_getIndexImage(_objects[index_object]));
+                }
+                return true;
+              });
+        std::sort(indices_image_matched.begin(), indices_image_matched.end());
+        indices_image_matched.erase(
+          std::unique(indices_image_matched.begin(), indices_image_matched.end()),
+          indices_image_matched.end());
+        for (const uint64_t& index_image : indices_image_matched) {
+          ++scores_per_image[index_image].number_of_matches;
+        }
+      }
+
+      // ds compute relative scores
+      const real_type number_of_query_descriptors = matchables_query_.size();
+      for (Score& score : scores_per_image) {
+        score.matching_ratio = score.number_of_matches / number_of_query_descriptors;
+      }
+      if (sort_output) {
+        std::sort(
+          scores_per_image.begin(), scores_per_image.end(), [](const Score& a, const Score& b) {
+            return a.matching_ratio > b.matching_ratio;
+          });
+      }
+      return scores_per_image;
+    }
+
+    //! @brief knn multi-matching function (see BinaryTree::match) - there are no reference
+    //! matchables in a mapped database, the matchable_references of all matches are nullptr
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ best matches for every image in the database
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    void match(const MatchableVector& matchables_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      matches_.clear();
+      if (!_header || matchables_query_.empty()) {
+        return;
+      }
+      for (uint64_t index_image = 0; index_image < _header->number_of_identifiers; ++index_image) {
+        matches_[_identifiers[index_image]].reserve(matchables_query_.size());
+      }
+
+      // ds best match storage reused for all query descriptors
+      MatchAccumulator best_matches(_header->number_of_identifiers);
+      for (const Matchable* matchable_query : matchables_query_) {
+        const ObjectType& object_query = matchable_query->objects.begin()->second;
+        best_matches.reset();
+        _scan(matchable_query->descriptor,
+              maximum_distance_matching_,
+              [&](const uint64_t& index_entry, const uint32_t& distance) {
+                for (uint64_t index_object = _object_ranges[index_entry];
+                     index_object < _object_ranges[index_entry + 1];
+                     ++index_object) {
+                  const Object& object = _objects[index_object];
+                  best_matches.add(object.image_identifier,
+                                   matchable_query,
+                                   nullptr,
+                                   object_query,
+                                   object.object,
+                                   distance);
+                }
+                return true;
+              });
+
+        // ds register all matches in the output structure
+        for (size_t index = 0; index < best_matches.size(); ++index) {
+          matches_[best_matches.identifier(index)].push_back(best_matches.match(index));
+        }
+      }
+    }
+
+    // ds helpers
+  protected:
+    //! @brief descends to the leaf of descriptor_query_ and visits all entries within the
+    //! distance bound (visit_(index_entry, distance), returning false terminates the scan)
+    template <typename Descriptor_, typename Visitor_>
+    void _scan(const Descriptor_& descriptor_query_,
+               const uint32_t& maximum_distance_,
+               Visitor_ visit_) const {
+      const MappedNode* node = _nodes;
+      while (node->index_split_bit >= 0) {
+        node = _nodes + node->index_first + (descriptor_query_[node->index_split_bit] ? 1 : 0);
+      }
+
+      // ds brute-force leaf scan directly on the mapped descriptor words
+      uint64_t query_words[descriptor_size_words];
+      Matchable::getDescriptorWords(descriptor_query_, query_words);
+      uint32_t distances[scan_block_size];
+      const uint32_t number_of_entries = node->number_of_entries;
+      for (uint32_t index_begin = 0; index_begin < number_of_entries;
+           index_begin += scan_block_size) {
+        const uint32_t number_of_entries_block =
+          std::min(scan_block_size, number_of_entries - index_begin);
+        const uint64_t index_entry_begin = node->index_first + index_begin;
+        const uint64_t* entry_words = _descriptor_words + index_entry_begin * descriptor_size_words;
+        if (maximum_distance_ <= Tree::Node::maximum_distance_for_early_exit) {
+          getHammingDistancesBounded<descriptor_size_words>(
+            query_words, entry_words, number_of_entries_block, maximum_distance_, distances);
+        } else {
+          getHammingDistances<descriptor_size_words>(
+            query_words, entry_words, number_of_entries_block, distances);
+        }
+        for (uint32_t index = 0; index < number_of_entries_block; ++index) {
+          if (distances[index] < maximum_distance_) {
+            if (!visit_(index_entry_begin + index, distances[index])) {
+              return;
+            }
+          }
+        }
+      }
+    }
+
+    //! @brief sets the section pointers into the validated database bytes
+    void _resolveSections() {
+      _header      = reinterpret_cast<const MappedHeader*>(_data);
+      _identifiers = reinterpret_cast<const uint64_t*>(_data + _header->offset_identifiers);
+      _nodes       = reinterpret_cast<const MappedNode*>(_data + _header->offset_nodes);
+      _descriptor_words =
+        reinterpret_cast<const uint64_t*>(_data + _header->offset_descriptor_words);
+      _object_ranges = reinterpret_cast<const uint64_t*>(_data + _header->offset_object_ranges);
+      _objects       = reinterpret_cast<const Object*>(_data + _header->offset_objects);
+    }
+
+    //! @brief position of the image of object_ in the sorted identifier section
+    uint64_t _getIndexImage(const Object& object_) const {
+      return std::lower_bound(_identifiers,
+                              _identifiers + _header->number_of_identifiers,
+                              object_.image_identifier) -
+             _identifiers;
+    }
+
+    //! @brief checks header compatibility and that all sections lie within the file
+    bool _isValid(const bool& verify_structure_) const {
+      if (!_data || _size < sizeof(MappedHeader)) {
+        return false;
+      }
+      const MappedHeader& header = *reinterpret_cast<const MappedHeader*>(_data);
+      const MappedHeader reference;
+      if (std::memcmp(header.magic, reference.magic, sizeof(reference.magic)) != 0 ||
+          header.version != MappedHeader::current_version ||
+          header.endianness_check != MappedHeader::endianness ||
+          header.descriptor_size_bits != Matchable::descriptor_size_bits ||
+          header.object_record_size != sizeof(Object) || header.number_of_nodes == 0) {
+        return false;
+      }
+
+      // ds the section layout is fully determined by the section sizes
+      MappedHeader layout(header);
+      layout.computeOffsets(descriptor_size_words);
+      if (layout.offset_identifiers != header.offset_identifiers ||
+          layout.offset_nodes != header.offset_nodes ||
+          layout.offset_descriptor_words != header.offset_descriptor_words ||
+          layout.offset_object_ranges != header.offset_object_ranges ||
+          layout.offset_objects != header.offset_objects || layout.file_size != header.file_size ||
+          header.file_size != _size) {
+        return false;
+      }
+      if (!verify_structure_) {
+        return true;
+      }
+
+      // ds all children and entry ranges must be within bounds
+      const MappedNode* nodes =
+        reinterpret_cast<const MappedNode*>(_data + header.offset_nodes);
+      const uint64_t* object_ranges =
+        reinterpret_cast<const uint64_t*>(_data + header.offset_object_ranges);
+      for (uint64_t index_node = 0; index_node < header.number_of_nodes; ++index_node) {
+        const MappedNode& node = nodes[index_node];
+        if (node.index_split_bit >= 0) {
+          if (node.index_split_bit >= static_cast<int32_t>(Matchable::descriptor_size_bits) ||
+              node.index_first <= index_node || node.index_first + 1 >= header.number_of_nodes) {
+            return false;
+          }
+        } else if (node.index_first + node.number_of_entries > header.number_of_entries) {
+          return false;
+        }
+      }
+      for (uint64_t index_entry = 0; index_entry < header.number_of_entries; ++index_entry) {
+        if (object_ranges[index_entry] > object_ranges[index_entry + 1]) {
+          return false;
+        }
+      }
+      return object_ranges[header.number_of_entries] == header.number_of_objects;
+    }
+
+    // ds attributes
+  protected:
+    //! @brief memory mapping of the database file
+    MappedFile _file;
+
+    //! @brief owned database image (frozen in memory instead of mapped)
+    std::vector<uint64_t> _image;
+
+    //! @brief database bytes (mapping or image) and their number
+    const char* _data = nullptr;
+    uint64_t _size    = 0;
+
+    //! @brief sections (pointing into the mapping)
+    const MappedHeader* _header       = nullptr;
+    const uint64_t* _identifiers      = nullptr;
+    const MappedNode* _nodes          = nullptr;
+    const uint64_t* _descriptor_words = nullptr;
+    const uint64_t* _object_ranges    = nullptr;
+    const Object* _objects            = nullptr;
+  };
+
+  template <typename BinaryTreeType_>
+  constexpr uint32_t BinaryTreeMapped<BinaryTreeType_>::descriptor_size_words;
+  template <typename BinaryTreeType_>
+  constexpr uint32_t BinaryTreeMapped<BinaryTreeType_>::scan_block_size;
+
+} // namespace srrg_hbst
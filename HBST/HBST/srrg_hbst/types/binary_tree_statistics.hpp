@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+namespace srrg_hbst {
+
+  //! @brief histogram bucket of a leaf size: 0 for empty leafs, b for sizes in [2^(b-1), 2^b)
+  inline size_t getLeafSizeBucket(const uint64_t& leaf_size_) {
+    size_t bucket = 0;
+    for (uint64_t size = leaf_size_; size > 0; size >>= 1) {
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  //! @brief increments bin_ of histogram_ (the histogram grows as needed)
+  inline void addToHistogram(std::vector<uint64_t>& histogram_,
+                             const size_t& bin_,
+                             const uint64_t& count_ = 1) {
+    if (histogram_.size() <= bin_) {
+      histogram_.resize(bin_ + 1, 0);
+    }
+    histogram_[bin_] += count_;
+  }
+
+  //! @brief writes the non-empty bins of a histogram, one per line
+  inline void writeHistogram(std::ostream& stream_,
+                             const std::vector<uint64_t>& histogram_,
+                             const bool& leaf_size_buckets_) {
+    for (size_t bin = 0; bin < histogram_.size(); ++bin) {
+      if (histogram_[bin] == 0) {
+        continue;
+      }
+      if (leaf_size_buckets_) {
+        const uint64_t size_begin = bin == 0 ? 0 : uint64_t(1) << (bin - 1);
+        const uint64_t size_end   = uint64_t(1) << bin;
+        stream_ << "  [" << size_begin << ", " << size_end << "): " << histogram_[bin] << "\n";
+      } else {
+        stream_ << "  " << bin << ": " << histogram_[bin] << "\n";
+      }
+    }
+  }
+
+  //! @brief traversal counters of tree queries (collected if SRRG_HBST_STATISTICS is defined, see
+  //! BinaryTree::getStatistics) - one query is a single query matchable
+  struct BinaryQueryStatistics {
+    //! @brief records a query matchable
+    void addQuery() {
+      ++number_of_queries;
+    }
+
+    //! @brief records a leaf reached by a query
+    //! @param[in] number_of_nodes_ nodes visited to reach the leaf (including the leaf)
+    //! @param[in] depth_ depth of the leaf
+    //! @param[in] leaf_size_ number of references in the leaf
+    //! @param[in] number_of_comparisons_ number of references compared in the leaf (references
+    //! skipped by the popcount window or pivot pruning are not compared, see BinaryNode::scan)
+    //! @param[in] number_of_matches_ references within the matching distance
+    void addLeaf(const uint64_t& number_of_nodes_,
+                 const uint64_t& depth_,
+                 const uint64_t& leaf_size_,
+                 const uint64_t& number_of_comparisons_,
+                 const uint64_t& number_of_matches_) {
+      assert(number_of_matches_ <= number_of_comparisons_);
+      assert(number_of_comparisons_ <= leaf_size_);
+      number_of_nodes_visited += number_of_nodes_;
+      ++number_of_leafs_visited;
+      number_of_comparisons += number_of_comparisons_;
+      number_of_matches += number_of_matches_;
+      number_of_matches_rejected += number_of_comparisons_ - number_of_matches_;
+      maximum_depth     = std::max(maximum_depth, depth_);
+      maximum_leaf_size = std::max(maximum_leaf_size, leaf_size_);
+      addToHistogram(depth_histogram, depth_);
+      addToHistogram(leaf_size_histogram, getLeafSizeBucket(leaf_size_));
+    }
+
+    //! @brief accumulates the counters of other_
+    BinaryQueryStatistics& operator+=(const BinaryQueryStatistics& other_) {
+      number_of_queries += other_.number_of_queries;
+      number_of_nodes_visited += other_.number_of_nodes_visited;
+      number_of_leafs_visited += other_.number_of_leafs_visited;
+      number_of_comparisons += other_.number_of_comparisons;
+      number_of_matches += other_.number_of_matches;
+      number_of_matches_rejected += other_.number_of_matches_rejected;
+      maximum_depth     = std::max(maximum_depth, other_.maximum_depth);
+      maximum_leaf_size = std::max(maximum_leaf_size, other_.maximum_leaf_size);
+      for (size_t bin = 0; bin < other_.depth_histogram.size(); ++bin) {
+        addToHistogram(depth_histogram, bin, other_.depth_histogram[bin]);
+      }
+      for (size_t bin = 0; bin < other_.leaf_size_histogram.size(); ++bin) {
+        addToHistogram(leaf_size_histogram, bin, other_.leaf_size_histogram[bin]);
+      }
+      return *this;
+    }
+
+    //! @brief writes all counters in human readable form
+    void write(std::ostream& stream_) const {
+      stream_ << "queries: " << number_of_queries << "\n"
+              << "nodes visited: " << number_of_nodes_visited << "\n"
+              << "leafs visited: " << number_of_leafs_visited << "\n"
+              << "comparisons: " << number_of_comparisons << "\n"
+              << "matches: " << number_of_matches << "\n"
+              << "matches rejected (distance): " << number_of_matches_rejected << "\n"
+              << "maximum depth: " << maximum_depth << "\n"
+              << "maximum leaf size: " << maximum_leaf_size << "\n"
+              << "leaf visits per depth:\n";
+      writeHistogram(stream_, depth_histogram, false);
+      stream_ << "leaf visits per leaf size:\n";
+      writeHistogram(stream_, leaf_size_histogram, true);
+    }
+
+    uint64_t number_of_queries          = 0;
+    uint64_t number_of_nodes_visited    = 0;
+    uint64_t number_of_leafs_visited    = 0;
+    uint64_t number_of_comparisons      = 0;
+    uint64_t number_of_matches          = 0;
+    uint64_t number_of_matches_rejected = 0;
+    uint64_t maximum_depth              = 0;
+    uint64_t maximum_leaf_size          = 0;
+
+    //! @brief number of leaf visits per leaf depth
+    std::vector<uint64_t> depth_histogram;
+
+    //! @brief number of leaf visits per leaf size bucket (see getLeafSizeBucket)
+    std::vector<uint64_t> leaf_size_histogram;
+  };
+
+  //! @brief stand-in for BinaryQueryStatistics without SRRG_HBST_STATISTICS: the recording calls
+  //! in the query paths compile to nothing
+  struct BinaryQueryStatisticsDisabled {
+    void addQuery() {
+    }
+    void addLeaf(const uint64_t& /*number_of_nodes_*/,
+                 const uint64_t& /*depth_*/,
+                 const uint64_t& /*leaf_size_*/,
+                 const uint64_t& /*number_of_comparisons_*/,
+                 const uint64_t& /*number_of_matches_*/) {
+    }
+  };
+
+  //! @brief shape of a tree (see BinaryTree::getShape): leaf depth and size distributions - a few
+  //! oversized or very deep leafs dominate the query time of a database
+  struct BinaryTreeShape {
+    //! @brief records a leaf
+    void addLeaf(const uint64_t& depth_, const uint64_t& leaf_size_) {
+      ++number_of_leafs;
+      number_of_empty_leafs += (leaf_size_ == 0);
+      number_of_matchables += leaf_size_;
+      maximum_depth     = std::max(maximum_depth, depth_);
+      maximum_leaf_size = std::max(maximum_leaf_size, leaf_size_);
+      addToHistogram(depth_histogram, depth_);
+      addToHistogram(leaf_size_histogram, getLeafSizeBucket(leaf_size_));
+    }
+
+    //! @brief writes the shape in human readable form
+    void write(std::ostream& stream_) const {
+      stream_ << "inner nodes: " << number_of_inner_nodes << "\n"
+              << "leafs: " << number_of_leafs << " (empty: " << number_of_empty_leafs << ")\n"
+              << "matchables: " << number_of_matchables << "\n"
+              << "maximum depth: " << maximum_depth << "\n"
+              << "maximum leaf size: " << maximum_leaf_size << "\n"
+              << "leafs per depth:\n";
+      writeHistogram(stream_, depth_histogram, false);
+      stream_ << "leafs per leaf size:\n";
+      writeHistogram(stream_, leaf_size_histogram, true);
+    }
+
+    uint64_t number_of_inner_nodes = 0;
+    uint64_t number_of_leafs       = 0;
+    uint64_t number_of_empty_leafs = 0;
+    uint64_t number_of_matchables  = 0;
+    uint64_t maximum_depth         = 0;
+    uint64_t maximum_leaf_size     = 0;
+
+    //! @brief number of leafs per depth
+    std::vector<uint64_t> depth_histogram;
+
+    //! @brief number of leafs per leaf size bucket (see getLeafSizeBucket)
+    std::vector<uint64_t> leaf_size_histogram;
+  };
+
+} // namespace srrg_hbst
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace srrg_hbst {
+
+  //! @class epoch based reclamation for a single writer and lock-free readers: objects that have
+  //! been unlinked by the writer are retired and only deleted once no reader that might still
+  //! hold them is active
+  class EpochReclaimer {
+    // ds exports
+  public:
+    //! @brief maximum number of simultaneously active readers (further readers wait for a slot)
+    static constexpr size_t maximum_number_of_readers = 128;
+
+    //! @brief scoped reader registration: objects reachable while the guard is alive are not freed
+    class Guard {
+    public:
+      //! @brief enters a read section (no-op for reclaimer_ == nullptr)
+      Guard(EpochReclaimer* reclaimer_) : _reclaimer(reclaimer_) {
+        if (_reclaimer) {
+          _slot = _reclaimer->_enter();
+        }
+      }
+
+      //! @brief leaves the read section
+      ~Guard() {
+        if (_reclaimer) {
+          _reclaimer->_leave(_slot);
+        }
+      }
+
+      Guard(const Guard&) = delete;
+      Guard& operator=(const Guard&) = delete;
+
+    protected:
+      EpochReclaimer* _reclaimer;
+      size_t _slot = 0;
+    };
+
+    // ds ctor/dtor
+  public:
+    EpochReclaimer() {
+      for (std::atomic<uint64_t>& slot : _slots) {
+        slot.store(0);
+      }
+    }
+
+    //! @brief frees all retired objects (no readers may be active)
+    ~EpochReclaimer() {
+      clear();
+    }
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // ds access (writer)
+  public:
+    //! @brief schedules an unlinked object for deletion
+    template <typename Type_>
+    void retire(const Type_* object_) {
+      _retired.emplace_back(_epoch.load(), [object_]() { delete object_; });
+    }
+
+    //! @brief advances the epoch and frees all retired objects no active reader can still hold -
+    //! to be called after new versions have been published
+    void synchronize() {
+      _epoch.fetch_add(1);
+
+      // ds oldest epoch still observed by a reader
+      uint64_t epoch_oldest = std::numeric_limits<uint64_t>::max();
+      for (const std::atomic<uint64_t>& slot : _slots) {
+        const uint64_t epoch = slot.load();
+        if (epoch != 0 && epoch < epoch_oldest) {
+          epoch_oldest = epoch;
+        }
+      }
+
+      // ds objects retired before the oldest reader entered are unreachable
+      size_t number_of_pending = 0;
+      for (std::pair<uint64_t, std::function<void()>>& retired : _retired) {
+        if (retired.first < epoch_oldest) {
+          retired.second();
+        } else {
+          if (&_retired[number_of_pending] != &retired) {
+            _retired[number_of_pending] = std::move(retired);
+          }
+          ++number_of_pending;
+        }
+      }
+      _retired.resize(number_of_pending);
+    }
+
+    //! @brief frees all retired objects immediately (no readers may be active)
+    void clear() {
+      for (std::pair<uint64_t, std::function<void()>>& retired : _retired) {
+        retired.second();
+      }
+      _retired.clear();
+    }
+
+    //! @brief number of retired objects waiting for readers to leave
+    size_t numberOfPending() const {
+      return _retired.size();
+    }
+
+    // ds helpers
+  protected:
+    size_t _enter() {
+      while (true) {
+        for (size_t index_slot = 0; index_slot < maximum_number_of_readers; ++index_slot) {
+          // ds the epoch is read before the slot is claimed: the slot may only be conservative
+          uint64_t epoch_free = 0;
+          if (_slots[index_slot].load() == 0 &&
+              _slots[index_slot].compare_exchange_strong(epoch_free, _epoch.load())) {
+            return index_slot;
+          }
+        }
+        std::this_thread::yield();
+      }
+    }
+
+    void _leave(const size_t& index_slot_) {
+      _slots[index_slot_].store(0);
+    }
+
+    // ds attributes
+  protected:
+    //! @brief global epoch (starts at 1, 0 marks free reader slots)
+    std::atomic<uint64_t> _epoch{1};
+
+    //! @brief epoch observed by each active reader
+    std::atomic<uint64_t> _slots[maximum_number_of_readers];
+
+    //! @brief retired objects with their retirement epoch (writer only)
+    std::vector<std::pair<uint64_t, std::function<void()>>> _retired;
+  };
+
+} // namespace srrg_hbst
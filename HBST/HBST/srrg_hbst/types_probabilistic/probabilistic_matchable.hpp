@@ -7,7 +7,7 @@ namespace srrg_hbst {
 
   template <typename ObjectType_,
             uint32_t descriptor_size_bits_ = 256,
-            typename real_precision_       = double>
+            typename real_precision_       = float>
   class ProbabilisticMatchable : public BinaryMatchable<ObjectType_, descriptor_size_bits_> {
     // ds template forwarding
   public:
@@ -63,7 +63,8 @@ namespace srrg_hbst {
 
     // ds attributes
   public:
-    // ds statistical data: bit probabilities
+    // ds statistical data: bit probabilities (single precision by default, the nodes gather them
+    // into contiguous per-node matrices for the split statistics)
     BitStatisticsVector bit_probabilities;
 
     // ds statistical data: bit volatity info, maximum number of appearances where the bit was
@@ -0,0 +1,495 @@
+// ds offline synthetic benchmark: seeded binary descriptor corpora with noise, duplicates and
+// revisits - measures insertion throughput, query latency percentiles, recall against brute force
+// and memory per descriptor for a sweep over splitting strategies, leaf sizes and depths
+//
+// build: g++ -O3 -std=c++11 -I<directory containing srrg_hbst/types> benchmark_search.cpp -lpthread
+// usage: benchmark_search [--descriptors 1e6] [--descriptors-per-image 1000] [--queries 100]
+//                         [--noise 8] [--duplicates 0.05] [--revisits 0.5] [--seed 0]
+//                         [--strategies even,uneven,random] [--leaf-sizes 50,100,200]
+//                         [--depths 256] [--distance 25] [--recall-queries 200] [--threads 1]
+//                         [--pivots 0] [--popcount-order 0] [--match-and-add]
+// one output line per configuration: insertion throughput (descriptors per second, add or
+// matchAndAdd), match latency percentiles per query image, recall of the best match per image
+// (-1 if --recall-queries 0), resident bytes per descriptor (Linux only) and the tree shape
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <srrg_hbst/types/binary_tree.hpp>
+
+// ds we associate our data with integer indexes (descriptor index in the corpus)
+typedef srrg_hbst::BinaryTree256<uint64_t> Tree;
+typedef Tree::Descriptor Descriptor;
+static constexpr uint32_t descriptor_size_words = Tree::Matchable::descriptor_size_words;
+
+// ds benchmark configuration (see usage)
+struct Configuration {
+  uint64_t number_of_descriptors                = 1000000;
+  uint64_t number_of_descriptors_per_image      = 1000;
+  uint64_t number_of_query_images               = 100;
+  uint32_t number_of_noise_bits                 = 8;
+  double duplicate_ratio                        = 0.05;
+  double revisit_ratio                          = 0.5;
+  uint32_t seed                                 = 0;
+  std::vector<std::string> strategies           = {"even", "uneven", "random"};
+  std::vector<uint64_t> leaf_sizes              = {50, 100, 200};
+  std::vector<uint64_t> depths                  = {256};
+  uint32_t maximum_distance                     = 25;
+  uint64_t number_of_recall_queries             = 200;
+  uint64_t number_of_threads                    = 1;
+  uint64_t minimum_leaf_size_for_pivots         = 0;
+  uint64_t minimum_leaf_size_for_popcount_order = 0;
+  bool match_and_add                            = false;
+};
+
+// ds synthetic corpus: images of descriptors, each image is either a new place (uniform random
+// descriptors) or a revisit of an earlier image (noisy copies of its descriptors) - within an
+// image a fraction of the descriptors duplicates another one (repetitive structure)
+struct Corpus {
+  std::vector<Descriptor> descriptors;
+  uint64_t number_of_images = 0;
+};
+
+// ds parses a comma separated list
+template <typename Type_>
+std::vector<Type_> parseList(const std::string& text_) {
+  std::vector<Type_> values;
+  std::stringstream stream(text_);
+  std::string token;
+  while (std::getline(stream, token, ',')) {
+    std::stringstream stream_token(token);
+    Type_ value;
+    stream_token >> value;
+    values.push_back(value);
+  }
+  return values;
+}
+
+// ds descriptor with uniformly random bits
+Descriptor getRandomDescriptor(std::mt19937_64& random_number_generator_) {
+  Descriptor descriptor;
+  for (uint32_t index_word = 0; index_word < descriptor_size_words; ++index_word) {
+    const uint64_t word = random_number_generator_();
+    for (uint32_t index_bit = 0; index_bit < 64; ++index_bit) {
+      descriptor[index_word * 64 + index_bit] = (word >> index_bit) & 1;
+    }
+  }
+  return descriptor;
+}
+
+// ds flips number_of_bits_ distinct random bits
+void addNoise(Descriptor& descriptor_,
+              const uint32_t& number_of_bits_,
+              std::mt19937_64& random_number_generator_) {
+  std::uniform_int_distribution<uint32_t> bit_index(0, Tree::Matchable::descriptor_size_bits - 1);
+  Descriptor flips;
+  while (flips.count() < number_of_bits_) {
+    flips.set(bit_index(random_number_generator_));
+  }
+  descriptor_ ^= flips;
+}
+
+// ds generates the descriptors of an image (revisiting an earlier image of reference_ if drawn)
+void generateImage(std::vector<Descriptor>& descriptors_,
+                   const std::vector<Descriptor>& reference_,
+                   const uint64_t& number_of_reference_images_,
+                   const Configuration& configuration_,
+                   std::mt19937_64& random_number_generator_) {
+  const uint64_t number_of_descriptors = configuration_.number_of_descriptors_per_image;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const bool revisit = number_of_reference_images_ > 0 &&
+                       uniform(random_number_generator_) < configuration_.revisit_ratio;
+  std::uniform_int_distribution<uint64_t> reference_image(0, number_of_reference_images_ - 1);
+  const uint64_t index_reference_begin =
+    revisit ? reference_image(random_number_generator_) * number_of_descriptors : 0;
+  for (uint64_t index = 0; index < number_of_descriptors; ++index) {
+    if (index > 0 && uniform(random_number_generator_) < configuration_.duplicate_ratio) {
+      std::uniform_int_distribution<uint64_t> earlier(descriptors_.size() - index,
+                                                      descriptors_.size() - 1);
+      descriptors_.push_back(descriptors_[earlier(random_number_generator_)]);
+    } else if (revisit) {
+      Descriptor descriptor = reference_[index_reference_begin + index];
+      addNoise(descriptor, configuration_.number_of_noise_bits, random_number_generator_);
+      descriptors_.push_back(descriptor);
+    } else {
+      descriptors_.push_back(getRandomDescriptor(random_number_generator_));
+    }
+  }
+}
+
+// ds current resident memory in bytes (0 if not available on this platform)
+uint64_t getResidentBytes() {
+#ifdef __GLIBC__
+  // ds return freed heap pages to the system for comparable measurements
+  malloc_trim(0);
+#endif
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  uint64_t number_of_pages_total    = 0;
+  uint64_t number_of_pages_resident = 0;
+  if (statm >> number_of_pages_total >> number_of_pages_resident) {
+    return number_of_pages_resident * 4096;
+  }
+#endif
+  return 0;
+}
+
+// ds value at percentile_ of sorted values_
+double getPercentile(const std::vector<double>& values_, const double& percentile_) {
+  if (values_.empty()) {
+    return 0;
+  }
+  const size_t index = static_cast<size_t>(percentile_ * (values_.size() - 1) + 0.5);
+  return values_[std::min(index, values_.size() - 1)];
+}
+
+// ds creates matchables for the descriptors [index_begin_, index_end_) of an image in the pool
+// of the tree they are added to (contiguous per image, freed by the tree)
+Tree::MatchableVector getMatchables(Tree& tree_,
+                                    const std::vector<Descriptor>& descriptors_,
+                                    const uint64_t& index_begin_,
+                                    const uint64_t& index_end_,
+                                    const uint64_t& identifier_image_) {
+  Tree::MatchableVector matchables;
+  matchables.reserve(index_end_ - index_begin_);
+  tree_.reserveMatchables(index_end_ - index_begin_);
+  for (uint64_t index = index_begin_; index < index_end_; ++index) {
+    matchables.push_back(tree_.allocateMatchable(index, descriptors_[index], identifier_image_));
+  }
+  return matchables;
+}
+
+// ds creates query matchables for the descriptors [index_begin_, index_end_) of an image in a
+// pool of the caller (freed with the pool)
+Tree::MatchableVector getMatchables(Tree::MatchablePool& pool_,
+                                    const std::vector<Descriptor>& descriptors_,
+                                    const uint64_t& index_begin_,
+                                    const uint64_t& index_end_,
+                                    const uint64_t& identifier_image_) {
+  Tree::MatchableVector matchables;
+  matchables.reserve(index_end_ - index_begin_);
+  pool_.reserve(index_end_ - index_begin_);
+  for (uint64_t index = index_begin_; index < index_end_; ++index) {
+    matchables.push_back(pool_.create(index, descriptors_[index], identifier_image_));
+  }
+  return matchables;
+}
+
+// ds recall ground truth: queries sampled evenly over all query images and their best distance
+// per corpus image within the matching distance (independent of the tree configuration)
+struct GroundTruth {
+  std::vector<Descriptor> queries;
+  std::vector<std::unordered_map<uint64_t, uint32_t>> distances_best;
+};
+
+// ds computes the ground truth by brute force over the whole corpus - the corpus is packed for
+// the block distance kernel one image at a time
+GroundTruth getGroundTruth(const Corpus& corpus_,
+                           const std::vector<Descriptor>& queries_,
+                           const Configuration& configuration_) {
+  GroundTruth ground_truth;
+  const uint64_t number_of_queries =
+    std::min(configuration_.number_of_recall_queries, static_cast<uint64_t>(queries_.size()));
+  if (number_of_queries == 0) {
+    return ground_truth;
+  }
+  ground_truth.queries.reserve(number_of_queries);
+  for (uint64_t index_query = 0; index_query < number_of_queries; ++index_query) {
+    ground_truth.queries.push_back(queries_[index_query * queries_.size() / number_of_queries]);
+  }
+  std::vector<uint64_t> query_words(number_of_queries * descriptor_size_words);
+  for (uint64_t index_query = 0; index_query < number_of_queries; ++index_query) {
+    Tree::Matchable::getDescriptorWords(ground_truth.queries[index_query],
+                                        &query_words[index_query * descriptor_size_words]);
+  }
+
+  // ds best distance per image within the matching distance
+  const uint64_t number_of_descriptors_per_image = configuration_.number_of_descriptors_per_image;
+  ground_truth.distances_best.resize(number_of_queries);
+  std::vector<uint64_t> image_words(number_of_descriptors_per_image * descriptor_size_words);
+  std::vector<uint32_t> distances(number_of_descriptors_per_image);
+  for (uint64_t index_image = 0; index_image < corpus_.number_of_images; ++index_image) {
+    for (uint64_t index = 0; index < number_of_descriptors_per_image; ++index) {
+      Tree::Matchable::getDescriptorWords(
+        corpus_.descriptors[index_image * number_of_descriptors_per_image + index],
+        &image_words[index * descriptor_size_words]);
+    }
+    for (uint64_t index_query = 0; index_query < number_of_queries; ++index_query) {
+      srrg_hbst::getHammingDistances<descriptor_size_words>(
+        &query_words[index_query * descriptor_size_words],
+        image_words.data(),
+        number_of_descriptors_per_image,
+        distances.data());
+      const uint32_t distance_best = *std::min_element(distances.begin(), distances.end());
+      if (distance_best < configuration_.maximum_distance) {
+        ground_truth.distances_best[index_query][index_image] = distance_best;
+      }
+    }
+  }
+  return ground_truth;
+}
+
+// ds fraction of (query, image) pairs with a reference within the matching distance for which
+// the tree reports the best distance (see GroundTruth)
+double getRecall(const Tree& tree_,
+                 const Corpus& corpus_,
+                 const GroundTruth& ground_truth_,
+                 const Configuration& configuration_) {
+  const std::vector<Descriptor>& queries = ground_truth_.queries;
+  const std::vector<std::unordered_map<uint64_t, uint32_t>>& distances_best =
+    ground_truth_.distances_best;
+  const uint64_t number_of_queries = queries.size();
+  if (number_of_queries == 0) {
+    return -1;
+  }
+
+  // ds tree results for the same queries
+  Tree::MatchablePool pool_query;
+  Tree::MatchableVector matchables_query =
+    getMatchables(pool_query, queries, 0, number_of_queries, corpus_.number_of_images);
+  std::unordered_map<const Tree::Matchable*, uint64_t> indices_query;
+  for (uint64_t index_query = 0; index_query < number_of_queries; ++index_query) {
+    indices_query[matchables_query[index_query]] = index_query;
+  }
+  Tree::MatchVectorMap matches;
+  tree_.match(matchables_query, matches, configuration_.maximum_distance);
+  uint64_t number_of_pairs       = 0;
+  uint64_t number_of_pairs_found = 0;
+  for (const std::unordered_map<uint64_t, uint32_t>& distances_query : distances_best) {
+    number_of_pairs += distances_query.size();
+  }
+  for (const Tree::MatchVectorMap::value_type& matches_image : matches) {
+    for (const Tree::Match& match : matches_image.second) {
+      const std::unordered_map<uint64_t, uint32_t>& distances_query =
+        distances_best[indices_query.at(match.matchable_query)];
+      const std::unordered_map<uint64_t, uint32_t>::const_iterator iterator =
+        distances_query.find(matches_image.first);
+      if (iterator != distances_query.end() && iterator->second == match.distance) {
+        ++number_of_pairs_found;
+      }
+    }
+  }
+  return number_of_pairs > 0 ? static_cast<double>(number_of_pairs_found) / number_of_pairs : 1;
+}
+
+// ds builds a tree on the corpus for one configuration and reports all measurements
+void runConfiguration(const Corpus& corpus_,
+                      const std::vector<Descriptor>& queries_,
+                      const GroundTruth& ground_truth_,
+                      const Configuration& configuration_,
+                      const std::string& strategy_,
+                      const srrg_hbst::SplittingStrategy& train_mode_,
+                      const uint64_t& leaf_size_,
+                      const uint64_t& depth_) {
+  Tree::Node::maximum_leaf_size            = leaf_size_;
+  Tree::Node::maximum_depth                = depth_;
+  Tree::Node::minimum_leaf_size_for_pivots = configuration_.minimum_leaf_size_for_pivots;
+  Tree::Node::minimum_leaf_size_for_popcount_order =
+    configuration_.minimum_leaf_size_for_popcount_order;
+  Tree::Node::seedRandomNumberGenerator(configuration_.seed);
+  const uint64_t number_of_descriptors_per_image = configuration_.number_of_descriptors_per_image;
+  const uint64_t bytes_before                    = getResidentBytes();
+
+  // ds insertion (one image at a time)
+  Tree tree;
+  if (configuration_.number_of_threads > 1) {
+    tree.setThreadPool(std::make_shared<srrg_hbst::ThreadPool>(configuration_.number_of_threads));
+  }
+  double duration_insertion_seconds = 0;
+  for (uint64_t index_image = 0; index_image < corpus_.number_of_images; ++index_image) {
+    const uint64_t index_begin       = index_image * number_of_descriptors_per_image;
+    Tree::MatchableVector matchables = getMatchables(tree,
+                                                     corpus_.descriptors,
+                                                     index_begin,
+                                                     index_begin + number_of_descriptors_per_image,
+                                                     index_image);
+    const std::chrono::steady_clock::time_point time_begin = std::chrono::steady_clock::now();
+    if (configuration_.match_and_add) {
+      Tree::MatchVectorMap matches;
+      tree.matchAndAdd(matchables, matches, configuration_.maximum_distance, train_mode_);
+    } else {
+      tree.add(matchables, train_mode_);
+    }
+    duration_insertion_seconds +=
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - time_begin).count();
+  }
+  const uint64_t bytes_after = getResidentBytes();
+
+  // ds query latency per query image
+  std::vector<double> durations_query_milliseconds;
+  durations_query_milliseconds.reserve(configuration_.number_of_query_images);
+  Tree::MatchablePool pool_query;
+  for (uint64_t index_image = 0; index_image < configuration_.number_of_query_images;
+       ++index_image) {
+    const uint64_t index_begin       = index_image * number_of_descriptors_per_image;
+    Tree::MatchableVector matchables = getMatchables(pool_query,
+                                                     queries_,
+                                                     index_begin,
+                                                     index_begin + number_of_descriptors_per_image,
+                                                     corpus_.number_of_images + index_image);
+    Tree::MatchVectorMap matches;
+    const std::chrono::steady_clock::time_point time_begin = std::chrono::steady_clock::now();
+    tree.match(matchables, matches, configuration_.maximum_distance);
+    durations_query_milliseconds.push_back(
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_begin)
+        .count());
+    pool_query.clear();
+  }
+  std::sort(durations_query_milliseconds.begin(), durations_query_milliseconds.end());
+
+  // ds recall and tree shape
+  const double recall                    = getRecall(tree, corpus_, ground_truth_, configuration_);
+  const srrg_hbst::BinaryTreeShape shape = tree.getShape();
+  const double number_of_descriptors     = static_cast<double>(corpus_.descriptors.size());
+  std::printf("%-7s %6lu %6lu %12.0f %9.3f %9.3f %9.3f %9.3f %7.4f %8.1f %8lu %8lu %6lu\n",
+              strategy_.c_str(),
+              static_cast<unsigned long>(leaf_size_),
+              static_cast<unsigned long>(depth_),
+              number_of_descriptors / duration_insertion_seconds,
+              getPercentile(durations_query_milliseconds, 0.5),
+              getPercentile(durations_query_milliseconds, 0.9),
+              getPercentile(durations_query_milliseconds, 0.99),
+              getPercentile(durations_query_milliseconds, 1),
+              recall,
+              bytes_after > bytes_before ? (bytes_after - bytes_before) / number_of_descriptors : 0,
+              static_cast<unsigned long>(shape.number_of_leafs),
+              static_cast<unsigned long>(shape.maximum_leaf_size),
+              static_cast<unsigned long>(shape.maximum_depth));
+  std::fflush(stdout);
+  tree.clear(true);
+}
+
+int32_t main(int32_t argc_, char** argv_) {
+  // ds parse arguments
+  Configuration configuration;
+  for (int32_t index = 1; index < argc_; ++index) {
+    const std::string argument(argv_[index]);
+    if (argument == "--match-and-add") {
+      configuration.match_and_add = true;
+      continue;
+    }
+    if (index + 1 >= argc_) {
+      std::cerr << "benchmark_search|ERROR: missing value for argument: " << argument << std::endl;
+      return 1;
+    }
+    const std::string value(argv_[++index]);
+    if (argument == "--descriptors") {
+      configuration.number_of_descriptors = static_cast<uint64_t>(std::atof(value.c_str()));
+    } else if (argument == "--descriptors-per-image") {
+      configuration.number_of_descriptors_per_image =
+        static_cast<uint64_t>(std::atof(value.c_str()));
+    } else if (argument == "--queries") {
+      configuration.number_of_query_images = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (argument == "--noise") {
+      configuration.number_of_noise_bits = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (argument == "--duplicates") {
+      configuration.duplicate_ratio = std::atof(value.c_str());
+    } else if (argument == "--revisits") {
+      configuration.revisit_ratio = std::atof(value.c_str());
+    } else if (argument == "--seed") {
+      configuration.seed = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (argument == "--strategies") {
+      configuration.strategies = parseList<std::string>(value);
+    } else if (argument == "--leaf-sizes") {
+      configuration.leaf_sizes = parseList<uint64_t>(value);
+    } else if (argument == "--depths") {
+      configuration.depths = parseList<uint64_t>(value);
+    } else if (argument == "--distance") {
+      configuration.maximum_distance = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (argument == "--recall-queries") {
+      configuration.number_of_recall_queries = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (argument == "--threads") {
+      configuration.number_of_threads = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (argument == "--pivots") {
+      configuration.minimum_leaf_size_for_pivots = std::strtoull(value.c_str(), nullptr, 10);
+    } else if (argument == "--popcount-order") {
+      configuration.minimum_leaf_size_for_popcount_order =
+        std::strtoull(value.c_str(), nullptr, 10);
+    } else {
+      std::cerr << "benchmark_search|ERROR: unknown argument: " << argument << std::endl;
+      return 1;
+    }
+  }
+  if (configuration.number_of_descriptors_per_image == 0 ||
+      configuration.number_of_descriptors < configuration.number_of_descriptors_per_image) {
+    std::cerr << "benchmark_search|ERROR: at least one image of descriptors is required"
+              << std::endl;
+    return 1;
+  }
+
+  // ds generate corpus and query images (queries revisit corpus images or show new places)
+  std::mt19937_64 random_number_generator(configuration.seed);
+  Corpus corpus;
+  corpus.number_of_images =
+    configuration.number_of_descriptors / configuration.number_of_descriptors_per_image;
+  corpus.descriptors.reserve(corpus.number_of_images *
+                             configuration.number_of_descriptors_per_image);
+  for (uint64_t index_image = 0; index_image < corpus.number_of_images; ++index_image) {
+    generateImage(
+      corpus.descriptors, corpus.descriptors, index_image, configuration, random_number_generator);
+  }
+  std::vector<Descriptor> queries;
+  queries.reserve(configuration.number_of_query_images *
+                  configuration.number_of_descriptors_per_image);
+  for (uint64_t index_image = 0; index_image < configuration.number_of_query_images;
+       ++index_image) {
+    generateImage(queries,
+                  corpus.descriptors,
+                  corpus.number_of_images,
+                  configuration,
+                  random_number_generator);
+  }
+  std::cerr << "benchmark_search|generated corpus: " << corpus.descriptors.size()
+            << " descriptors in " << corpus.number_of_images << " images, "
+            << configuration.number_of_query_images << " query images" << std::endl;
+
+  // ds recall ground truth (shared by all configurations)
+  const GroundTruth ground_truth = getGroundTruth(corpus, queries, configuration);
+
+  // ds parameter sweep
+  std::printf("%-7s %6s %6s %12s %9s %9s %9s %9s %7s %8s %8s %8s %6s\n",
+              "split",
+              "leaf",
+              "depth",
+              "insert[1/s]",
+              "p50[ms]",
+              "p90[ms]",
+              "p99[ms]",
+              "max[ms]",
+              "recall",
+              "B/desc",
+              "leafs",
+              "leaf_max",
+              "d_max");
+  for (const std::string& strategy : configuration.strategies) {
+    srrg_hbst::SplittingStrategy train_mode = srrg_hbst::SplittingStrategy::SplitEven;
+    if (strategy == "uneven") {
+      train_mode = srrg_hbst::SplittingStrategy::SplitUneven;
+    } else if (strategy == "random") {
+      train_mode = srrg_hbst::SplittingStrategy::SplitRandomUniform;
+    } else if (strategy != "even") {
+      std::cerr << "benchmark_search|ERROR: unknown splitting strategy: " << strategy << std::endl;
+      return 1;
+    }
+    for (const uint64_t& leaf_size : configuration.leaf_sizes) {
+      for (const uint64_t& depth : configuration.depths) {
+        runConfiguration(
+          corpus, queries, ground_truth, configuration, strategy, train_mode, leaf_size, depth);
+      }
+    }
+  }
+  return 0;
+}
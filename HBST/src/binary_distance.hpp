@@ -0,0 +1,549 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <stdint.h>
+
+// ds SIMD kernels are only available on x86-64 - SRRG_HBST_DISABLE_SIMD forces the portable path
+#if !defined(SRRG_HBST_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define SRRG_HBST_HAS_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// ds MSVC emits any intrinsic without flags, gcc/clang require a per-function target
+#if defined(SRRG_HBST_HAS_X86_SIMD) && !defined(_MSC_VER)
+#define SRRG_HBST_TARGET(FEATURES) __attribute__((target(FEATURES)))
+#else
+#define SRRG_HBST_TARGET(FEATURES)
+#endif
+
+namespace srrg_hbst {
+
+  //! @brief available Hamming distance kernels, ordered by preference
+  enum HammingKernel : uint8_t { Portable, Popcount, AVX2, AVX512, Unresolved = 0xFF };
+
+  //! @brief population count of a single word without any instruction set requirements
+  inline uint32_t getPopcountPortable(uint64_t word_) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word_);
+#else
+    word_ = word_ - ((word_ >> 1) & 0x5555555555555555ULL);
+    word_ = (word_ & 0x3333333333333333ULL) + ((word_ >> 2) & 0x3333333333333333ULL);
+    word_ = (word_ + (word_ >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<uint32_t>((word_ * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  //! @brief portable fallback: word-wise population count of the xor
+  template <uint32_t number_of_words_>
+  inline uint32_t getHammingDistancePortable(const uint64_t* a_, const uint64_t* b_) {
+    uint32_t distance = 0;
+    for (uint32_t index_word = 0; index_word < number_of_words_; ++index_word) {
+      distance += getPopcountPortable(a_[index_word] ^ b_[index_word]);
+    }
+    return distance;
+  }
+
+  //! @brief portable fallback: distances of one query to a contiguous block of references
+  template <uint32_t number_of_words_>
+  inline void getHammingDistancesPortable(const uint64_t* query_,
+                                          const uint64_t* references_,
+                                          const uint32_t& number_of_references_,
+                                          uint32_t* distances_) {
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] = getHammingDistancePortable<number_of_words_>(
+        query_, references_ + index * number_of_words_);
+    }
+  }
+
+  //! @brief maximum number of references of a single thresholded block kernel call
+  constexpr uint32_t bounded_block_size = 256;
+
+  //! @brief portable fallback: thresholded distances of one query to a contiguous block of
+  //! references, counted word by word for all references that are still below maximum_distance_
+  //! (branchless compaction of the remaining references after each word, at most
+  //! bounded_block_size references)
+  template <uint32_t number_of_words_>
+  inline void getHammingDistancesBoundedPortable(const uint64_t* query_,
+                                                 const uint64_t* references_,
+                                                 const uint32_t& number_of_references_,
+                                                 const uint32_t& maximum_distance_,
+                                                 uint32_t* distances_) {
+    uint32_t candidates[bounded_block_size];
+    uint32_t number_of_candidates = 0;
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] = getPopcountPortable(query_[0] ^ references_[index * number_of_words_]);
+      candidates[number_of_candidates] = index;
+      number_of_candidates += (distances_[index] < maximum_distance_);
+    }
+    for (uint32_t index_word = 1; index_word < number_of_words_ && number_of_candidates > 0;
+         ++index_word) {
+      uint32_t number_of_candidates_kept = 0;
+      for (uint32_t index_candidate = 0; index_candidate < number_of_candidates;
+           ++index_candidate) {
+        const uint32_t index      = candidates[index_candidate];
+        const uint64_t* reference = references_ + index * number_of_words_;
+        distances_[index] += getPopcountPortable(query_[index_word] ^ reference[index_word]);
+        candidates[number_of_candidates_kept] = index;
+        number_of_candidates_kept += (distances_[index] < maximum_distance_);
+      }
+      number_of_candidates = number_of_candidates_kept;
+    }
+  }
+
+#ifdef SRRG_HBST_HAS_X86_SIMD
+  //! @brief hardware popcount (SSE4.2 era) on 64-bit words
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("popcnt")
+  inline uint32_t getHammingDistancePopcount(const uint64_t* a_, const uint64_t* b_) {
+    uint64_t distance = 0;
+    for (uint32_t index_word = 0; index_word < number_of_words_; ++index_word) {
+      distance += _mm_popcnt_u64(a_[index_word] ^ b_[index_word]);
+    }
+    return static_cast<uint32_t>(distance);
+  }
+
+  //! @brief AVX2 nibble lookup popcount over 256-bit lanes, returns 4 partial 64-bit sums
+  SRRG_HBST_TARGET("avx2")
+  inline __m256i getPopcountAVX2(const __m256i& bytes_) {
+    const __m256i lookup   = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i low      = _mm256_and_si256(bytes_, low_mask);
+    const __m256i high     = _mm256_and_si256(_mm256_srli_epi16(bytes_, 4), low_mask);
+    const __m256i counts =
+      _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+  }
+
+  //! @brief AVX2 kernel: 4 words per step, remaining words through hardware popcount
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("avx2,popcnt")
+  inline uint32_t getHammingDistanceAVX2(const uint64_t* a_, const uint64_t* b_) {
+    constexpr uint32_t number_of_blocks = number_of_words_ / 4;
+    __m256i sums                        = _mm256_setzero_si256();
+    for (uint32_t index_block = 0; index_block < number_of_blocks; ++index_block) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_) + index_block);
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_) + index_block);
+      sums            = _mm256_add_epi64(sums, getPopcountAVX2(_mm256_xor_si256(a, b)));
+    }
+    const __m128i sums_128 =
+      _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    uint64_t distance = static_cast<uint64_t>(_mm_cvtsi128_si64(sums_128)) +
+                        static_cast<uint64_t>(_mm_extract_epi64(sums_128, 1));
+    for (uint32_t index_word = number_of_blocks * 4; index_word < number_of_words_;
+         ++index_word) {
+      distance += _mm_popcnt_u64(a_[index_word] ^ b_[index_word]);
+    }
+    return static_cast<uint32_t>(distance);
+  }
+
+  //! @brief AVX-512 VPOPCNTDQ kernel: 8 words per zmm step, 4 words per ymm step (VL), the
+  //! remaining words through hardware popcount
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("avx512f,avx512vl,avx512vpopcntdq,popcnt")
+  inline uint32_t getHammingDistanceAVX512(const uint64_t* a_, const uint64_t* b_) {
+    constexpr uint32_t number_of_blocks_512 = number_of_words_ / 8;
+    constexpr uint32_t number_of_blocks_256 = (number_of_words_ % 8) / 4;
+    uint64_t distance                       = 0;
+    if (number_of_blocks_512 > 0) {
+      __m512i sums = _mm512_setzero_si512();
+      for (uint32_t index_block = 0; index_block < number_of_blocks_512; ++index_block) {
+        const __m512i a = _mm512_loadu_si512(a_ + 8 * index_block);
+        const __m512i b = _mm512_loadu_si512(b_ + 8 * index_block);
+        sums            = _mm512_add_epi64(sums, _mm512_popcnt_epi64(_mm512_xor_si512(a, b)));
+      }
+      uint64_t lanes[8];
+      _mm512_storeu_si512(lanes, sums);
+      distance += lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] +
+                  lanes[7];
+    }
+    if (number_of_blocks_256 > 0) {
+      const uint64_t* a_block = a_ + 8 * number_of_blocks_512;
+      const uint64_t* b_block = b_ + 8 * number_of_blocks_512;
+      const __m256i a         = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_block));
+      const __m256i b         = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b_block));
+      const __m256i counts    = _mm256_popcnt_epi64(_mm256_xor_si256(a, b));
+      const __m128i sums_128 =
+        _mm_add_epi64(_mm256_castsi256_si128(counts), _mm256_extracti128_si256(counts, 1));
+      distance += static_cast<uint64_t>(_mm_cvtsi128_si64(sums_128)) +
+                  static_cast<uint64_t>(_mm_extract_epi64(sums_128, 1));
+    }
+    for (uint32_t index_word = 8 * number_of_blocks_512 + 4 * number_of_blocks_256;
+         index_word < number_of_words_;
+         ++index_word) {
+      distance += _mm_popcnt_u64(a_[index_word] ^ b_[index_word]);
+    }
+    return static_cast<uint32_t>(distance);
+  }
+
+  // ds block kernels: the per pair kernel is inlined into the loop (same target), so the kernel
+  // dispatch is paid once per block instead of once per reference
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("popcnt")
+  inline void getHammingDistancesPopcount(const uint64_t* query_,
+                                          const uint64_t* references_,
+                                          const uint32_t& number_of_references_,
+                                          uint32_t* distances_) {
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] = getHammingDistancePopcount<number_of_words_>(
+        query_, references_ + index * number_of_words_);
+    }
+  }
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("popcnt")
+  inline void getHammingDistancesBoundedPopcount(const uint64_t* query_,
+                                                 const uint64_t* references_,
+                                                 const uint32_t& number_of_references_,
+                                                 const uint32_t& maximum_distance_,
+                                                 uint32_t* distances_) {
+    uint32_t candidates[bounded_block_size];
+    uint32_t number_of_candidates = 0;
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] = static_cast<uint32_t>(
+        _mm_popcnt_u64(query_[0] ^ references_[index * number_of_words_]));
+      candidates[number_of_candidates] = index;
+      number_of_candidates += (distances_[index] < maximum_distance_);
+    }
+    for (uint32_t index_word = 1; index_word < number_of_words_ && number_of_candidates > 0;
+         ++index_word) {
+      uint32_t number_of_candidates_kept = 0;
+      for (uint32_t index_candidate = 0; index_candidate < number_of_candidates;
+           ++index_candidate) {
+        const uint32_t index      = candidates[index_candidate];
+        const uint64_t* reference = references_ + index * number_of_words_;
+        distances_[index] +=
+          static_cast<uint32_t>(_mm_popcnt_u64(query_[index_word] ^ reference[index_word]));
+        candidates[number_of_candidates_kept] = index;
+        number_of_candidates_kept += (distances_[index] < maximum_distance_);
+      }
+      number_of_candidates = number_of_candidates_kept;
+    }
+  }
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("avx2,popcnt")
+  inline void getHammingDistancesAVX2(const uint64_t* query_,
+                                      const uint64_t* references_,
+                                      const uint32_t& number_of_references_,
+                                      uint32_t* distances_) {
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] =
+        getHammingDistanceAVX2<number_of_words_>(query_, references_ + index * number_of_words_);
+    }
+  }
+  template <uint32_t number_of_words_>
+  SRRG_HBST_TARGET("avx512f,avx512vl,avx512vpopcntdq,popcnt")
+  inline void getHammingDistancesAVX512(const uint64_t* query_,
+                                        const uint64_t* references_,
+                                        const uint32_t& number_of_references_,
+                                        uint32_t* distances_) {
+    for (uint32_t index = 0; index < number_of_references_; ++index) {
+      distances_[index] = getHammingDistanceAVX512<number_of_words_>(
+        query_, references_ + index * number_of_words_);
+    }
+  }
+#endif
+
+  //! @class process wide Hamming kernel selection, resolved once on first use by CPU detection
+  //! @brief the template parameter only serves to keep the static storage inside this header
+  template <typename Dummy_ = void>
+  class HammingKernelDispatch {
+  public:
+    //! @brief returns the active kernel (resolving it on the first call)
+    static inline HammingKernel active() {
+      const uint8_t kernel = _active.load(std::memory_order_relaxed);
+      if (kernel == Unresolved) {
+        const HammingKernel kernel_best = getBestSupported();
+        _active.store(kernel_best, std::memory_order_relaxed);
+        return kernel_best;
+      }
+      return static_cast<HammingKernel>(kernel);
+    }
+
+    //! @brief forces a kernel (e.g. for benchmarking), fails if the CPU does not support it
+    static bool set(const HammingKernel& kernel_) {
+      if (!isSupported(kernel_)) {
+        return false;
+      }
+      _active.store(kernel_, std::memory_order_relaxed);
+      return true;
+    }
+
+    //! @brief restores the automatic selection
+    static void reset() {
+      _active.store(getBestSupported(), std::memory_order_relaxed);
+    }
+
+    //! @brief checks if the kernel can be executed on the running CPU
+    static bool isSupported(const HammingKernel& kernel_) {
+      switch (kernel_) {
+        case HammingKernel::Portable:
+          return true;
+#ifdef SRRG_HBST_HAS_X86_SIMD
+        case HammingKernel::Popcount:
+          return _getFeatures().popcnt;
+        case HammingKernel::AVX2:
+          return _getFeatures().avx2 && _getFeatures().popcnt;
+        case HammingKernel::AVX512:
+          return _getFeatures().avx512_vpopcntdq && _getFeatures().avx2 && _getFeatures().popcnt;
+#endif
+        default:
+          return false;
+      }
+    }
+
+    //! @brief fastest kernel supported by the running CPU
+    static HammingKernel getBestSupported() {
+      if (isSupported(HammingKernel::AVX512)) {
+        return HammingKernel::AVX512;
+      }
+      if (isSupported(HammingKernel::AVX2)) {
+        return HammingKernel::AVX2;
+      }
+      if (isSupported(HammingKernel::Popcount)) {
+        return HammingKernel::Popcount;
+      }
+      return HammingKernel::Portable;
+    }
+
+  protected:
+    struct Features {
+      bool popcnt           = false;
+      bool avx2             = false;
+      bool avx512_vpopcntdq = false; // ds including avx512f and avx512vl
+    };
+
+    //! @brief queries cpuid once (including OS support for the extended register state)
+    static const Features& _getFeatures() {
+      static const Features features = _detectFeatures();
+      return features;
+    }
+
+    static Features _detectFeatures() {
+      Features features;
+#ifdef SRRG_HBST_HAS_X86_SIMD
+      uint32_t registers[4] = {0, 0, 0, 0};
+      _cpuid(0, 0, registers);
+      const uint32_t maximum_leaf = registers[0];
+      if (maximum_leaf < 1) {
+        return features;
+      }
+      _cpuid(1, 0, registers);
+      features.popcnt     = (registers[2] >> 23) & 1;
+      const bool os_xsave = (registers[2] >> 27) & 1;
+      const bool cpu_avx  = (registers[2] >> 28) & 1;
+      if (!os_xsave || !cpu_avx || maximum_leaf < 7) {
+        return features;
+      }
+
+      // ds the OS has to preserve ymm (and zmm/opmask) registers across context switches
+      const uint64_t xcr0  = _getExtendedControlRegister();
+      const bool os_avx    = (xcr0 & 0x6) == 0x6;
+      const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+      _cpuid(7, 0, registers);
+      features.avx2             = os_avx && ((registers[1] >> 5) & 1);
+      features.avx512_vpopcntdq = os_avx512 && ((registers[1] >> 16) & 1) /*avx512f*/ &&
+                                  ((registers[1] >> 31) & 1) /*avx512vl*/ &&
+                                  ((registers[2] >> 14) & 1) /*avx512_vpopcntdq*/;
+#endif
+      return features;
+    }
+
+#ifdef SRRG_HBST_HAS_X86_SIMD
+    static void _cpuid(const uint32_t leaf_, const uint32_t subleaf_, uint32_t* registers_) {
+#if defined(_MSC_VER)
+      int values[4];
+      __cpuidex(values, leaf_, subleaf_);
+      for (uint32_t i = 0; i < 4; ++i) {
+        registers_[i] = static_cast<uint32_t>(values[i]);
+      }
+#else
+      __cpuid_count(leaf_, subleaf_, registers_[0], registers_[1], registers_[2], registers_[3]);
+#endif
+    }
+
+    static uint64_t _getExtendedControlRegister() {
+#if defined(_MSC_VER)
+      return _xgetbv(0);
+#else
+      uint32_t eax = 0, edx = 0;
+      __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+      return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+#endif
+
+    //! @brief active kernel, constant initialized (safe to use during static initialization)
+    static std::atomic<uint8_t> _active;
+  };
+
+  template <typename Dummy_>
+  std::atomic<uint8_t> HammingKernelDispatch<Dummy_>::_active(HammingKernel::Unresolved);
+
+  //! @brief Hamming distance between two packed descriptors of number_of_words_ 64-bit words
+  //! @param[in] a_ first descriptor words
+  //! @param[in] b_ second descriptor words
+  //! @returns the number of differing bits (identical for all kernels)
+  template <uint32_t number_of_words_>
+  inline uint32_t getHammingDistance(const uint64_t* a_, const uint64_t* b_) {
+    switch (HammingKernelDispatch<>::active()) {
+#ifdef SRRG_HBST_HAS_X86_SIMD
+      case HammingKernel::AVX512:
+        // ds a single 128-bit lane does not pay off the vector setup
+        if (number_of_words_ < 4) {
+          return getHammingDistancePopcount<number_of_words_>(a_, b_);
+        }
+        return getHammingDistanceAVX512<number_of_words_>(a_, b_);
+      case HammingKernel::AVX2:
+        if (number_of_words_ < 4) {
+          return getHammingDistancePopcount<number_of_words_>(a_, b_);
+        }
+        return getHammingDistanceAVX2<number_of_words_>(a_, b_);
+      case HammingKernel::Popcount:
+        return getHammingDistancePopcount<number_of_words_>(a_, b_);
+#endif
+      default:
+        return getHammingDistancePortable<number_of_words_>(a_, b_);
+    }
+  }
+
+  //! @brief Hamming distances between a query and a contiguous block of packed references
+  //! @param[in] query_ query descriptor words
+  //! @param[in] references_ number_of_references_ descriptors, number_of_words_ words each
+  //! @param[in] number_of_references_ number of references in the block
+  //! @param[out] distances_ distance for each reference (preallocated)
+  template <uint32_t number_of_words_>
+  inline void getHammingDistances(const uint64_t* query_,
+                                  const uint64_t* references_,
+                                  const uint32_t& number_of_references_,
+                                  uint32_t* distances_) {
+    switch (HammingKernelDispatch<>::active()) {
+#ifdef SRRG_HBST_HAS_X86_SIMD
+      case HammingKernel::AVX512:
+        if (number_of_words_ < 4) {
+          getHammingDistancesPopcount<number_of_words_>(
+            query_, references_, number_of_references_, distances_);
+        } else {
+          getHammingDistancesAVX512<number_of_words_>(
+            query_, references_, number_of_references_, distances_);
+        }
+        break;
+      case HammingKernel::AVX2:
+        if (number_of_words_ < 4) {
+          getHammingDistancesPopcount<number_of_words_>(
+            query_, references_, number_of_references_, distances_);
+        } else {
+          getHammingDistancesAVX2<number_of_words_>(
+            query_, references_, number_of_references_, distances_);
+        }
+        break;
+      case HammingKernel::Popcount:
+        getHammingDistancesPopcount<number_of_words_>(
+          query_, references_, number_of_references_, distances_);
+        break;
+#endif
+      default:
+        getHammingDistancesPortable<number_of_words_>(
+          query_, references_, number_of_references_, distances_);
+    }
+  }
+
+  //! @brief thresholded Hamming distances between a query and a contiguous block of packed
+  //! references: the count of a reference is abandoned after the first word at which it reaches
+  //! maximum_distance_ (the vector kernels count all words at once, hence the word-wise hardware
+  //! popcount is used whenever available)
+  //! @param[in] query_ query descriptor words
+  //! @param[in] references_ number_of_references_ descriptors, number_of_words_ words each
+  //! @param[in] number_of_references_ number of references in the block
+  //! @param[in] maximum_distance_ distance bound
+  //! @param[out] distances_ exact distance for each reference below maximum_distance_, a partial
+  //! count of at least maximum_distance_ otherwise (preallocated)
+  template <uint32_t number_of_words_>
+  inline void getHammingDistancesBounded(const uint64_t* query_,
+                                         const uint64_t* references_,
+                                         const uint32_t& number_of_references_,
+                                         const uint32_t& maximum_distance_,
+                                         uint32_t* distances_) {
+    const HammingKernel kernel = HammingKernelDispatch<>::active();
+    for (uint32_t index_begin = 0; index_begin < number_of_references_;
+         index_begin += bounded_block_size) {
+      const uint32_t number_of_references_block =
+        std::min(bounded_block_size, number_of_references_ - index_begin);
+      const uint64_t* references_block = references_ + index_begin * number_of_words_;
+      switch (kernel) {
+#ifdef SRRG_HBST_HAS_X86_SIMD
+        case HammingKernel::AVX512:
+        case HammingKernel::AVX2:
+        case HammingKernel::Popcount:
+          getHammingDistancesBoundedPopcount<number_of_words_>(query_,
+                                                               references_block,
+                                                               number_of_references_block,
+                                                               maximum_distance_,
+                                                               distances_ + index_begin);
+          break;
+#endif
+        default:
+          getHammingDistancesBoundedPortable<number_of_words_>(query_,
+                                                               references_block,
+                                                               number_of_references_block,
+                                                               maximum_distance_,
+                                                               distances_ + index_begin);
+      }
+    }
+  }
+
+  //! @class minimal allocator returning memory aligned to alignment_ bytes (e.g. cache lines for
+  //! the descriptor word blocks of the leafs)
+  template <typename Type_, size_t alignment_ = 64>
+  class AlignedAllocator {
+  public:
+    using value_type = Type_;
+    template <typename Other_>
+    struct rebind {
+      using other = AlignedAllocator<Other_, alignment_>;
+    };
+
+    AlignedAllocator() {
+    }
+    template <typename Other_>
+    AlignedAllocator(const AlignedAllocator<Other_, alignment_>& /*other_*/) {
+    }
+
+    Type_* allocate(const size_t number_of_elements_) {
+      // ds over-allocate and keep the original pointer right in front of the aligned block
+      const size_t number_of_bytes =
+        number_of_elements_ * sizeof(Type_) + alignment_ + sizeof(void*);
+      void* raw = std::malloc(number_of_bytes);
+      if (!raw) {
+        throw std::bad_alloc();
+      }
+      const uintptr_t address =
+        (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + alignment_ - 1) & ~(alignment_ - 1);
+      reinterpret_cast<void**>(address)[-1] = raw;
+      return reinterpret_cast<Type_*>(address);
+    }
+
+    void deallocate(Type_* data_, const size_t /*number_of_elements_*/) {
+      if (data_) {
+        std::free(reinterpret_cast<void**>(data_)[-1]);
+      }
+    }
+
+    template <typename Other_>
+    bool operator==(const AlignedAllocator<Other_, alignment_>& /*other_*/) const {
+      return true;
+    }
+    template <typename Other_>
+    bool operator!=(const AlignedAllocator<Other_, alignment_>& /*other_*/) const {
+      return false;
+    }
+  };
+
+} // namespace srrg_hbst
@@ -1,10 +1,14 @@
 #pragma once
 #include <assert.h>
 #include <bitset>
-#include <map>
+#include <cstring>
 #include <stdint.h>
+#include <type_traits>
 #include <vector>
 
+#include "binary_distance.hpp"
+#include "binary_object_map.hpp"
+
 // ds if opencv is present on building system
 #ifdef SRRG_HBST_HAS_OPENCV
 #include <opencv2/core/version.hpp>
@@ -13,7 +17,8 @@
 
 namespace srrg_hbst {
 
-  //! @class default matching object (wraps the input descriptors and more)
+  //! @class default matching object (wraps the input descriptors and more) - kept compact for
+  //! large databases: no virtual functions and the object of an unmerged matchable inline
   //! @param descriptor_size_bits_ number of bits for the native descriptor
   template <typename ObjectType_, uint32_t descriptor_size_bits_ = 256>
   class BinaryMatchable {
@@ -22,7 +27,7 @@ namespace srrg_hbst {
     //! @brief descriptor type (extended by augmented bits, no effect if zero)
     using Descriptor = std::bitset<descriptor_size_bits_>;
     using ObjectType = ObjectType_;
-    using ObjectMap  = std::map<uint64_t, ObjectType>;
+    using ObjectMap  = BinaryObjectMap<ObjectType>;
 
     // ds shared properties
   public:
@@ -41,6 +46,13 @@ namespace srrg_hbst {
     static constexpr uint32_t descriptor_size_bits_overflow =
       descriptor_size_bits - descriptor_size_bits_in_bytes;
 
+    //! @brief descriptor size in 64-bit words (used by the SIMD distance kernels)
+    static constexpr uint32_t descriptor_size_words = (descriptor_size_bits_ + 63) / 64;
+
+    //! @brief true if the bitset storage is exactly the packed word array (all common sizes)
+    static constexpr bool descriptor_is_word_packed =
+      (sizeof(Descriptor) == descriptor_size_words * sizeof(uint64_t));
+
     // ds ctor/dtor
   public:
     //! @brief default constructor: DISABLED
@@ -56,21 +68,15 @@ namespace srrg_hbst {
                     const Descriptor& descriptor_,
                     const uint64_t& image_identifier_ = 0) :
       descriptor(descriptor_),
-      number_of_objects(1),
-      _image_identifier(image_identifier_),
-      _object(std::move(object_)) {
-      objects.insert(std::make_pair(_image_identifier, _object));
-      assert(number_of_objects == objects.size());
+      _image_identifier(image_identifier_) {
+      objects.insert(std::make_pair(_image_identifier, std::move(object_)));
     }
 
     //! @brief constructor from object map
     BinaryMatchable(ObjectMap objects_, const Descriptor& descriptor_) :
       descriptor(descriptor_),
-      objects(objects_),
-      number_of_objects(objects_.size()),
-      _image_identifier(objects_.begin()->first),
-      _object(objects_.begin()->second) {
-      assert(number_of_objects == objects.size());
+      objects(std::move(objects_)),
+      _image_identifier(objects.begin()->first) {
     }
 
 // ds wrapped constructors - only available if OpenCV is present on building system
@@ -89,11 +95,6 @@ namespace srrg_hbst {
     }
 #endif
 
-    //! @brief default destructor
-    virtual ~BinaryMatchable() {
-      objects.clear();
-    }
-
     // ds functionality
   public:
     //! @brief computes the classic Hamming descriptor distance between this and another matchable
@@ -101,7 +102,21 @@ namespace srrg_hbst {
     //! @returns the matching distance as integer
     inline const uint32_t
     distance(const BinaryMatchable<ObjectType_, descriptor_size_bits_>* matchable_query_) const {
-      return (matchable_query_->descriptor ^ this->descriptor).count();
+      return getDistance(matchable_query_->descriptor, this->descriptor);
+    }
+
+    //! @brief Hamming distance between two raw descriptors, dispatched to the fastest kernel
+    //! supported by the CPU (results are bit-identical to std::bitset::count)
+    static inline uint32_t getDistance(const Descriptor& a_, const Descriptor& b_) {
+      return _getDistance(a_, b_, std::integral_constant<bool, descriptor_is_word_packed>());
+    }
+
+    //! @brief writes the descriptor bits into descriptor_size_words packed 64-bit words
+    //! @param[in] descriptor_ descriptor to convert
+    //! @param[out] words_ preallocated word buffer (unused high bits are zero)
+    static inline void getDescriptorWords(const Descriptor& descriptor_, uint64_t* words_) {
+      _getDescriptorWords(
+        descriptor_, words_, std::integral_constant<bool, descriptor_is_word_packed>());
     }
 
 #ifdef SRRG_MERGE_DESCRIPTORS
@@ -110,8 +125,6 @@ namespace srrg_hbst {
     //! @param[in] matchable_ the matchable to merge with THIS
     inline void merge(const BinaryMatchable<ObjectType_, descriptor_size_bits_>* matchable_) {
       objects.insert(matchable_->objects.begin(), matchable_->objects.end());
-      number_of_objects += matchable_->objects.size();
-      assert(number_of_objects == objects.size());
     }
 
     //! @brief merges a matchable with THIS matchable (desirable when having to store identical
@@ -120,26 +133,42 @@ namespace srrg_hbst {
     //! contains a single entry for identifier and pointer
     //! @param[in] matchable_ the matchable to merge with THIS
     inline void mergeSingle(const BinaryMatchable<ObjectType_, descriptor_size_bits_>* matchable_) {
-      objects.insert(std::make_pair(matchable_->_image_identifier, std::move(matchable_->_object)));
-      ++number_of_objects;
-      assert(number_of_objects == objects.size());
+      assert(matchable_->objects.size() == 1);
+      objects.insert(*matchable_->objects.begin());
+    }
+
+    //! @brief removes the object of an image from THIS merged matchable (the inverse of merging)
+    //! @param[in] image_identifier_ image of the object to remove (THIS keeps at least one object)
+    inline void removeObject(const uint64_t& image_identifier_) {
+      assert(objects.count(image_identifier_) == 1);
+      assert(objects.size() > 1);
+      objects.erase(image_identifier_);
+
+      // ds the first remaining object becomes the inner object if the image was the reference
+      if (_image_identifier == image_identifier_) {
+        _image_identifier = objects.begin()->first;
+      }
     }
 #endif
 
-    //! @brief enables manual update of the inner linked object
+    //! @brief enables manual update of the inner linked object (of the referenced image)
     inline void setObject(ObjectType object_) {
-      _object = std::move(object_);
+      objects.at(_image_identifier) = std::move(object_);
     }
 
     //! @brief enables manual update of all linked objects (without changing the referenced image
     //! number)
-    inline void setObjects(ObjectType object_) {
-      setObject(object_);
+    inline void setObjects(const ObjectType& object_) {
       for (auto& object : objects) {
-        object.second = std::move(object_);
+        object.second = object_;
       }
     }
 
+    //! @brief number of contained objects/image_identifiers (1 if not merged)
+    inline size_t numberOfObjects() const {
+      return objects.size();
+    }
+
 #ifdef SRRG_HBST_HAS_OPENCV
     //! @brief descriptor wrapping - only available if OpenCV is present on building system
     //! @param[in] descriptor_cv_ opencv descriptor to convert into HBST format
@@ -184,21 +213,49 @@ namespace srrg_hbst {
     //! permanence of the referenced object!
     ObjectMap objects;
 
-    //! @brief quick access to the number of contained objects/image_identifiers (default: 1)
-    uint64_t number_of_objects;
+    // ds helpers
+  protected:
+    //! @brief word-packed bitsets are handed to the kernels directly
+    static inline uint32_t
+    _getDistance(const Descriptor& a_, const Descriptor& b_, std::true_type /*word_packed*/) {
+      return getHammingDistance<descriptor_size_words>(reinterpret_cast<const uint64_t*>(&a_),
+                                                       reinterpret_cast<const uint64_t*>(&b_));
+    }
+
+    //! @brief exotic bitset layouts fall back to the standard library
+    static inline uint32_t
+    _getDistance(const Descriptor& a_, const Descriptor& b_, std::false_type /*word_packed*/) {
+      return (a_ ^ b_).count();
+    }
+
+    static inline void _getDescriptorWords(const Descriptor& descriptor_,
+                                           uint64_t* words_,
+                                           std::true_type /*word_packed*/) {
+      std::memcpy(words_, &descriptor_, sizeof(Descriptor));
+    }
+
+    static inline void _getDescriptorWords(const Descriptor& descriptor_,
+                                           uint64_t* words_,
+                                           std::false_type /*word_packed*/) {
+      std::memset(words_, 0, descriptor_size_words * sizeof(uint64_t));
+      for (uint32_t bit_index = 0; bit_index < descriptor_size_bits; ++bit_index) {
+        if (descriptor_[bit_index]) {
+          words_[bit_index / 64] |= (uint64_t(1) << (bit_index % 64));
+        }
+      }
+    }
 
     // ds fast access (for a matchable with only single values, internal only)
   protected:
     //! @brief single value access only: linked object to group of descriptors (e.g. an image or
-    //! image index)
-    const uint64_t _image_identifier;
-
-    //! @brief single value access only: linked object to descriptor (e.g. keypoint or an index)
-    ObjectType _object;
+    //! image index) - only changes if the image is removed from a merged matchable
+    uint64_t _image_identifier;
 
     //! @brief allow direct access for processing classes
     template <typename BinaryNodeType_>
     friend class BinaryTree;
+    template <typename BinaryMatchableType_, typename real_type_>
+    friend class BinaryNode;
   };
 
   // ds come on c++11
@@ -212,6 +269,10 @@ namespace srrg_hbst {
   template <typename ObjectType_, uint32_t descriptor_size_bits_>
   constexpr uint32_t
     BinaryMatchable<ObjectType_, descriptor_size_bits_>::descriptor_size_bits_overflow;
+  template <typename ObjectType_, uint32_t descriptor_size_bits_>
+  constexpr uint32_t BinaryMatchable<ObjectType_, descriptor_size_bits_>::descriptor_size_words;
+  template <typename ObjectType_, uint32_t descriptor_size_bits_>
+  constexpr bool BinaryMatchable<ObjectType_, descriptor_size_bits_>::descriptor_is_word_packed;
 
   template <typename ObjectType_>
   using BinaryMatchable128 = BinaryMatchable<ObjectType_, 128>;
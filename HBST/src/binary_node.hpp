@@ -1,6 +1,11 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
 #include <random>
+#include <set>
+#include <unordered_map>
 
 #include "binary_match.hpp"
 
@@ -23,6 +28,19 @@ namespace srrg_hbst {
     using real_type       = real_type_;
     using Match           = BinaryMatch<Matchable, real_type>;
 
+    //! @brief dense image slot per image identifier, owned by the tree (see BinaryTree::ImageSlots)
+    using SlotPerIdentifier = std::unordered_map<uint64_t, uint32_t>;
+
+    //! @brief contiguous descriptor storage of a leaf (descriptor_size_words per matchable)
+    using DescriptorWordVector = std::vector<uint64_t, AlignedAllocator<uint64_t>>;
+    static constexpr uint32_t descriptor_size_words = Matchable::descriptor_size_words;
+
+    //! @brief number of references for which distances are computed in one kernel call
+    static constexpr uint32_t scan_block_size = 32;
+
+    //! @brief number of pivot descriptors of a leaf for triangle inequality pruning
+    static constexpr uint32_t number_of_pivots = 2;
+
     //! @brief header for de/serialization TODO fuse with attributes
     struct Header {
       Header(const uint64_t& depth_) : depth(depth_) {
@@ -65,6 +83,143 @@ namespace srrg_hbst {
   public:
     // ds create leafs (external use intented)
     virtual const bool spawnLeafs(const SplittingStrategy& train_mode_) {
+      return _spawnLeafs(train_mode_, random_number_generator, true);
+    }
+
+    //! @brief seeds the generator shared by all nodes for random splitting (reproducible builds)
+    static void seedRandomNumberGenerator(const uint32_t& seed_) {
+      random_number_generator.seed(seed_);
+    }
+
+    // ds getters
+  public:
+    const MatchableVector& getMatchables() const {
+      return matchables;
+    }
+    const uint64_t& getDepth() const {
+      return _header.depth;
+    }
+    const int32_t& indexSplitBit() const {
+      return index_split_bit;
+    }
+    const uint64_t& getNumberOfSetBits() const {
+      return number_of_on_bits_total;
+    }
+    const bool& hasLeafs() const {
+      return has_leafs;
+    }
+    const DescriptorWordVector& getDescriptorWords() const {
+      return descriptor_words;
+    }
+    const std::vector<uint64_t>& getImageIdentifiers() const {
+      return image_identifiers;
+    }
+    const std::vector<uint32_t>& getImageSlots() const {
+      return image_slots;
+    }
+
+    //! @brief brute-force leaf scan over the contiguous descriptor storage
+    //! @param[in] descriptor_query_ query descriptor
+    //! @param[in] maximum_distance_ exclusive distance bound for a reference to be visited
+    //! @param[in] visit_ callback (index_reference, distance) for each reference within the bound,
+    //! in storage order - returning false terminates the scan
+    //! @return number of references whose distance was computed (outside of the popcount window
+    //! and pruned references are skipped, a terminated scan counts the blocks evaluated so far)
+    template <typename Visitor_>
+    inline uint32_t scan(const Descriptor& descriptor_query_,
+                     const uint32_t& maximum_distance_,
+                     Visitor_ visit_) const {
+      uint64_t query_words[descriptor_size_words];
+      Matchable::getDescriptorWords(descriptor_query_, query_words);
+
+      // ds in a popcount ordered leaf only the references with |popcount(q) - popcount(r)| below
+      // ds the bound can match (the popcount difference is a lower bound of the distance)
+      uint32_t index_first = 0;
+      uint32_t index_end   = matchables.size();
+      if (!popcounts.empty()) {
+        const int64_t popcount_query   = _getPopcount(query_words);
+        const int64_t maximum_distance = maximum_distance_;
+        index_first =
+          std::lower_bound(popcounts.begin(),
+                           popcounts.end(),
+                           std::max(popcount_query - maximum_distance + 1, int64_t(0))) -
+          popcounts.begin();
+        index_end = std::lower_bound(popcounts.begin() + index_first,
+                                     popcounts.end(),
+                                     popcount_query + maximum_distance) -
+                    popcounts.begin();
+      }
+      if (!pivot_distances.empty()) {
+        return _scanPruned(query_words, index_first, index_end, maximum_distance_, visit_);
+      }
+      uint32_t distances[scan_block_size];
+      uint32_t number_of_comparisons = 0;
+      for (uint32_t index_begin = index_first; index_begin < index_end;
+           index_begin += scan_block_size) {
+        const uint32_t number_of_references_block =
+          std::min(scan_block_size, index_end - index_begin);
+        _getDistances(
+          query_words, index_begin, number_of_references_block, maximum_distance_, distances);
+        number_of_comparisons += number_of_references_block;
+        for (uint32_t index = 0; index < number_of_references_block; ++index) {
+          if (distances[index] < maximum_distance_) {
+            if (!visit_(index_begin + index, distances[index])) {
+              return number_of_comparisons;
+            }
+          }
+        }
+      }
+      return number_of_comparisons;
+    }
+
+    // ds inner constructors (used for recursive tree building)
+  protected:
+    // ds only internally called: default for single matchables
+    BinaryNode(Node* parent_,
+               const uint64_t& depth_,
+               const MatchableVector& matchables_,
+               Descriptor bit_mask_,
+               const SplittingStrategy& train_mode_) :
+      BinaryNode(parent_, depth_, matchables_, bit_mask_) {
+      spawnLeafs(train_mode_);
+    }
+
+    // ds only internally called: unsplit leaf (leafs are spawned by the caller)
+    BinaryNode(Node* parent_,
+               const uint64_t& depth_,
+               const MatchableVector& matchables_,
+               Descriptor bit_mask_) :
+      parent(parent_),
+      _header(depth_),
+      matchables(matchables_),
+      bit_mask(bit_mask_) {
+#ifdef SRRG_MERGE_DESCRIPTORS
+      // ds recompute current number of contained merged matchables TODO make this less horribly
+      // wasteful
+      _header.number_of_matchables_uncompressed = 0;
+      for (const Matchable* matchable : matchables) {
+        _header.number_of_matchables_uncompressed += matchable->objects.size();
+      }
+#else
+      _header.number_of_matchables_uncompressed = matchables.size();
+#endif
+      if (parent_) {
+        _slot_per_identifier = parent_->_slot_per_identifier;
+      }
+      _updateLeafStorage();
+    }
+
+    // ds helpers
+  protected:
+    //! @brief splits this node if possible
+    //! @param[in] train_mode_ splitting strategy
+    //! @param[in] random_number_generator_ generator for random splitting
+    //! @param[in] recursive_ also split the created leafs (entire subtree), otherwise the leafs
+    //! are left unsplit
+    //! @return true if leafs were spawned
+    const bool _spawnLeafs(const SplittingStrategy& train_mode_,
+                           std::mt19937& random_number_generator_,
+                           const bool& recursive_) {
       assert(!has_leafs);
       _header.number_of_matchables_compressed = matchables.size();
 
@@ -77,6 +232,7 @@ namespace srrg_hbst {
       if (_header.number_of_matchables_uncompressed < maximum_leaf_size) {
         return false;
       }
+      _flushSetBitCounts();
 
       // ds affirm initial situation
       index_split_bit         = -1;
@@ -90,18 +246,13 @@ namespace srrg_hbst {
           for (uint32_t bit_index = 0; bit_index < Matchable::descriptor_size_bits; ++bit_index) {
             // ds if this index is available in the mask
             if (bit_mask[bit_index]) {
-              // ds temporary set bit count
-              uint64_t number_of_set_bits = 0;
-
               // ds compute distance for this index (0.0 is perfect)
-              const double partitioning_current =
-                std::fabs(0.5 - _getSetBitFraction(bit_index, matchables, number_of_set_bits));
+              const double partitioning_current = std::fabs(0.5 - _getSetBitFraction(bit_index));
 
               // ds if better
               if (partitioning_current < partitioning) {
-                partitioning            = partitioning_current;
-                number_of_on_bits_total = number_of_set_bits;
-                index_split_bit         = bit_index;
+                partitioning    = partitioning_current;
+                index_split_bit = bit_index;
 
                 // ds finalize loop if maximum target is reached
                 if (partitioning == 0)
@@ -118,18 +269,13 @@ namespace srrg_hbst {
           for (uint32_t bit_index = 0; bit_index < Matchable::descriptor_size_bits; ++bit_index) {
             // ds if this index is available in the mask
             if (bit_mask[bit_index]) {
-              // ds temporary set bit count
-              uint64_t number_of_set_bits = 0;
-
               // ds compute distance for this index (0.0 is perfect)
-              const double partitioning_current =
-                std::fabs(0.5 - _getSetBitFraction(bit_index, matchables, number_of_set_bits));
+              const double partitioning_current = std::fabs(0.5 - _getSetBitFraction(bit_index));
 
               // ds if worse
               if (partitioning_current > partitioning) {
-                partitioning            = partitioning_current;
-                number_of_on_bits_total = number_of_set_bits;
-                index_split_bit         = bit_index;
+                partitioning    = partitioning_current;
+                index_split_bit = bit_index;
 
                 // ds finalize loop if maximum target is reached
                 if (partitioning == 0.5)
@@ -154,16 +300,18 @@ namespace srrg_hbst {
             std::uniform_int_distribution<uint32_t> available_indices(0, available_bits.size() - 1);
 
             // ds sample uniformly at random
-            index_split_bit = available_bits[available_indices(Node::random_number_generator)];
+            index_split_bit = available_bits[available_indices(random_number_generator_)];
 
             // ds compute distance for this index (0.0 is perfect)
-            partitioning = std::fabs(
-              0.5 - _getSetBitFraction(index_split_bit, matchables, number_of_on_bits_total));
+            partitioning = std::fabs(0.5 - _getSetBitFraction(index_split_bit));
           }
           break;
         }
         default: { throw std::runtime_error("invalid leaf spawning mode"); }
       }
+      if (index_split_bit != -1) {
+        number_of_on_bits_total = _getNumberOfSetBits(index_split_bit);
+      }
 
       // ds if best was found and the partitioning is sufficient (0 to 0.5) - we can spawn leaves
       if (index_split_bit != -1 && partitioning < maximum_partitioning) {
@@ -179,14 +327,17 @@ namespace srrg_hbst {
         MatchableVector matchables_zeros(matchables.size() - number_of_on_bits_total);
 
         // ds loop over all descriptors and assigning them to the new vectors based on bit status
-        uint64_t index_ones  = 0;
-        uint64_t index_zeros = 0;
-        for (Matchable* matchable : matchables) {
-          if (matchable->descriptor[index_split_bit]) {
-            matchables_ones[index_ones] = matchable;
+        // ds the split bit is read from the contiguous leaf storage
+        const uint32_t index_split_word = index_split_bit / 64;
+        const uint64_t split_bit        = uint64_t(1) << (index_split_bit % 64);
+        uint64_t index_ones             = 0;
+        uint64_t index_zeros            = 0;
+        for (uint64_t index = 0; index < matchables.size(); ++index) {
+          if (descriptor_words[index * descriptor_size_words + index_split_word] & split_bit) {
+            matchables_ones[index_ones] = matchables[index];
             ++index_ones;
           } else {
-            matchables_zeros[index_zeros] = matchable;
+            matchables_zeros[index_zeros] = matchables[index];
             ++index_zeros;
           }
         }
@@ -195,15 +346,23 @@ namespace srrg_hbst {
 
         // ds this leaf becomes a regular node and hence does not carry matchables
         has_leafs = true;
-        matchables.clear();
+        _clearLeafStorage();
         _header.number_of_matchables_compressed = 0;
 
         // ds if there are elements for leaves
         assert(0 < matchables_ones.size());
-        right = new Node(this, _header.depth + 1, matchables_ones, bit_mask_previous, train_mode_);
+        Node* leaf_ones = new Node(this, _header.depth + 1, matchables_ones, bit_mask_previous);
+        if (recursive_) {
+          leaf_ones->_spawnLeafs(train_mode_, random_number_generator_, true);
+        }
+        right = leaf_ones;
 
         assert(0 < matchables_zeros.size());
-        left = new Node(this, _header.depth + 1, matchables_zeros, bit_mask_previous, train_mode_);
+        Node* leaf_zeros = new Node(this, _header.depth + 1, matchables_zeros, bit_mask_previous);
+        if (recursive_) {
+          leaf_zeros->_spawnLeafs(train_mode_, random_number_generator_, true);
+        }
+        left = leaf_zeros;
 
         // ds success
         return true;
@@ -213,51 +372,104 @@ namespace srrg_hbst {
       }
     }
 
-    // ds getters
-  public:
-    const MatchableVector& getMatchables() const {
-      return matchables;
-    }
-    const uint64_t& getDepth() const {
-      return _header.depth;
-    }
-    const int32_t& indexSplitBit() const {
-      return index_split_bit;
-    }
-    const uint64_t& getNumberOfSetBits() const {
-      return number_of_on_bits_total;
-    }
-    const bool& hasLeafs() const {
-      return has_leafs;
+    //! @brief weighted fraction of matchables in this leaf with the bit set (from the leaf
+    //! bit statistics, without scanning the matchables)
+    const real_type _getSetBitFraction(const uint32_t& index_split_bit_) const {
+      assert(set_bit_counts.size() == descriptor_size_words * 64);
+      assert(number_of_set_bit_counts_pending == 0);
+      assert(0 < _header.number_of_matchables_uncompressed);
+      assert(set_bit_counts[index_split_bit_] <= _header.number_of_matchables_uncompressed);
+      return (static_cast<real_type>(set_bit_counts[index_split_bit_]) /
+              _header.number_of_matchables_uncompressed);
     }
 
-    // ds inner constructors (used for recursive tree building)
-  protected:
-    // ds only internally called: default for single matchables
-    BinaryNode(Node* parent_,
-               const uint64_t& depth_,
-               const MatchableVector& matchables_,
-               Descriptor bit_mask_,
-               const SplittingStrategy& train_mode_) :
-      parent(parent_),
-      _header(depth_),
-      matchables(matchables_),
-      bit_mask(bit_mask_) {
+    //! @brief number of matchables in this leaf with the bit set (merged matchables count once)
+    const uint64_t _getNumberOfSetBits(const uint32_t& index_split_bit_) const {
 #ifdef SRRG_MERGE_DESCRIPTORS
-      // ds recompute current number of contained merged matchables TODO make this less horribly
-      // wasteful
-      _header.number_of_matchables_uncompressed = 0;
-      for (const Matchable* matchable : matchables) {
-        _header.number_of_matchables_uncompressed += matchable->number_of_objects;
+      // ds the bit statistics are weighted - count the actual matchables
+      const uint32_t index_split_word = index_split_bit_ / 64;
+      const uint64_t split_bit        = uint64_t(1) << (index_split_bit_ % 64);
+      uint64_t number_of_set_bits     = 0;
+      for (uint64_t index = 0; index < matchables.size(); ++index) {
+        if (descriptor_words[index * descriptor_size_words + index_split_word] & split_bit) {
+          ++number_of_set_bits;
+        }
       }
+      return number_of_set_bits;
 #else
-      _header.number_of_matchables_uncompressed = matchables.size();
+      return set_bit_counts[index_split_bit_];
 #endif
-      spawnLeafs(train_mode_);
     }
 
-    // ds helpers
-  protected:
+    //! @brief adds a descriptor (packed words) to the leaf bit statistics: unit weights are
+    //! accumulated in byte lanes (8 bit counters per 64-bit word, one add per descriptor byte)
+    //! which are flushed into the counters every 255 descriptors or before a split
+    //! @param[in] descriptor_words_ descriptor_size_words packed words
+    //! @param[in] weight_ number of objects represented by the descriptor
+    inline void _addSetBitCounts(const uint64_t* descriptor_words_, const uint32_t& weight_) {
+      assert(set_bit_counts.size() == descriptor_size_words * 64);
+      if (weight_ != 1) {
+        for (uint32_t index_bit = 0; index_bit < descriptor_size_words * 64; ++index_bit) {
+          if ((descriptor_words_[index_bit / 64] >> (index_bit % 64)) & 1) {
+            set_bit_counts[index_bit] += weight_;
+          }
+        }
+        return;
+      }
+      for (uint32_t index_word = 0; index_word < descriptor_size_words; ++index_word) {
+        const uint64_t word  = descriptor_words_[index_word];
+        uint64_t* byte_lanes = &set_bit_counts_pending[index_word * 8];
+        for (uint32_t index_byte = 0; index_byte < 8; ++index_byte) {
+          // ds spread the 8 bits of the byte to the lowest bit of 8 byte lanes
+          const uint64_t bits =
+            (((word >> (8 * index_byte)) & 0xFF) * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+          byte_lanes[index_byte] += ((bits + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) >> 7;
+        }
+      }
+      if (++number_of_set_bit_counts_pending == 255) {
+        _flushSetBitCounts();
+      }
+    }
+
+    //! @brief moves the byte lane accumulators into the leaf bit statistics
+    void _flushSetBitCounts() {
+      for (uint32_t index_lanes = 0; index_lanes < set_bit_counts_pending.size(); ++index_lanes) {
+        const uint64_t byte_lanes = set_bit_counts_pending[index_lanes];
+        for (uint32_t index_lane = 0; index_lane < 8; ++index_lane) {
+          set_bit_counts[index_lanes * 8 + index_lane] += (byte_lanes >> (8 * index_lane)) & 0xFF;
+        }
+        set_bit_counts_pending[index_lanes] = 0;
+      }
+      number_of_set_bit_counts_pending = 0;
+    }
+
+    //! @brief removes a descriptor (packed words) from the leaf bit statistics
+    //! @param[in] descriptor_words_ descriptor_size_words packed words
+    //! @param[in] weight_ number of objects no longer represented by the descriptor
+    void _removeSetBitCounts(const uint64_t* descriptor_words_, const uint32_t& weight_) {
+      _flushSetBitCounts();
+      for (uint32_t index_bit = 0; index_bit < descriptor_size_words * 64; ++index_bit) {
+        if ((descriptor_words_[index_bit / 64] >> (index_bit % 64)) & 1) {
+          assert(weight_ <= set_bit_counts[index_bit]);
+          set_bit_counts[index_bit] -= weight_;
+        }
+      }
+    }
+
+    //! @brief zeroes the leaf bit statistics
+    void _resetSetBitCounts() {
+      set_bit_counts.assign(descriptor_size_words * 64, 0);
+      set_bit_counts_pending.assign(descriptor_size_words * 8, 0);
+      number_of_set_bit_counts_pending = 0;
+    }
+
+    //! @brief adds a matchable merged into a reference of this leaf to the bit statistics
+    inline void _addSetBitCounts(const Matchable* matchable_reference_) {
+      uint64_t words[descriptor_size_words];
+      Matchable::getDescriptorWords(matchable_reference_->descriptor, words);
+      _addSetBitCounts(words, 1);
+    }
+
     const real_type _getSetBitFraction(const uint32_t& index_split_bit_,
                                        const MatchableVector& matchables_,
                                        uint64_t& number_of_set_bits_total_) const {
@@ -273,7 +485,7 @@ namespace srrg_hbst {
         // ds accumulate set bit matchable counts
         if (matchable->descriptor[index_split_bit_]) {
           // ds make sure to weight merged matchables! default is 1, if not merged
-          number_of_set_bits += matchable->number_of_objects;
+          number_of_set_bits += matchable->objects.size();
           ++number_of_set_bits_actual;
         }
       }
@@ -295,13 +507,424 @@ namespace srrg_hbst {
               _header.number_of_matchables_uncompressed);
     }
 
+    //! @brief distances of the query to a block of leaf references, exact below maximum_distance_
+    //! (for tight bounds the count of a reference stops once it reaches the bound)
+    inline void _getDistances(const uint64_t* query_words_,
+                              const uint32_t& index_begin_,
+                              const uint32_t& number_of_references_,
+                              const uint32_t& maximum_distance_,
+                              uint32_t* distances_) const {
+      const uint64_t* reference_words =
+        descriptor_words.data() + index_begin_ * descriptor_size_words;
+      if (maximum_distance_ <= maximum_distance_for_early_exit) {
+        getHammingDistancesBounded<descriptor_size_words>(
+          query_words_, reference_words, number_of_references_, maximum_distance_, distances_);
+      } else {
+        getHammingDistances<descriptor_size_words>(
+          query_words_, reference_words, number_of_references_, distances_);
+      }
+    }
+
+    //! @brief leaf scan skipping references by the triangle inequality: reference r cannot be
+    //! within maximum_distance_ of query q if |d(q, p) - d(r, p)| >= maximum_distance_ for any
+    //! pivot p (d(r, p) is precomputed) - visits exactly the references of the plain scan
+    //! @return number of references whose distance was computed (see scan)
+    template <typename Visitor_>
+    inline uint32_t _scanPruned(const uint64_t* query_words_,
+                            const uint32_t& index_first_,
+                            const uint32_t& index_end_,
+                            const uint32_t& maximum_distance_,
+                            Visitor_& visit_) const {
+      int32_t distances_query_pivots[number_of_pivots];
+      for (uint32_t index_pivot = 0; index_pivot < number_of_pivots; ++index_pivot) {
+        distances_query_pivots[index_pivot] = getHammingDistance<descriptor_size_words>(
+          query_words_, &pivot_words[index_pivot * descriptor_size_words]);
+      }
+      const int32_t maximum_distance = maximum_distance_;
+      uint32_t candidates[scan_block_size];
+      uint32_t distances[scan_block_size];
+      uint32_t number_of_comparisons = 0;
+      for (uint32_t index_begin = index_first_; index_begin < index_end_;
+           index_begin += scan_block_size) {
+        const uint32_t number_of_references_block =
+          std::min(scan_block_size, index_end_ - index_begin);
+
+        // ds collect the references not excluded by any pivot (branchless)
+        const uint16_t* distances_reference_pivots =
+          &pivot_distances[index_begin * number_of_pivots];
+        uint32_t number_of_candidates = 0;
+        for (uint32_t index = 0; index < number_of_references_block; ++index) {
+          bool is_candidate = true;
+          for (uint32_t index_pivot = 0; index_pivot < number_of_pivots; ++index_pivot) {
+            const int32_t difference =
+              distances_query_pivots[index_pivot] -
+              distances_reference_pivots[index * number_of_pivots + index_pivot];
+            is_candidate &= (difference < maximum_distance && -difference < maximum_distance);
+          }
+          candidates[number_of_candidates] = index;
+          number_of_candidates += is_candidate;
+        }
+
+        // ds a mostly unpruned block is cheaper to evaluate with the block kernel
+        if (number_of_candidates > scan_block_size / 4) {
+          _getDistances(
+            query_words_, index_begin, number_of_references_block, maximum_distance_, distances);
+          number_of_comparisons += number_of_references_block;
+          for (uint32_t index = 0; index < number_of_references_block; ++index) {
+            if (distances[index] < maximum_distance_) {
+              if (!visit_(index_begin + index, distances[index])) {
+                return number_of_comparisons;
+              }
+            }
+          }
+        } else {
+          for (uint32_t index_candidate = 0; index_candidate < number_of_candidates;
+               ++index_candidate) {
+            const uint32_t index_reference = index_begin + candidates[index_candidate];
+            const uint32_t distance        = getHammingDistance<descriptor_size_words>(
+              query_words_, &descriptor_words[index_reference * descriptor_size_words]);
+            ++number_of_comparisons;
+            if (distance < maximum_distance_) {
+              if (!visit_(index_reference, distance)) {
+                return number_of_comparisons;
+              }
+            }
+          }
+        }
+      }
+      return number_of_comparisons;
+    }
+
+    //! @brief adds a matchable to this leaf, keeping the contiguous leaf storage in sync (appended,
+    //! or inserted after all references with at most its popcount in a popcount ordered leaf)
+    inline void _addMatchable(Matchable* matchable_) {
+      uint64_t words[descriptor_size_words];
+      Matchable::getDescriptorWords(matchable_->descriptor, words);
+      size_t index = matchables.size();
+      if (!popcounts.empty()) {
+        const uint16_t popcount = _getPopcount(words);
+        index = std::upper_bound(popcounts.begin(), popcounts.end(), popcount) - popcounts.begin();
+        popcounts.insert(popcounts.begin() + index, popcount);
+      }
+      matchables.insert(matchables.begin() + index, matchable_);
+      descriptor_words.insert(descriptor_words.begin() + index * descriptor_size_words,
+                              words,
+                              words + descriptor_size_words);
+      image_identifiers.insert(image_identifiers.begin() + index, matchable_->_image_identifier);
+      image_slots.insert(image_slots.begin() + index, _getImageSlot(matchable_->_image_identifier));
+      if (set_bit_counts.empty()) {
+        _resetSetBitCounts();
+      }
+      _addSetBitCounts(words, _getWeight(matchable_));
+      if (!pivot_distances.empty()) {
+        _insertPivotDistances(index, words);
+      } else if (minimum_leaf_size_for_pivots > 0 &&
+                 matchables.size() >= minimum_leaf_size_for_pivots) {
+        _updatePivots();
+      }
+      if (popcounts.empty() && minimum_leaf_size_for_popcount_order > 0 &&
+          matchables.size() >= minimum_leaf_size_for_popcount_order) {
+        _updatePopcountOrder();
+      }
+    }
+
+    //! @brief number of set bits of a packed descriptor
+    static inline uint16_t _getPopcount(const uint64_t* words_) {
+      uint32_t popcount = 0;
+      for (uint32_t index_word = 0; index_word < descriptor_size_words; ++index_word) {
+        popcount += getPopcountPortable(words_[index_word]);
+      }
+      return static_cast<uint16_t>(popcount);
+    }
+
+    //! @brief stably sorts the leaf storage by descriptor popcount and caches the popcounts, the
+    //! order is released for leafs below minimum_leaf_size_for_popcount_order
+    void _updatePopcountOrder() {
+      std::vector<uint16_t>().swap(popcounts);
+      const size_t number_of_references = matchables.size();
+      if (minimum_leaf_size_for_popcount_order == 0 ||
+          number_of_references < minimum_leaf_size_for_popcount_order) {
+        return;
+      }
+      std::vector<uint16_t> popcounts_unordered(number_of_references);
+      std::vector<uint32_t> order(number_of_references);
+      for (size_t index = 0; index < number_of_references; ++index) {
+        popcounts_unordered[index] = _getPopcount(&descriptor_words[index * descriptor_size_words]);
+        order[index]               = index;
+      }
+      std::stable_sort(order.begin(), order.end(), [&](const uint32_t& a_, const uint32_t& b_) {
+        return popcounts_unordered[a_] < popcounts_unordered[b_];
+      });
+
+      // ds permute all parallel arrays
+      MatchableVector matchables_ordered(number_of_references);
+      DescriptorWordVector descriptor_words_ordered(descriptor_words.size());
+      std::vector<uint64_t> image_identifiers_ordered(number_of_references);
+      std::vector<uint32_t> image_slots_ordered(number_of_references);
+      std::vector<uint16_t> pivot_distances_ordered(pivot_distances.size());
+      popcounts.resize(number_of_references);
+      for (size_t index = 0; index < number_of_references; ++index) {
+        const uint32_t index_source = order[index];
+        matchables_ordered[index]   = matchables[index_source];
+        std::copy(descriptor_words.begin() + index_source * descriptor_size_words,
+                  descriptor_words.begin() + (index_source + 1) * descriptor_size_words,
+                  descriptor_words_ordered.begin() + index * descriptor_size_words);
+        image_identifiers_ordered[index] = image_identifiers[index_source];
+        image_slots_ordered[index]       = image_slots[index_source];
+        if (!pivot_distances.empty()) {
+          std::copy(pivot_distances.begin() + index_source * number_of_pivots,
+                    pivot_distances.begin() + (index_source + 1) * number_of_pivots,
+                    pivot_distances_ordered.begin() + index * number_of_pivots);
+        }
+        popcounts[index] = popcounts_unordered[index_source];
+      }
+      matchables.swap(matchables_ordered);
+      descriptor_words.swap(descriptor_words_ordered);
+      image_identifiers.swap(image_identifiers_ordered);
+      image_slots.swap(image_slots_ordered);
+      pivot_distances.swap(pivot_distances_ordered);
+    }
+
+    //! @brief selects the pivots of this leaf and computes all reference to pivot distances, the
+    //! pivots are released for leafs below minimum_leaf_size_for_pivots
+    void _updatePivots() {
+      DescriptorWordVector().swap(pivot_words);
+      std::vector<uint16_t>().swap(pivot_distances);
+      const uint32_t number_of_references = matchables.size();
+      if (minimum_leaf_size_for_pivots == 0 ||
+          number_of_references < minimum_leaf_size_for_pivots) {
+        return;
+      }
+
+      // ds farthest point heuristic: every pivot is the reference farthest from the previous
+      // ds one (starting from the first reference), which spreads the pivot distances
+      pivot_words.resize(number_of_pivots * descriptor_size_words);
+      const uint64_t* pivot_previous = descriptor_words.data();
+      for (uint32_t index_pivot = 0; index_pivot < number_of_pivots; ++index_pivot) {
+        uint32_t index_farthest    = 0;
+        uint32_t distance_farthest = 0;
+        for (uint32_t index = 0; index < number_of_references; ++index) {
+          const uint32_t distance = getHammingDistance<descriptor_size_words>(
+            pivot_previous, &descriptor_words[index * descriptor_size_words]);
+          if (distance > distance_farthest) {
+            distance_farthest = distance;
+            index_farthest    = index;
+          }
+        }
+        std::copy(descriptor_words.begin() + index_farthest * descriptor_size_words,
+                  descriptor_words.begin() + (index_farthest + 1) * descriptor_size_words,
+                  pivot_words.begin() + index_pivot * descriptor_size_words);
+        pivot_previous = &pivot_words[index_pivot * descriptor_size_words];
+      }
+      pivot_distances.reserve(number_of_references * number_of_pivots);
+      for (uint32_t index = 0; index < number_of_references; ++index) {
+        _insertPivotDistances(index, &descriptor_words[index * descriptor_size_words]);
+      }
+    }
+
+    //! @brief inserts the pivot distances of a reference at index_
+    inline void _insertPivotDistances(const size_t& index_, const uint64_t* reference_words_) {
+      uint16_t distances[number_of_pivots];
+      for (uint32_t index_pivot = 0; index_pivot < number_of_pivots; ++index_pivot) {
+        distances[index_pivot] = static_cast<uint16_t>(getHammingDistance<descriptor_size_words>(
+          reference_words_, &pivot_words[index_pivot * descriptor_size_words]));
+      }
+      pivot_distances.insert(pivot_distances.begin() + index_ * number_of_pivots,
+                             distances,
+                             distances + number_of_pivots);
+    }
+
+    //! @brief rebuilds the contiguous leaf storage from the current matchables
+    void _updateLeafStorage() {
+      descriptor_words.resize(matchables.size() * descriptor_size_words);
+      image_identifiers.resize(matchables.size());
+      image_slots.resize(matchables.size());
+      _resetSetBitCounts();
+      for (size_t index = 0; index < matchables.size(); ++index) {
+        Matchable::getDescriptorWords(matchables[index]->descriptor,
+                                      &descriptor_words[index * descriptor_size_words]);
+        image_identifiers[index] = matchables[index]->_image_identifier;
+        image_slots[index]       = _getImageSlot(image_identifiers[index]);
+        _addSetBitCounts(&descriptor_words[index * descriptor_size_words],
+                         _getWeight(matchables[index]));
+      }
+      _updatePivots();
+      _updatePopcountOrder();
+    }
+
+    //! @brief number of objects a matchable contributes to the bit statistics
+    static inline uint32_t _getWeight(const Matchable* matchable_) {
+#ifdef SRRG_MERGE_DESCRIPTORS
+      return static_cast<uint32_t>(matchable_->objects.size());
+#else
+      (void)matchable_;
+      return 1;
+#endif
+    }
+
+    //! @brief removes matchables from this leaf, keeping the order of the remaining matchables and
+    //! the contiguous leaf storage in sync (linear in the leaf size)
+    //! @param[in] matchables_ matchables to remove (all contained in this leaf)
+    void _removeMatchables(const std::set<const Matchable*>& matchables_) {
+      assert(!has_leafs);
+      size_t number_of_matchables_kept = 0;
+      for (size_t index = 0; index < matchables.size(); ++index) {
+        Matchable* matchable = matchables[index];
+        if (matchables_.count(matchable)) {
+          const uint32_t weight = _getWeight(matchable);
+          _removeSetBitCounts(&descriptor_words[index * descriptor_size_words], weight);
+          assert(weight <= _header.number_of_matchables_uncompressed);
+          _header.number_of_matchables_uncompressed -= weight;
+          continue;
+        }
+        if (number_of_matchables_kept != index) {
+          matchables[number_of_matchables_kept] = matchable;
+          std::copy(descriptor_words.begin() + index * descriptor_size_words,
+                    descriptor_words.begin() + (index + 1) * descriptor_size_words,
+                    descriptor_words.begin() + number_of_matchables_kept * descriptor_size_words);
+          image_identifiers[number_of_matchables_kept] = image_identifiers[index];
+          image_slots[number_of_matchables_kept]       = image_slots[index];
+          if (!pivot_distances.empty()) {
+            std::copy(pivot_distances.begin() + index * number_of_pivots,
+                      pivot_distances.begin() + (index + 1) * number_of_pivots,
+                      pivot_distances.begin() + number_of_matchables_kept * number_of_pivots);
+          }
+          if (!popcounts.empty()) {
+            popcounts[number_of_matchables_kept] = popcounts[index];
+          }
+        }
+        ++number_of_matchables_kept;
+      }
+      assert(matchables.size() == number_of_matchables_kept + matchables_.size());
+      matchables.resize(number_of_matchables_kept);
+      descriptor_words.resize(number_of_matchables_kept * descriptor_size_words);
+      image_identifiers.resize(number_of_matchables_kept);
+      image_slots.resize(number_of_matchables_kept);
+      if (number_of_matchables_kept < minimum_leaf_size_for_pivots) {
+        DescriptorWordVector().swap(pivot_words);
+        std::vector<uint16_t>().swap(pivot_distances);
+      } else if (!pivot_distances.empty()) {
+        pivot_distances.resize(number_of_matchables_kept * number_of_pivots);
+      }
+      if (!popcounts.empty()) {
+        popcounts.resize(number_of_matchables_kept);
+      }
+      _header.number_of_matchables_compressed = number_of_matchables_kept;
+    }
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+    //! @brief removes the object of an image from a merged matchable of this leaf
+    //! @param[in] matchable_ merged matchable contained in this leaf (keeps at least one object)
+    //! @param[in] image_identifier_ image of the object to remove
+    void _removeObject(Matchable* matchable_, const uint64_t& image_identifier_) {
+      assert(!has_leafs);
+      const size_t index =
+        std::find(matchables.begin(), matchables.end(), matchable_) - matchables.begin();
+      assert(index < matchables.size());
+      matchable_->removeObject(image_identifier_);
+      image_identifiers[index] = matchable_->_image_identifier;
+      image_slots[index]       = _getImageSlot(image_identifiers[index]);
+      _removeSetBitCounts(&descriptor_words[index * descriptor_size_words], 1);
+      assert(0 < _header.number_of_matchables_uncompressed);
+      --_header.number_of_matchables_uncompressed;
+    }
+#endif
+
+    //! @brief turns this node back into a leaf holding the matchables of its two leafs, which are
+    //! freed (inverse of a split)
+    void _collapseLeafs() {
+      assert(has_leafs);
+      Node* leaf_zeros = left;
+      Node* leaf_ones  = right;
+      assert(!leaf_zeros->has_leafs && !leaf_ones->has_leafs);
+      matchables = leaf_zeros->matchables;
+      matchables.insert(
+        matchables.end(), leaf_ones->matchables.begin(), leaf_ones->matchables.end());
+      _header.number_of_matchables_uncompressed =
+        leaf_zeros->_header.number_of_matchables_uncompressed +
+        leaf_ones->_header.number_of_matchables_uncompressed;
+      _header.number_of_matchables_compressed = matchables.size();
+      has_leafs                               = false;
+      index_split_bit                         = -1;
+      number_of_on_bits_total                 = 0;
+      partitioning                            = 1;
+      left                                    = nullptr;
+      right                                   = nullptr;
+      delete leaf_zeros;
+      delete leaf_ones;
+      _updateLeafStorage();
+    }
+
+    //! @brief releases all matchable references (e.g. when a leaf becomes an inner node)
+    void _clearLeafStorage() {
+      MatchableVector().swap(matchables);
+      DescriptorWordVector().swap(descriptor_words);
+      std::vector<uint64_t>().swap(image_identifiers);
+      std::vector<uint32_t>().swap(image_slots);
+      std::vector<uint32_t>().swap(set_bit_counts);
+      std::vector<uint64_t>().swap(set_bit_counts_pending);
+      number_of_set_bit_counts_pending = 0;
+      DescriptorWordVector().swap(pivot_words);
+      std::vector<uint16_t>().swap(pivot_distances);
+      std::vector<uint16_t>().swap(popcounts);
+    }
+
+    //! @brief slot of an image in the owning tree (maximum value if unknown)
+    inline uint32_t _getImageSlot(const uint64_t& image_identifier_) const {
+      if (_slot_per_identifier) {
+        const typename SlotPerIdentifier::const_iterator iterator =
+          _slot_per_identifier->find(image_identifier_);
+        if (iterator != _slot_per_identifier->end()) {
+          return iterator->second;
+        }
+      }
+      return std::numeric_limits<uint32_t>::max();
+    }
+
+    //! @brief attaches the slots of the owning tree to this subtree and refreshes the image slots
+    //! of its leafs (created leafs inherit the slots from their parent)
+    void _setSlotPerIdentifier(const SlotPerIdentifier* slot_per_identifier_) {
+      _slot_per_identifier = slot_per_identifier_;
+      if (has_leafs) {
+        left.load()->_setSlotPerIdentifier(slot_per_identifier_);
+        right.load()->_setSlotPerIdentifier(slot_per_identifier_);
+      } else {
+        for (size_t index = 0; index < image_identifiers.size(); ++index) {
+          image_slots[index] = _getImageSlot(image_identifiers[index]);
+        }
+      }
+    }
+
+    //! @brief creates an unsplit copy of this leaf sharing its matchables (copy-on-write update
+    //! of a leaf that is visible to concurrent readers)
+    Node* _copyLeaf() const {
+      assert(!has_leafs);
+      Node* leaf                             = new Node();
+      leaf->parent                           = parent;
+      leaf->_header                          = _header;
+      leaf->matchables                       = matchables;
+      leaf->descriptor_words                 = descriptor_words;
+      leaf->image_identifiers                = image_identifiers;
+      leaf->image_slots                      = image_slots;
+      leaf->_slot_per_identifier             = _slot_per_identifier;
+      leaf->set_bit_counts                   = set_bit_counts;
+      leaf->set_bit_counts_pending           = set_bit_counts_pending;
+      leaf->number_of_set_bit_counts_pending = number_of_set_bit_counts_pending;
+      leaf->pivot_words                      = pivot_words;
+      leaf->pivot_distances                  = pivot_distances;
+      leaf->popcounts                        = popcounts;
+      leaf->bit_mask                         = bit_mask;
+      return leaf;
+    }
+
     // ds public fields
   public:
-    //! @brief leaf containing all unset bits
-    Node* left = nullptr;
+    //! @brief leaf containing all unset bits (atomic: children may be replaced while concurrent
+    //! readers descend the tree)
+    std::atomic<Node*> left{nullptr};
 
     //! @brief leaf containing all set bits
-    Node* right = nullptr;
+    std::atomic<Node*> right{nullptr};
 
     //! @brief parent node (if any, for root:parent=0)
     Node* parent = nullptr;
@@ -315,14 +938,59 @@ namespace srrg_hbst {
     //! @brief maximum tree depth (leaf spawning blocks if reached, default: descriptor dimension)
     static uint32_t maximum_depth;
 
+    //! @brief leafs with at least this many matchables keep pivots for triangle inequality pruning
+    //! in scan (0: disabled), takes effect for leafs created or updated afterwards
+    static uint64_t minimum_leaf_size_for_pivots;
+
+    //! @brief leafs with at least this many matchables are kept sorted by descriptor popcount,
+    //! which restricts scans to a popcount window (0: disabled), takes effect for leafs created or
+    //! updated afterwards
+    static uint64_t minimum_leaf_size_for_popcount_order;
+
+    //! @brief scans up to this matching distance abandon the distance of a reference word by word
+    //! once it reaches the matching distance, instead of counting all words with the fastest full
+    //! distance kernel (0: disabled, default: half a word for descriptors of at least 4 words,
+    //! where most references are rejected after their first word)
+    static uint32_t maximum_distance_for_early_exit;
+
     // ds fields
   protected:
     //! @brief serializable header carrying core attributes
     Header _header;
 
-    //! @brief matchables contained in this node
+    //! @brief matchables contained in this node - also serves as object handle array for the
+    //! contiguous leaf storage below (all arrays are parallel)
     MatchableVector matchables;
 
+    //! @brief descriptors of the matchables, packed contiguously for linear leaf scans
+    DescriptorWordVector descriptor_words;
+
+    //! @brief image identifier of each matchable (first one for merged matchables)
+    std::vector<uint64_t> image_identifiers;
+
+    //! @brief image slot of each matchable in the owning tree (parallel to image_identifiers)
+    std::vector<uint32_t> image_slots;
+
+    //! @brief slots of the owning tree the image slots are looked up in (nullptr if none)
+    const SlotPerIdentifier* _slot_per_identifier = nullptr;
+
+    //! @brief number of matchables with each bit set, weighted by their number of objects
+    //! (leaf bit statistics for split selection, maintained along with the leaf storage)
+    std::vector<uint32_t> set_bit_counts;
+
+    //! @brief byte lane accumulators not yet flushed into set_bit_counts
+    std::vector<uint64_t> set_bit_counts_pending;
+    uint32_t number_of_set_bit_counts_pending = 0;
+
+    //! @brief pivot descriptors of this leaf (empty if the leaf is too small for pruning)
+    DescriptorWordVector pivot_words;
+
+    //! @brief distance of each matchable to each pivot (number_of_pivots per matchable)
+    std::vector<uint16_t> pivot_distances;
+
+    //! @brief descriptor popcount of each matchable, ascending (empty if the leaf is unordered)
+    std::vector<uint16_t> popcounts;
+
     //! @brief the split bit diving potential leafs of this node
     int32_t index_split_bit = -1;
 
@@ -355,7 +1023,20 @@ namespace srrg_hbst {
   uint32_t BinaryNode<BinaryMatchableType_, real_type_>::maximum_depth =
     BinaryMatchableType_::descriptor_size_bits;
   template <typename BinaryMatchableType_, typename real_type_>
+  uint64_t BinaryNode<BinaryMatchableType_, real_type_>::minimum_leaf_size_for_pivots = 0;
+  template <typename BinaryMatchableType_, typename real_type_>
+  uint64_t BinaryNode<BinaryMatchableType_, real_type_>::minimum_leaf_size_for_popcount_order = 0;
+  template <typename BinaryMatchableType_, typename real_type_>
+  uint32_t BinaryNode<BinaryMatchableType_, real_type_>::maximum_distance_for_early_exit =
+    BinaryMatchableType_::descriptor_size_words >= 4 ? 32 : 0;
+  template <typename BinaryMatchableType_, typename real_type_>
   std::mt19937 BinaryNode<BinaryMatchableType_, real_type_>::random_number_generator;
+  template <typename BinaryMatchableType_, typename real_type_>
+  constexpr uint32_t BinaryNode<BinaryMatchableType_, real_type_>::descriptor_size_words;
+  template <typename BinaryMatchableType_, typename real_type_>
+  constexpr uint32_t BinaryNode<BinaryMatchableType_, real_type_>::scan_block_size;
+  template <typename BinaryMatchableType_, typename real_type_>
+  constexpr uint32_t BinaryNode<BinaryMatchableType_, real_type_>::number_of_pivots;
 
   template <typename ObjectType_>
   using BinaryNode128 = BinaryNode<BinaryMatchable128<ObjectType_>>;
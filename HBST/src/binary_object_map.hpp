@@ -0,0 +1,215 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace srrg_hbst {
+
+  //! @class compact image identifier to object mapping of a matchable: the single object of an
+  //! unmerged matchable is stored inline (no allocation, constructed on insertion), merged
+  //! matchables keep their objects in a sorted side vector - iteration, lookup and insertion
+  //! follow std::map (ascending keys)
+  //! @param ObjectType_ object type (e.g. keypoint or index) linked to a descriptor
+  template <typename ObjectType_>
+  class BinaryObjectMap {
+    // ds exports
+  public:
+    using key_type       = uint64_t;
+    using mapped_type    = ObjectType_;
+    using value_type     = std::pair<uint64_t, ObjectType_>;
+    using iterator       = value_type*;
+    using const_iterator = const value_type*;
+
+    // ds ctor/dtor
+  public:
+    BinaryObjectMap() {
+    }
+
+    BinaryObjectMap(const BinaryObjectMap& other_) {
+      if (other_._multiple) {
+        _multiple = new std::vector<value_type>(*other_._multiple);
+      } else if (other_._size == 1) {
+        new (&_single) value_type(*other_._getSingle());
+      }
+      _size = other_._size;
+    }
+
+    BinaryObjectMap(BinaryObjectMap&& other_) noexcept {
+      _take(other_);
+    }
+
+    BinaryObjectMap& operator=(const BinaryObjectMap& other_) {
+      if (this != &other_) {
+        BinaryObjectMap copy(other_);
+        clear();
+        _take(copy);
+      }
+      return *this;
+    }
+
+    BinaryObjectMap& operator=(BinaryObjectMap&& other_) noexcept {
+      if (this != &other_) {
+        clear();
+        _take(other_);
+      }
+      return *this;
+    }
+
+    ~BinaryObjectMap() {
+      clear();
+    }
+
+    // ds access
+  public:
+    iterator begin() {
+      return _multiple ? _multiple->data() : _getSingle();
+    }
+    const_iterator begin() const {
+      return _multiple ? _multiple->data() : _getSingle();
+    }
+    iterator end() {
+      return begin() + _size;
+    }
+    const_iterator end() const {
+      return begin() + _size;
+    }
+    size_t size() const {
+      return _size;
+    }
+    bool empty() const {
+      return _size == 0;
+    }
+
+    iterator find(const uint64_t& key_) {
+      const iterator element = _lowerBound(key_);
+      return (element != end() && element->first == key_) ? element : end();
+    }
+    const_iterator find(const uint64_t& key_) const {
+      return const_cast<BinaryObjectMap*>(this)->find(key_);
+    }
+    size_t count(const uint64_t& key_) const {
+      return find(key_) != end();
+    }
+    ObjectType_& at(const uint64_t& key_) {
+      const iterator element = find(key_);
+      if (element == end()) {
+        throw std::out_of_range("BinaryObjectMap::at|ERROR: unknown key");
+      }
+      return element->second;
+    }
+    const ObjectType_& at(const uint64_t& key_) const {
+      return const_cast<BinaryObjectMap*>(this)->at(key_);
+    }
+
+    //! @brief inserts an element if its key is not present yet (see std::map::insert)
+    std::pair<iterator, bool> insert(const value_type& element_) {
+      iterator element = _lowerBound(element_.first);
+      if (element != end() && element->first == element_.first) {
+        return std::make_pair(element, false);
+      }
+
+      // ds the first element is stored inline, the second one moves all to the side vector
+      if (_size == 0) {
+        new (&_single) value_type(element_);
+        _size = 1;
+        return std::make_pair(begin(), true);
+      }
+      if (!_multiple) {
+        std::vector<value_type>* multiple = new std::vector<value_type>();
+        multiple->reserve(2);
+        multiple->emplace_back(std::move(*_getSingle()));
+        _getSingle()->~value_type();
+        _multiple = multiple;
+        element   = _lowerBound(element_.first);
+      }
+      const size_t index = element - begin();
+      _multiple->insert(_multiple->begin() + index, element_);
+      ++_size;
+      return std::make_pair(begin() + index, true);
+    }
+
+    template <typename Iterator_>
+    void insert(Iterator_ begin_, Iterator_ end_) {
+      for (Iterator_ element = begin_; element != end_; ++element) {
+        insert(*element);
+      }
+    }
+
+    //! @brief removes the element with key_ - the last remaining element is stored inline again
+    size_t erase(const uint64_t& key_) {
+      const iterator element = find(key_);
+      if (element == end()) {
+        return 0;
+      }
+      --_size;
+      if (!_multiple) {
+        _getSingle()->~value_type();
+        return 1;
+      }
+      _multiple->erase(_multiple->begin() + (element - begin()));
+      if (_size == 1) {
+        new (&_single) value_type(std::move(_multiple->front()));
+        delete _multiple;
+        _multiple = nullptr;
+      }
+      return 1;
+    }
+
+    void clear() {
+      if (_multiple) {
+        delete _multiple;
+        _multiple = nullptr;
+      } else if (_size == 1) {
+        _getSingle()->~value_type();
+      }
+      _size = 0;
+    }
+
+    // ds helpers
+  protected:
+    value_type* _getSingle() {
+      return reinterpret_cast<value_type*>(&_single);
+    }
+    const value_type* _getSingle() const {
+      return reinterpret_cast<const value_type*>(&_single);
+    }
+
+    //! @brief takes over the objects of an other (empty) map, leaving it empty
+    void _take(BinaryObjectMap& other_) noexcept {
+      assert(_size == 0 && !_multiple);
+      if (other_._multiple) {
+        _multiple        = other_._multiple;
+        other_._multiple = nullptr;
+      } else if (other_._size == 1) {
+        new (&_single) value_type(std::move(*other_._getSingle()));
+        other_._getSingle()->~value_type();
+      }
+      _size        = other_._size;
+      other_._size = 0;
+    }
+
+    iterator _lowerBound(const uint64_t& key_) {
+      return std::lower_bound(
+        begin(), end(), key_, [](const value_type& element_, const uint64_t& key_element_) {
+          return element_.first < key_element_;
+        });
+    }
+
+    // ds attributes
+  protected:
+    //! @brief raw inline storage of a single object (constructed if _size == 1 and no _multiple)
+    typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type _single;
+
+    //! @brief side storage of merged objects, sorted by key (nullptr for a single object)
+    std::vector<value_type>* _multiple = nullptr;
+
+    //! @brief number of objects
+    uint32_t _size = 0;
+  };
+
+} // namespace srrg_hbst
@@ -1,13 +1,22 @@
 #pragma once
 #include <algorithm>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <set>
 #include <unordered_map>
 
+#include "binary_match_accumulator.hpp"
+#include "binary_matchable_pool.hpp"
 #include "binary_node.hpp"
+#include "binary_tree_mapped.hpp"
+#include "binary_tree_statistics.hpp"
+#include "epoch_reclaimer.hpp"
+#include "thread_pool.hpp"
 
 // ds helper macro for controlled reading and writing operations
 #define GUARDED_IO(FILE, IO_OPERATION, VARIABLE, SIZE, ERROR_MESSAGE) \
@@ -37,6 +46,14 @@ namespace srrg_hbst {
     using MatchVector           = std::vector<Match>;
     using MatchVectorMap        = std::unordered_map<uint64_t, std::vector<Match>>;
     using MatchVectorMapElement = std::pair<uint64_t, std::vector<Match>>;
+    using MatchablePool         = BinaryMatchablePool<Matchable>;
+    using MatchAccumulator      = BinaryMatchAccumulator<Match>;
+    using Mapped                = BinaryTreeMapped<BinaryTree>;
+#ifdef SRRG_HBST_STATISTICS
+    using QueryStatistics = BinaryQueryStatistics;
+#else
+    using QueryStatistics = BinaryQueryStatisticsDisabled;
+#endif
 
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief component object used for matchable merging
@@ -67,6 +84,17 @@ namespace srrg_hbst {
     };
     typedef std::vector<Score> ScoreVector;
 
+    //! @brief per query budget of the multi-probe search (see matchMultiProbe)
+    struct ProbeBudget {
+      ProbeBudget(const uint32_t& maximum_number_of_leafs_       = 1,
+                  const uint32_t& maximum_number_of_comparisons_ = 0) :
+        maximum_number_of_leafs(maximum_number_of_leafs_),
+        maximum_number_of_comparisons(maximum_number_of_comparisons_) {
+      }
+      uint32_t maximum_number_of_leafs;       // scanned leafs (at least the leaf of the query path)
+      uint32_t maximum_number_of_comparisons; // descriptor comparisons (0: unbounded)
+    };
+
     //! @brief object header containing main attributes
     struct Header {
       Header(const uint64_t& identifier_ = 0) :
@@ -95,7 +123,7 @@ namespace srrg_hbst {
     BinaryTree(const uint64_t& identifier_) : _header(identifier_), _root(nullptr) {
       _matchables.clear();
       _matchables_to_train.clear();
-      _added_identifiers_train.clear();
+      _clearIdentifiers();
       _trainables.clear();
 #ifdef SRRG_MERGE_DESCRIPTORS
       _merged_matchables.clear();
@@ -114,15 +142,32 @@ namespace srrg_hbst {
       _root(new Node(matchables_, train_mode_)) {
       _matchables.clear();
       _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+      _indexMatchables(matchables_);
       _matchables_to_train.clear();
-      _added_identifiers_train.clear();
-      _added_identifiers_train.insert(_header.identifier);
+      _clearIdentifiers();
+      _insertIdentifier(_header.identifier);
+      _attachImageSlots();
       _trainables.clear();
 #ifdef SRRG_MERGE_DESCRIPTORS
       _merged_matchables.clear();
 #endif
     }
 
+    //! @brief bulk construction on filtered descriptors: the tree is built in parallel on the
+    //! provided thread pool, which is kept for later processing (see setThreadPool)
+    BinaryTree(const uint64_t& identifier_,
+               const MatchableVector& matchables_,
+               const SplittingStrategy& train_mode_,
+               std::shared_ptr<ThreadPool> thread_pool_) :
+      BinaryTree(identifier_) {
+      _thread_pool = thread_pool_;
+      _root        = _buildTree(matchables_, Descriptor().set(), train_mode_);
+      _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+      _indexMatchables(matchables_);
+      _insertIdentifier(_header.identifier);
+      _attachImageSlots();
+    }
+
     // ds construct tree upon allocation on filtered descriptors
     BinaryTree(const MatchableVector& matchables_,
                const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
@@ -138,9 +183,11 @@ namespace srrg_hbst {
       _root(new Node(matchables_, bit_mask_, train_mode_)) {
       _matchables.clear();
       _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+      _indexMatchables(matchables_);
       _matchables_to_train.clear();
-      _added_identifiers_train.clear();
-      _added_identifiers_train.insert(_header.identifier);
+      _clearIdentifiers();
+      _insertIdentifier(_header.identifier);
+      _attachImageSlots();
       _trainables.clear();
 #ifdef SRRG_MERGE_DESCRIPTORS
       _merged_matchables.clear();
@@ -150,6 +197,7 @@ namespace srrg_hbst {
     // ds free all nodes in the tree without freeing the matchables - call clear(true)
     ~BinaryTree() {
       clear();
+      delete _identifiers_snapshot.load();
     }
 
     // ds shared pointer access wrappers
@@ -223,6 +271,50 @@ namespace srrg_hbst {
       return _root;
     }
 
+    //! @brief leaf depth and size distributions of the tree (walks all nodes)
+    const BinaryTreeShape getShape() const {
+      const EpochReclaimer::Guard guard(_getReclaimer());
+      BinaryTreeShape shape;
+      std::vector<const Node*> nodes;
+      if (_root) {
+        nodes.push_back(_root);
+      }
+      while (!nodes.empty()) {
+        const Node* node = nodes.back();
+        nodes.pop_back();
+        if (node->has_leafs) {
+          ++shape.number_of_inner_nodes;
+          nodes.push_back(node->right);
+          nodes.push_back(node->left);
+        } else {
+          shape.addLeaf(node->getDepth(), node->matchables.size());
+        }
+      }
+      return shape;
+    }
+
+#ifdef SRRG_HBST_STATISTICS
+    //! @brief traversal counters accumulated over all queries (match, matchSparse,
+    //! matchMultiProbe, matchAndAdd and getScorePerImage) since construction or resetStatistics
+    const BinaryQueryStatistics getStatistics() const {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      return _statistics;
+    }
+
+    //! @brief traversal counters of the last completed query call
+    const BinaryQueryStatistics getStatisticsLastCall() const {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      return _statistics_last_call;
+    }
+
+    //! @brief clears all traversal counters
+    void resetStatistics() {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      _statistics           = BinaryQueryStatistics();
+      _statistics_last_call = BinaryQueryStatistics();
+    }
+#endif
+
     //! number of merged matchables in last call
     const size_t numberOfMergedMatchablesLastTraining() const {
 #ifdef SRRG_MERGE_DESCRIPTORS
@@ -248,98 +340,188 @@ namespace srrg_hbst {
       if (matchables_query_.empty()) {
         return 0;
       }
-      uint64_t number_of_matches = 0;
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              if (maximum_distance_ > matchable_query->distance(matchable_reference)) {
-                ++number_of_matches;
-                break;
+      // ds for each descriptor (in parallel ranges if a thread pool is set)
+      const size_t number_of_ranges = _getNumberOfQueryRanges(matchables_query_.size());
+      std::vector<uint64_t> number_of_matches_per_range(number_of_ranges, 0);
+      const EpochReclaimer::Guard guard(_getReclaimer());
+      _forEachQuery(
+        matchables_query_,
+        number_of_ranges,
+        [&](const size_t& index_range, const Matchable* matchable_query) {
+          uint64_t& number_of_matches = number_of_matches_per_range[index_range];
+
+          // ds traverse tree to find this descriptor
+          const Node* node_current = _root;
+          while (node_current) {
+            // ds if this node has leaves (is splittable)
+            if (node_current->has_leafs) {
+              // ds check the split bit and go deeper
+              if (matchable_query->descriptor[node_current->index_split_bit]) {
+                node_current = node_current->right;
+              } else {
+                node_current = node_current->left;
               }
+            } else {
+              // ds check current descriptors in this node and exit
+              node_current->scan(matchable_query->descriptor,
+                                 maximum_distance_,
+                                 [&number_of_matches](const uint32_t& /*index_reference*/,
+                                                      const uint32_t& /*distance*/) {
+                                   ++number_of_matches;
+                                   return false;
+                                 });
+              break;
             }
-            break;
           }
-        }
-      }
-      return number_of_matches;
+        });
+      return std::accumulate(
+        number_of_matches_per_range.begin(), number_of_matches_per_range.end(), uint64_t(0));
     }
 
+    //! @brief number of matches and matching ratio for each image in the database - a query
+    //! matchable counts once per reference image, the counts are kept in flat arrays indexed by
+    //! image slot (see ImageSlots) with epoch stamps for deduplication, which are reused across
+    //! calls (see ScoreScratch) and indexed directly with the slots stored in the leafs
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] sort_output if set, the scores are sorted in descending order by matching ratio
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] maximum_number_of_images_ if set, only the scores of the images with the most
+    //! matches are returned in descending order (partial selection among the matched images, ties
+    //! are resolved in favor of lower image identifiers) - otherwise all images are scored
+    //! @returns scores per image (in order of image identifiers if not sorted)
     const ScoreVector getScorePerImage(const MatchableVector& matchables_query_,
-                                       const bool sort_output           = false,
-                                       const uint32_t maximum_distance_ = 25) const {
+                                       const bool sort_output                  = false,
+                                       const uint32_t maximum_distance_        = 25,
+                                       const size_t& maximum_number_of_images_ = 0) const {
       if (matchables_query_.empty()) {
         return ScoreVector(0);
       }
-      ScoreVector scores_per_image(_added_identifiers_train.size());
-
-      // ds identifier to vector index mapping - simultaneously initialize result vector
-      std::map<uint64_t, uint64_t> mapping_identifier_image_to_score;
-      for (const uint64_t& identifier_reference : _added_identifiers_train) {
-        scores_per_image[mapping_identifier_image_to_score.size()].identifier_reference =
-          identifier_reference;
-        mapping_identifier_image_to_score.insert(
-          std::make_pair(identifier_reference, mapping_identifier_image_to_score.size()));
-      }
-
-      // ds for each query descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
+      const EpochReclaimer::Guard guard(_getReclaimer());
+
+      // ds identifiers and slots of the same snapshot for concurrent reading
+      const IdentifierSnapshot* snapshot =
+        _concurrent_reading ? _identifiers_snapshot.load() : nullptr;
+      const std::set<uint64_t>& identifiers =
+        snapshot ? snapshot->identifiers : _added_identifiers_train;
+      const ImageSlots& image_slots = snapshot ? snapshot->image_slots : _image_slots;
+      const size_t number_of_slots  = image_slots.identifier_per_slot.size();
+      const size_t number_of_ranges = _getNumberOfQueryRanges(matchables_query_.size());
+
+      // ds per range match counts (returned cleared to the pool when leaving this scope)
+      const ScoreScratchLease counts_per_range(
+        _score_scratch_pool, number_of_ranges, number_of_slots);
+      std::vector<QueryStatistics> statistics_per_range(number_of_ranges);
+
+      // ds for each query descriptor (in parallel ranges if a thread pool is set)
+      _forEachQuery(
+        matchables_query_,
+        number_of_ranges,
+        [&](const size_t& index_range, const Matchable* matchable_query) {
+          ScoreScratch& counts = counts_per_range[index_range];
+          ++counts.stamp;
+          statistics_per_range[index_range].addQuery();
+
+          // ds traverse tree to find this descriptor
+          const Node* node_current = _root;
+          while (node_current) {
+            // ds if this node has leaves (is splittable)
+            if (node_current->has_leafs) {
+              // ds check the split bit and go deeper
+              if (matchable_query->descriptor[node_current->index_split_bit]) {
+                node_current = node_current->right;
+              } else {
+                node_current = node_current->left;
+              }
             } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors for each reference image in this node and exit
-            std::set<uint64_t> matched_references;
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              if (matchable_query->distance(matchable_reference) < maximum_distance_) {
+              // ds check current descriptors for each reference image in this node and exit
+              uint64_t number_of_matches           = 0;
+              const uint32_t number_of_comparisons = node_current->scan(
+                matchable_query->descriptor,
+                maximum_distance_,
+                [&](const uint32_t& index_reference, const uint32_t& /*distance*/) {
+                  ++number_of_matches;
+                  const uint32_t& slot_leaf = node_current->image_slots[index_reference];
 #ifdef SRRG_MERGE_DESCRIPTORS
-                for (const ObjectMapElement& object : matchable_reference->objects) {
-                  const uint64_t& identifier_reference = object.first;
+                  for (const ObjectMapElement& object :
+                       node_current->matchables[index_reference]->objects) {
+                    const uint64_t& identifier_reference = object.first;
 #else
-                const uint64_t& identifier_reference = matchable_reference->_image_identifier;
+                  const uint64_t& identifier_reference =
+                    node_current->image_identifiers[index_reference];
 #endif
 
-                  // ds the query matchable can be matched only once to each reference image
-                  if (matched_references.count(identifier_reference) == 0) {
-                    ++scores_per_image[mapping_identifier_image_to_score.at(identifier_reference)]
-                        .number_of_matches;
-                    matched_references.insert(identifier_reference);
-                  }
+                    // ds the query matchable can be matched only once to each reference image
+                    // ds (images added after the call started are not scored)
+                    const uint32_t slot = image_slots.getSlot(identifier_reference, slot_leaf);
+                    if (slot < number_of_slots && counts.stamps[slot] != counts.stamp) {
+                      counts.stamps[slot] = counts.stamp;
+                      if (counts.number_of_matches[slot]++ == 0) {
+                        counts.slots_matched.push_back(slot);
+                      }
+                    }
 #ifdef SRRG_MERGE_DESCRIPTORS
-                }
+                  }
 #endif
-              }
+                  return true;
+                });
+              statistics_per_range[index_range].addLeaf(node_current->getDepth() + 1,
+                                                        node_current->getDepth(),
+                                                        node_current->matchables.size(),
+                                                        number_of_comparisons,
+                                                        number_of_matches);
+              break;
             }
-            break;
           }
+        });
+      _recordStatistics(statistics_per_range);
+
+      // ds merge range results (only matched slots are visited)
+      ScoreScratch& counts = counts_per_range[0];
+      for (size_t index_range = 1; index_range < number_of_ranges; ++index_range) {
+        const ScoreScratch& counts_range = counts_per_range[index_range];
+        for (const uint32_t& slot : counts_range.slots_matched) {
+          if (counts.number_of_matches[slot] == 0) {
+            counts.slots_matched.push_back(slot);
+          }
+          counts.number_of_matches[slot] += counts_range.number_of_matches[slot];
         }
       }
 
-      // ds compute relative scores
+      // ds compute relative scores - for all images or the matched images only
       const real_type number_of_query_descriptors = matchables_query_.size();
-      for (Score& score : scores_per_image) {
-        score.matching_ratio = score.number_of_matches / number_of_query_descriptors;
+      ScoreVector scores_per_image;
+      const auto add_score = [&](const uint32_t& slot) {
+        Score score;
+        score.number_of_matches    = counts.number_of_matches[slot];
+        score.matching_ratio       = score.number_of_matches / number_of_query_descriptors;
+        score.identifier_reference = image_slots.identifier_per_slot[slot];
+        scores_per_image.push_back(score);
+      };
+      if (maximum_number_of_images_ == 0) {
+        scores_per_image.reserve(identifiers.size());
+        for (const uint64_t& identifier_reference : identifiers) {
+          add_score(image_slots.slot_per_identifier.at(identifier_reference));
+        }
+      } else {
+        scores_per_image.reserve(counts.slots_matched.size());
+        for (const uint32_t& slot : counts.slots_matched) {
+          add_score(slot);
+        }
+
+        // ds select the best images: O(matched images + K log K)
+        const size_t number_of_images =
+          std::min(maximum_number_of_images_, scores_per_image.size());
+        std::partial_sort(scores_per_image.begin(),
+                          scores_per_image.begin() + number_of_images,
+                          scores_per_image.end(),
+                          [](const Score& a_, const Score& b_) {
+                            return a_.number_of_matches > b_.number_of_matches ||
+                                   (a_.number_of_matches == b_.number_of_matches &&
+                                    a_.identifier_reference < b_.identifier_reference);
+                          });
+        scores_per_image.resize(number_of_images);
+        return scores_per_image;
       }
 
       // ds if desired, sort in descending order by matching ratio
@@ -358,6 +540,7 @@ namespace srrg_hbst {
         return 0;
       }
       uint64_t number_of_matches = 0;
+      const EpochReclaimer::Guard guard(_getReclaimer());
 
       // ds for each descriptor
       for (const Matchable* matchable_query : matchables_query_) {
@@ -392,35 +575,50 @@ namespace srrg_hbst {
         return;
       }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              const real_type distance = matchable_query->distance(matchable_reference);
-              if (distance < maximum_distance_) {
-                matches_.push_back(Match(matchable_query,
-                                         matchable_reference,
-                                         matchable_query->objects.begin()->second,
-                                         matchable_reference->objects.begin()->second,
-                                         distance));
-                break;
+      // ds for each descriptor (in parallel ranges if a thread pool is set)
+      const size_t number_of_ranges = _getNumberOfQueryRanges(matchables_query_.size());
+      std::vector<MatchVector> matches_per_range(number_of_ranges > 1 ? number_of_ranges : 0);
+      const EpochReclaimer::Guard guard(_getReclaimer());
+      _forEachQuery(
+        matchables_query_,
+        number_of_ranges,
+        [&](const size_t& index_range, const Matchable* matchable_query) {
+          MatchVector& matches =
+            number_of_ranges > 1 ? matches_per_range[index_range] : matches_;
+
+          // ds traverse tree to find this descriptor
+          const Node* node_current = _root;
+          while (node_current) {
+            // ds if this node has leaves (is splittable)
+            if (node_current->has_leafs) {
+              // ds check the split bit and go deeper
+              if (matchable_query->descriptor[node_current->index_split_bit]) {
+                node_current = node_current->right;
+              } else {
+                node_current = node_current->left;
               }
+            } else {
+              // ds check current descriptors in this node and exit
+              node_current->scan(
+                matchable_query->descriptor,
+                maximum_distance_,
+                [&](const uint32_t& index_reference, const uint32_t& distance) {
+                  const Matchable* matchable_reference = node_current->matchables[index_reference];
+                  matches.push_back(Match(matchable_query,
+                                          matchable_reference,
+                                          matchable_query->objects.begin()->second,
+                                          matchable_reference->objects.begin()->second,
+                                          distance));
+                  return false;
+                });
+              break;
             }
-            break;
           }
-        }
+        });
+
+      // ds merge range results in query order
+      for (const MatchVector& matches : matches_per_range) {
+        matches_.insert(matches_.end(), matches.begin(), matches.end());
       }
     }
 
@@ -432,44 +630,61 @@ namespace srrg_hbst {
         return;
       }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
+      // ds for each descriptor (in parallel ranges if a thread pool is set)
+      const size_t number_of_ranges = _getNumberOfQueryRanges(matchables_query_.size());
+      std::vector<MatchVector> matches_per_range(number_of_ranges > 1 ? number_of_ranges : 0);
+      const EpochReclaimer::Guard guard(_getReclaimer());
+      _forEachQuery(
+        matchables_query_,
+        number_of_ranges,
+        [&](const size_t& index_range, const Matchable* matchable_query) {
+          MatchVector& matches =
+            number_of_ranges > 1 ? matches_per_range[index_range] : matches_;
+
+          // ds traverse tree to find this descriptor
+          const Node* node_current = _root;
+          while (node_current) {
+            // ds if this node has leaves (is splittable)
+            if (node_current->has_leafs) {
+              // ds check the split bit and go deeper
+              if (matchable_query->descriptor[node_current->index_split_bit]) {
+                node_current = node_current->right;
+              } else {
+                node_current = node_current->left;
+              }
             } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds current best (0 if none)
-            const Matchable* matchable_reference_best = nullptr;
-            uint32_t distance_best                    = maximum_distance_;
-
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              const uint32_t& distance = matchable_query->distance(matchable_reference);
-              if (distance < distance_best) {
-                matchable_reference_best = matchable_reference;
-                distance_best            = distance;
+              // ds current best (0 if none)
+              const Matchable* matchable_reference_best = nullptr;
+              uint32_t distance_best                    = maximum_distance_;
+
+              // ds check current descriptors in this node and exit
+              node_current->scan(
+                matchable_query->descriptor,
+                maximum_distance_,
+                [&](const uint32_t& index_reference, const uint32_t& distance) {
+                  if (distance < distance_best) {
+                    matchable_reference_best = node_current->matchables[index_reference];
+                    distance_best            = distance;
+                  }
+                  return true;
+                });
+
+              // ds if a match was found
+              if (matchable_reference_best) {
+                matches.push_back(Match(matchable_query,
+                                        matchable_reference_best,
+                                        matchable_query->objects.begin()->second,
+                                        matchable_reference_best->objects.begin()->second,
+                                        distance_best));
               }
+              break;
             }
-
-            // ds if a match was found
-            if (matchable_reference_best) {
-              matches_.push_back(Match(matchable_query,
-                                       matchable_reference_best,
-                                       matchable_query->objects.begin()->second,
-                                       matchable_reference_best->objects.begin()->second,
-                                       distance_best));
-            }
-            break;
           }
-        }
+        });
+
+      // ds merge range results in query order
+      for (const MatchVector& matches : matches_per_range) {
+        matches_.insert(matches_.end(), matches.begin(), matches.end());
       }
     }
 
@@ -491,46 +706,38 @@ namespace srrg_hbst {
     void match(const MatchableVector& matchables_query_,
                MatchVectorMap& matches_,
                const uint32_t& maximum_distance_matching_ = 25) const {
-      if (matchables_query_.empty() || _added_identifiers_train.empty()) {
-        return;
-      }
-
-      // ds prepare match vector map for all ids in the tree
-      matches_.clear();
-      for (const uint64_t identifier_tree : _added_identifiers_train) {
-        matches_.insert(std::make_pair(identifier_tree, MatchVector()));
-
-        // ds preallocate space to speed up match addition
-        matches_.at(identifier_tree).reserve(matchables_query_.size());
-      }
+      _match(matchables_query_, matches_, maximum_distance_matching_, false);
+    }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds obtain best matches in the current leaf via brute-force search
-            std::map<uint64_t, Match> best_matches;
-            _matchExhaustive(
-              matchable_query, node_current->matchables, maximum_distance_matching_, best_matches);
+    //! @brief budgeted multi-probe knn multi-matching function: besides the leaf of the query path,
+    //! the sibling subtrees along the way are scanned best-first by the number of split bits on
+    //! their path disagreeing with the query (a lower bound on the distance to all descriptors
+    //! they contain) until the budget is spent - recovers matches lost to flipped split bits
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains all available matches for all
+    //! training images added to the tree
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] budget_ maximum number of leafs and descriptor comparisons per query matchable
+    void matchMultiProbe(const MatchableVector& matchables_query_,
+                         MatchVectorMap& matches_,
+                         const uint32_t& maximum_distance_matching_ = 25,
+                         const ProbeBudget& budget_                 = ProbeBudget(8)) const {
+      _match(matchables_query_, matches_, maximum_distance_matching_, false, budget_);
+    }
 
-            // ds register all matches in the output structure
-            for (const std::pair<uint64_t, Match> best_match : best_matches) {
-              matches_.at(best_match.first).push_back(best_match.second);
-            }
-            break;
-          }
-        }
-      }
+    //! @brief knn multi-matching function for images with at least one match
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains all available matches for the
+    //! training images that received matches (no entries for other images)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] maximum_number_of_images_ only the images with the most matches are kept (0: all)
+    void matchSparse(const MatchableVector& matchables_query_,
+                     MatchVectorMap& matches_,
+                     const uint32_t& maximum_distance_matching_ = 25,
+                     const size_t& maximum_number_of_images_   = 0) const {
+      matches_.clear();
+      _match(matchables_query_, matches_, maximum_distance_matching_, true);
+      keepBestImages(matches_, maximum_number_of_images_);
     }
 
     //! @brief incrementally grows the tree
@@ -545,13 +752,15 @@ namespace srrg_hbst {
 
       // ds prepare bookkeeping for training
       assert(matchables_.front()->_image_identifier == matchables_.back()->_image_identifier);
-      _added_identifiers_train.insert(matchables_.front()->_image_identifier);
+      _insertIdentifier(matchables_.front()->_image_identifier);
+      _publishIdentifiers();
       ++_header.number_of_training_entries;
       _matchables_to_train.insert(
         _matchables_to_train.end(), matchables_.begin(), matchables_.end());
 
       // ds train based on set matchables (no effect for do SplittingStrategy::DoNothing)
       train(train_mode_);
+      _applyRetention();
     }
 
     //! @brief train tree with current _trainable_matchables according to selected mode
@@ -561,39 +770,41 @@ namespace srrg_hbst {
         return;
       }
       _header.number_of_matchables_uncompressed += _matchables_to_train.size();
+      const RandomNumberGeneratorScope random_number_generator_scope(
+        _random_number_generator.get());
 
       // ds check if we have to build an initial tree first (no training afterwards)
       if (!_root) {
-        _root = new Node(_matchables_to_train, train_mode_);
+        _root = _buildTree(_matchables_to_train, Descriptor().set(), train_mode_);
+        _attachImageSlots();
         assert(_matchables.empty());
         _matchables.insert(
           _matchables.end(), _matchables_to_train.begin(), _matchables_to_train.end());
+        _indexMatchables(_matchables_to_train);
         _header.number_of_matchables_compressed = _matchables_to_train.size();
         _matchables_to_train.clear();
         return;
       }
 
-      // ds if random splitting is chosen
-      if (train_mode_ == SplittingStrategy::SplitRandomUniform) {
+      // ds if random splitting is chosen (without an own generator of this tree)
+      if (train_mode_ == SplittingStrategy::SplitRandomUniform && !_random_number_generator) {
         // ds initialize random number generator with new seed
         std::random_device random_device;
         Node::random_number_generator = std::mt19937(random_device());
       }
 
-      // ds nodes to update after the addition of matchables to leafs
-      std::set<Node*> leafs_to_update;
-
-#ifdef SRRG_MERGE_DESCRIPTORS
-      // ds we need delayed insertion as we continuously scan the current references for merging
+      // ds insertion is delayed as we continuously scan the current references for merging (and
+      // ds leafs are filled concurrently or copied for concurrent readers)
       _trainables.resize(_matchables_to_train.size());
+      std::set<Node*> leafs_merged;
 
+#ifdef SRRG_MERGE_DESCRIPTORS
       // ds matches to merge (descriptor distance == SRRG_MERGE_DESCRIPTORS)
       _merged_matchables.clear();
       _merged_matchables.reserve(_matchables_to_train.size());
 
       // ds currently we allow merging maximally once per reference matchable
       std::set<const Matchable*> merged_reference_matchables;
-#endif
 
       // ds for each new descriptor - buffering new matchables and merging identical ones
       uint64_t index_new_matchable = 0;
@@ -611,26 +822,33 @@ namespace srrg_hbst {
             }
           } else {
             // ds we arrived in a leaf
-#ifdef SRRG_MERGE_DESCRIPTORS
             bool insertion_required = true;
 
             // ds if we can absorb this matchable instead of having to insert it
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              // ds if merge distance is satisfied
-              // ds and this reference has not absorbed a matchable already in this call
-              if (matchable_reference->distance(matchable_to_insert) <=
-                    maximum_distance_for_merge &&
-                  merged_reference_matchables.count(matchable_reference) == 0) {
-                assert(matchable_reference != matchable_to_insert);
-                assert(matchable_to_insert->objects.size() == 1);
-                _merged_matchables.emplace_back(
-                  MatchableMerge(matchable_to_insert,
-                                 std::move(matchable_to_insert->_object),
-                                 const_cast<Matchable*>(matchable_reference)));
-                merged_reference_matchables.insert(matchable_reference);
-                insertion_required = false;
-                break;
-              }
+            // ds if merge distance is satisfied (merging modifies shared references and is
+            // ds therefore disabled for concurrent reading)
+            if (!_concurrent_reading) {
+              node_current->scan(
+                matchable_to_insert->descriptor,
+                maximum_distance_for_merge + 1,
+                [&](const uint32_t& index_reference, const uint32_t& /*distance*/) {
+                  Matchable* matchable_reference = node_current->matchables[index_reference];
+
+                  // ds and this reference has not absorbed a matchable already in this call
+                  if (merged_reference_matchables.count(matchable_reference) == 0) {
+                    assert(matchable_reference != matchable_to_insert);
+                    assert(matchable_to_insert->objects.size() == 1);
+                    _merged_matchables.emplace_back(
+                      MatchableMerge(matchable_to_insert,
+                                     matchable_to_insert->objects.begin()->second,
+                                     matchable_reference));
+                    merged_reference_matchables.insert(matchable_reference);
+                    node_current->_addSetBitCounts(matchable_reference);
+                    insertion_required = false;
+                    return false;
+                  }
+                  return true;
+                });
             }
 
             // ds if insertion is required - we could not merge the query matchable
@@ -641,22 +859,16 @@ namespace srrg_hbst {
               _trainables[index_new_matchable].matchable = matchable_to_insert;
               _matchables_to_train[index_new_matchable]  = matchable_to_insert;
               ++index_new_matchable;
+            } else {
+              // ds leaf always needs to be updated, merged or not
+              ++node_current->_header.number_of_matchables_uncompressed;
+              leafs_merged.insert(node_current);
             }
-#else
-            // ds we can place the descriptor in the leaf on the spot
-            node_current->matchables.push_back(matchable_to_insert);
-            _matchables_to_train[index_new_matchable] = matchable_to_insert;
-            ++index_new_matchable;
-#endif
-            // ds leaf always needs to be updated, merged or not
-            ++node_current->_header.number_of_matchables_uncompressed;
-            leafs_to_update.insert(node_current);
             break;
           }
         }
       }
       _matchables_to_train.resize(index_new_matchable);
-#ifdef SRRG_MERGE_DESCRIPTORS
 
       // ds merge matchables
       for (MatchableMerge& mergable : _merged_matchables) {
@@ -664,28 +876,48 @@ namespace srrg_hbst {
 
         // ds perform merge
         mergable.reference->mergeSingle(mergable.query);
+        _matchables_per_image[mergable.query->_image_identifier].push_back(mergable.reference);
 
         // ds free query (!) recall that the tree takes ownership of the matchables
-        delete mergable.query;
+        _freeMatchable(mergable.query);
       }
       _number_of_merged_matchables_last_training = _merged_matchables.size();
       _merged_matchables.clear();
-
-      // ds insert matchables into nodes
       _trainables.resize(index_new_matchable);
-      assert(_matchables_to_train.size() == _trainables.size());
-      for (const Trainable& trainable : _trainables) {
-        trainable.node->matchables.push_back(trainable.matchable);
-      }
+#else
+      // ds find the leaf for each new descriptor (in parallel ranges if a thread pool is set) -
+      // ds the tree structure is not modified before all leafs are known
+      _forEachIndex(
+        _matchables_to_train.size(),
+        _getNumberOfQueryRanges(_matchables_to_train.size()),
+        [this](const size_t& /*index_range*/, const size_t& index_matchable) {
+          Matchable* matchable_to_insert = _matchables_to_train[index_matchable];
+
+          // ds traverse tree to find a leaf for this descriptor
+          Node* node_current = _root;
+          while (node_current->has_leafs) {
+            // ds check the split bit and traverse the tree
+            if (matchable_to_insert->descriptor[node_current->index_split_bit]) {
+              node_current = node_current->right;
+            } else {
+              node_current = node_current->left;
+            }
+          }
+
+          // ds bookkeep matchable for addition
+          _trainables[index_matchable].node      = node_current;
+          _trainables[index_matchable].matchable = matchable_to_insert;
+        });
 #endif
-      // ds check splits for touched leafs
-      for (Node* leaf : leafs_to_update) {
-        leaf->spawnLeafs(train_mode_);
-      }
+
+      // ds insert matchables into nodes and check splits for touched leafs
+      assert(_matchables_to_train.size() == _trainables.size());
+      _integrateTrainables(train_mode_, leafs_merged);
 
       // ds bookkeeping
       _matchables.insert(
         _matchables.end(), _matchables_to_train.begin(), _matchables_to_train.end());
+      _indexMatchables(_matchables_to_train);
       _header.number_of_matchables_compressed += _matchables_to_train.size();
       _matchables_to_train.clear();
     }
@@ -701,140 +933,164 @@ namespace srrg_hbst {
                      MatchVectorMap& matches_,
                      const uint32_t maximum_distance_matching_ = 25,
                      const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
-      if (matchables_.empty()) {
-        return;
-      }
-      const uint64_t identifier_image_query = matchables_.front()->_image_identifier;
-
-      // ds check if we have to build an initial tree first
-      if (!_root) {
-        _root = new Node(matchables_);
-        assert(_matchables.empty());
-        _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
-        _header.number_of_matchables_compressed = matchables_.size();
-        _added_identifiers_train.insert(identifier_image_query);
-        assert(_added_identifiers_train.size() == 1);
-        _header.number_of_training_entries = 1;
-        return;
-      }
+      _matchAndAdd(matchables_, matches_, maximum_distance_matching_, train_mode_, false);
+      _applyRetention();
+    }
 
-      // ds prepare match vector map for all ids in the tree
+    //! @brief sparse variant of matchAndAdd: matches_ only contains the images with matches
+    //! @param[in] maximum_number_of_images_ only the images with the most matches are kept (0: all)
+    void matchAndAddSparse(const MatchableVector& matchables_,
+                           MatchVectorMap& matches_,
+                           const uint32_t maximum_distance_matching_ = 25,
+                           const size_t& maximum_number_of_images_   = 0,
+                           const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
       matches_.clear();
-      for (const uint64_t identifier_tree : _added_identifiers_train) {
-        matches_.insert(std::make_pair(identifier_tree, MatchVector()));
+      _matchAndAdd(matchables_, matches_, maximum_distance_matching_, train_mode_, true);
+      _applyRetention();
+      keepBestImages(matches_, maximum_number_of_images_);
+    }
 
-        // ds preallocate space to speed up match addition
-        matches_.at(identifier_tree).reserve(matchables_.size());
+    //! @brief reduces matches_ to the maximum_number_of_images_ images with the most matches
+    //! (ties are resolved in favor of lower image identifiers)
+    static void keepBestImages(MatchVectorMap& matches_, const size_t& maximum_number_of_images_) {
+      if (maximum_number_of_images_ == 0 || matches_.size() <= maximum_number_of_images_) {
+        return;
       }
+      std::vector<std::pair<size_t, uint64_t>> images;
+      images.reserve(matches_.size());
+      for (const typename MatchVectorMap::value_type& matches_per_image : matches_) {
+        images.emplace_back(matches_per_image.second.size(), matches_per_image.first);
+      }
+      std::nth_element(images.begin(),
+                       images.begin() + maximum_number_of_images_,
+                       images.end(),
+                       [](const std::pair<size_t, uint64_t>& a_,
+                          const std::pair<size_t, uint64_t>& b_) {
+                         return a_.first > b_.first ||
+                                (a_.first == b_.first && a_.second < b_.second);
+                       });
+      for (size_t index = maximum_number_of_images_; index < images.size(); ++index) {
+        matches_.erase(images[index].second);
+      }
+    }
 
-      // ds prepare node/matchable list to integrate
-      _trainables.resize(matchables_.size());
-      std::set<Node*> leafs_to_update;
-
-#ifdef SRRG_MERGE_DESCRIPTORS
-      // ds matches to merge (descriptor distance == SRRG_MERGE_DESCRIPTORS)
-      _merged_matchables.clear();
-      _merged_matchables.reserve(matchables_.size());
-
-      // ds currently we allow merging maximally once per reference matchable
-      std::set<const Matchable*> merged_reference_matchables;
-#endif
-
-      // ds for each descriptor
-      uint64_t index_trainable = 0;
-      for (Matchable* matchable_query : matchables_) {
-        // ds traverse tree to find this descriptor
-        Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
+    //! @brief removes an image from the tree: its matchables are deleted from their leafs (merged
+    //! matchables only lose the object of the image) and sibling leafs that drop below
+    //! maximum_leaf_size are collapsed into their parent - the cost is proportional to the number
+    //! of removed matchables (amortized, the tree owns and frees the removed matchables)
+    //! @param[in] image_identifier_ image to remove
+    //! @return true if the image was contained in the tree
+    //! @throws std::runtime_error if concurrent reading is enabled
+    bool remove(const uint64_t& image_identifier_) {
+      if (_concurrent_reading) {
+        throw std::runtime_error(
+          "BinaryTree::remove|ERROR: removal is not available for concurrent reading");
+      }
+      if (!_eraseIdentifier(image_identifier_)) {
+        return false;
+      }
+      _publishIdentifiers();
+      --_header.number_of_training_entries;
+
+      // ds matchables added without training are not contained in the tree yet
+      size_t number_of_matchables_to_train = 0;
+      for (Matchable* matchable : _matchables_to_train) {
+        if (matchable->_image_identifier == image_identifier_) {
+          _freeMatchable(matchable);
+        } else {
+          _matchables_to_train[number_of_matchables_to_train] = matchable;
+          ++number_of_matchables_to_train;
+        }
+      }
+      _matchables_to_train.resize(number_of_matchables_to_train);
+
+      // ds remove the matchables of the image from their leafs (leafs are processed as a whole)
+      typename std::unordered_map<uint64_t, MatchableVector>::iterator iterator =
+        _matchables_per_image.find(image_identifier_);
+      if (iterator != _matchables_per_image.end()) {
+        std::map<Node*, std::set<const Matchable*>> matchables_per_leaf;
+        for (Matchable* matchable : iterator->second) {
+          Node* leaf = _root;
+          while (leaf->has_leafs) {
+            if (matchable->descriptor[leaf->index_split_bit]) {
+              leaf = leaf->right;
             } else {
-              node_current = node_current->left;
+              leaf = leaf->left;
             }
-          } else {
-            // ds obtain best matches in the current leaf via brute-force search - bookkeeping
-            // matches to merge (distance == 0)
-            std::map<uint64_t, Match> best_matches;
+          }
+          --_header.number_of_matchables_uncompressed;
 #ifdef SRRG_MERGE_DESCRIPTORS
-            Matchable* matchable_reference = nullptr;
-            _matchExhaustive(matchable_query,
-                             node_current->matchables,
-                             maximum_distance_matching_,
-                             best_matches,
-                             matchable_reference);
-#else
-            _matchExhaustive(
-              matchable_query, node_current->matchables, maximum_distance_matching_, best_matches);
+          // ds merged matchables stay in the tree for their other images
+          if (matchable->objects.size() > 1) {
+            leaf->_removeObject(matchable, image_identifier_);
+            continue;
+          }
 #endif
+          matchables_per_leaf[leaf].insert(matchable);
+          _matchables_removed.push_back(matchable);
+        }
+        _matchables_per_image.erase(iterator);
+
+        // ds parents of the touched leafs, deepest first
+        std::set<std::pair<uint64_t, Node*>, std::greater<std::pair<uint64_t, Node*>>> parents;
+        for (const std::pair<Node* const, std::set<const Matchable*>>& leaf : matchables_per_leaf) {
+          leaf.first->_removeMatchables(leaf.second);
+          _header.number_of_matchables_compressed -= leaf.second.size();
+          if (leaf.first->parent) {
+            parents.insert(std::make_pair(leaf.first->parent->_header.depth, leaf.first->parent));
+          }
+        }
 
-            // ds register all matches in the output structure
-            for (const std::pair<uint64_t, Match> best_match : best_matches) {
-              matches_.at(best_match.first).push_back(best_match.second);
-            }
+        // ds collapse sibling leafs that together fall below the split threshold - bottom up, so
+        // ds a parent is only evaluated after all of its touched descendants
+        while (!parents.empty()) {
+          Node* parent = parents.begin()->second;
+          parents.erase(parents.begin());
+          const Node* leaf_zeros = parent->left;
+          const Node* leaf_ones  = parent->right;
+          if (leaf_zeros->has_leafs || leaf_ones->has_leafs ||
+              leaf_zeros->_header.number_of_matchables_uncompressed +
+                  leaf_ones->_header.number_of_matchables_uncompressed >=
+                Node::maximum_leaf_size) {
+            continue;
+          }
+          parent->_collapseLeafs();
+          if (parent->parent) {
+            parents.insert(std::make_pair(parent->parent->_header.depth, parent->parent));
+          }
+        }
+      }
 
-#ifdef SRRG_MERGE_DESCRIPTORS
-            // ds if we can merge the query matchable into the reference
-            if (matchable_reference &&
-                merged_reference_matchables.count(matchable_reference) == 0) {
-              assert(matchable_query->objects.size() == 1);
+      // ds an emptied tree is rebuilt from scratch on the next insertion
+      if (_added_identifiers_train.empty()) {
+        delete _root;
+        _root = nullptr;
+        _header.number_of_matchables_uncompressed = 0;
+        _header.number_of_matchables_compressed   = 0;
+      }
 
-              // ds bookkeep matchable for merge
-              _merged_matchables.emplace_back(MatchableMerge(
-                matchable_query, std::move(matchable_query->_object), matchable_reference));
-              merged_reference_matchables.insert(matchable_reference);
-            } else {
-#endif
-              // ds bookkeep matchable for addition
-              _trainables[index_trainable].node      = node_current;
-              _trainables[index_trainable].matchable = matchable_query;
-              ++index_trainable;
-#ifdef SRRG_MERGE_DESCRIPTORS
-            }
-#endif
-
-            // ds leaf needs to be updated, merged or not
-            ++node_current->_header.number_of_matchables_uncompressed;
-            leafs_to_update.insert(node_current);
-            break;
-          }
-        }
-      }
-      _trainables.resize(index_trainable);
-#ifdef SRRG_MERGE_DESCRIPTORS
-
-      // ds merge matchables
-      for (MatchableMerge& mergable : _merged_matchables) {
-        assert(mergable.reference != mergable.query);
-
-        // ds perform merge
-        mergable.reference->mergeSingle(mergable.query);
-
-        // ds free query (!) recall that the tree takes ownership of the matchables
-        delete mergable.query;
+      // ds free removed matchables once they make up half of the bookkeeping
+      if (_added_identifiers_train.empty() || 2 * _matchables_removed.size() > _matchables.size()) {
+        _compactMatchables();
       }
-      _number_of_merged_matchables_last_training = _merged_matchables.size();
-      _merged_matchables.clear();
-#endif
+      return true;
+    }
 
-      // ds integrate new matchables: merge, add and spawn leaves if requested
-      MatchableVector new_matchables;
-      new_matchables.reserve(_trainables.size());
-      for (const Trainable& trainable : _trainables) {
-        trainable.node->matchables.push_back(trainable.matchable);
-        new_matchables.emplace_back(trainable.matchable);
+    //! @brief sliding window retention: after each insertion (add, matchAndAdd) the oldest images
+    //! are removed (see remove) until the window bounds are satisfied
+    //! @param[in] maximum_number_of_images_ maximum number of images in the tree (0: unbounded)
+    //! @param[in] maximum_identifier_age_ maximum image identifier difference to the latest image,
+    //! e.g. for timestamps or frame numbers as identifiers (0: unbounded)
+    //! @throws std::runtime_error if concurrent reading is enabled (removal is not available)
+    void setRetention(const size_t& maximum_number_of_images_,
+                      const uint64_t& maximum_identifier_age_ = 0) {
+      if (_concurrent_reading && (maximum_number_of_images_ > 0 || maximum_identifier_age_ > 0)) {
+        throw std::runtime_error(
+          "BinaryTree::setRetention|ERROR: retention is not available for concurrent reading");
       }
-      for (Node* leaf : leafs_to_update) {
-        leaf->spawnLeafs(train_mode_);
-      }
-
-      // ds insert new matchables and identifier
-      _matchables.insert(_matchables.end(), new_matchables.begin(), new_matchables.end());
-      _header.number_of_matchables_compressed += new_matchables.size();
-      _added_identifiers_train.insert(identifier_image_query);
-      ++_header.number_of_training_entries;
+      _maximum_number_of_images = maximum_number_of_images_;
+      _maximum_identifier_age   = maximum_identifier_age_;
+      _applyRetention();
     }
 
 #ifdef SRRG_HBST_HAS_OPENCV
@@ -855,14 +1111,101 @@ namespace srrg_hbst {
       return matchables;
     }
 
+    //! @brief creates a matchable vector from opencv descriptors in the matchable pool of this
+    //! tree - all matchables of the image are contiguous in memory and owned by the tree
+    const MatchableVector allocateMatchables(const cv::Mat& descriptors_cv_,
+                                             const std::vector<ObjectType>& objects_,
+                                             const uint64_t& identifier_tree_ = 0) {
+      MatchableVector matchables(descriptors_cv_.rows);
+      _matchable_pool.reserve(descriptors_cv_.rows);
+
+      // ds copy raw data
+      for (int64_t index_descriptor = 0; index_descriptor < descriptors_cv_.rows;
+           ++index_descriptor) {
+        matchables[index_descriptor] = _matchable_pool.create(
+          objects_[index_descriptor], descriptors_cv_.row(index_descriptor), identifier_tree_);
+      }
+      return matchables;
+    }
+
 #endif
 
+    //! @brief constructs a single matchable in the matchable pool of this tree (which owns it)
+    //! @param[in] arguments_ matchable constructor arguments
+    template <typename... Arguments_>
+    Matchable* allocateMatchable(Arguments_&&... arguments_) {
+      return _matchable_pool.create(std::forward<Arguments_>(arguments_)...);
+    }
+
+    //! @brief keeps the next number_of_matchables_ pool allocations contiguous (e.g. one image)
+    void reserveMatchables(const size_t& number_of_matchables_) {
+      _matchable_pool.reserve(number_of_matchables_);
+    }
+
+    //! @brief enables parallel batch queries: the const matching functions (match, matchLazy,
+    //! matchSparse, getNumberOfMatches, getScorePerImage) split the query matchables into ranges
+    //! processed on the pool - results are identical to serial processing. Training (add, train,
+    //! matchAndAdd) fills and splits the touched leafs concurrently, where train also descends
+    //! the tree for all new matchables in parallel and builds the initial tree as a bulk build
+    //! (see bulk_build_depth)
+    //! @param[in] thread_pool_ shared thread pool (nullptr for serial processing)
+    void setThreadPool(std::shared_ptr<ThreadPool> thread_pool_) {
+      _thread_pool = thread_pool_;
+    }
+
+    //! @brief thread pool used for batch queries (nullptr if serial)
+    std::shared_ptr<ThreadPool> getThreadPool() const {
+      return _thread_pool;
+    }
+
+    //! @brief gives this tree its own generator for random splitting, seeded from the node
+    //! generator (see Node::seedRandomNumberGenerator): training keeps drawing from it instead of
+    //! reseeding the node generator from std::random_device, hence the splits are reproducible
+    //! (e.g. for the trees of a forest)
+    void forkRandomNumberGenerator() {
+      _random_number_generator.reset(new std::mt19937(Node::random_number_generator()));
+    }
+
+    //! @brief enables concurrent reading: the const matching functions may be called from any
+    //! number of threads while a single thread modifies the tree (add, train, matchAndAdd) - the
+    //! writer publishes updated leaf copies instead of modifying leafs in place and matchable
+    //! merging is disabled (clear, read and toggling the mode require that no reader is active)
+    //! @param[in] enabled_
+    //! @throws std::runtime_error if enabled while a retention is set (removal is not available)
+    void setConcurrentReading(const bool& enabled_) {
+      if (_concurrent_reading == enabled_) {
+        return;
+      }
+      if (enabled_ && (_maximum_number_of_images > 0 || _maximum_identifier_age > 0)) {
+        throw std::runtime_error(
+          "BinaryTree::setConcurrentReading|ERROR: concurrent reading is not available with "
+          "retention");
+      }
+      _concurrent_reading = enabled_;
+      if (_concurrent_reading) {
+        _publishIdentifiers();
+      } else {
+        delete _identifiers_snapshot.exchange(nullptr);
+        _reclaimer.clear();
+      }
+    }
+
+    //! @brief true if concurrent reading is enabled
+    const bool& concurrentReading() const {
+      return _concurrent_reading;
+    }
+
+    //! @brief matchable pool (arena) of this tree
+    const MatchablePool& getMatchablePool() const {
+      return _matchable_pool;
+    }
+
     //! @brief clears complete structure (corresponds to empty construction)
     void clear(const bool& delete_matchables_ = true) {
       // ds database identifier is not reset
 
       // ds clean internal bookkeeping
-      _added_identifiers_train.clear();
+      _clearIdentifiers();
       _trainables.clear();
       _header.number_of_matchables_uncompressed = 0;
       _header.number_of_matchables_compressed   = 0;
@@ -874,23 +1217,42 @@ namespace srrg_hbst {
       // ds recursively delete all nodes
       delete _root;
       _root = nullptr;
+      _publishIdentifiers();
+      _reclaimer.clear();
 
-      // ds ownership dependent
+      // ds ownership dependent (removed matchables are still contained in _matchables)
       if (delete_matchables_) {
         deleteMatchables();
       }
       _matchables.clear();
       _matchables_to_train.clear();
+      _matchables_per_image.clear();
+      _matchables_removed.clear();
     }
 
-    //! @brief free all matchables contained in the tree (destructor)
+    //! @brief free all matchables contained in the tree (destructor) - pool allocated matchables
+    //! are released in bulk
     void deleteMatchables() {
-      for (const Matchable* matchable : _matchables) {
-        delete matchable;
-      }
-      for (const Matchable* matchable : _matchables_to_train) {
-        delete matchable;
+      if (_matchable_pool.size() == 0) {
+        for (const Matchable* matchable : _matchables) {
+          delete matchable;
+        }
+        for (const Matchable* matchable : _matchables_to_train) {
+          delete matchable;
+        }
+      } else {
+        for (const Matchable* matchable : _matchables) {
+          if (!_matchable_pool.owns(matchable)) {
+            delete matchable;
+          }
+        }
+        for (const Matchable* matchable : _matchables_to_train) {
+          if (!_matchable_pool.owns(matchable)) {
+            delete matchable;
+          }
+        }
       }
+      _matchable_pool.clear();
     }
 
     //! ds save complete database to disk
@@ -911,7 +1273,14 @@ namespace srrg_hbst {
       uint64_t number_of_matchables = 0;
       std::vector<const Node*> leafs;
       _getLeafs(_root, number_of_leafs, number_of_matchables, leafs);
-      assert(number_of_matchables == _matchables.size());
+      assert(number_of_matchables == _matchables.size() - _matchables_removed.size());
+
+      // ds leafs emptied by removals are not stored (read restores them as empty leafs)
+      leafs.erase(std::remove_if(leafs.begin(),
+                                 leafs.end(),
+                                 [](const Node* leaf_) { return leaf_->matchables.empty(); }),
+                  leafs.end());
+      number_of_leafs = leafs.size();
 
       // ds set endianness byte flag - when reading we will check for zero value
       const char endianness_check[] = {char(0)};
@@ -971,12 +1340,12 @@ namespace srrg_hbst {
                      reinterpret_cast<const char*>(&matchable->descriptor),
                      Matchable::raw_descriptor_size_bytes,
                      "BinaryTree::write|ERROR: unable to write descriptor data");
+          const uint64_t number_of_objects = matchable->objects.size();
           GUARDED_IO(outfile,
                      write,
-                     reinterpret_cast<const char*>(&matchable->number_of_objects),
+                     reinterpret_cast<const char*>(&number_of_objects),
                      sizeof(uint64_t),
                      "BinaryTree::write|ERROR: unable to write number of objects");
-          assert(matchable->number_of_objects == matchable->objects.size());
           for (const ObjectMapElement& element : matchable->objects) {
             GUARDED_IO(outfile,
                        write,
@@ -995,6 +1364,47 @@ namespace srrg_hbst {
       return true;
     }
 
+    //! @brief saves the database in the memory mappable format (see MappedHeader), which is
+    //! queried in place by BinaryTreeMapped without reading or allocating any matchables
+    //! @param[in] file_path
+    //! @returns false if the file could not be written
+    bool writeMapped(const std::string& file_path) const {
+      // ds open file (overwriting existing)
+      std::ofstream outfile(file_path, std::ios::binary | std::ios::out);
+      if (!outfile.is_open()) {
+        std::cerr << "BinaryTree::writeMapped|ERROR: unable to open file: " << file_path
+                  << std::endl;
+        return false;
+      }
+
+      // ds the file is an exact copy of the frozen image
+      std::vector<uint64_t> image;
+      const uint64_t number_of_bytes = _serializeMapped(image);
+      GUARDED_IO(outfile,
+                 write,
+                 reinterpret_cast<const char*>(image.data()),
+                 static_cast<std::streamsize>(number_of_bytes),
+                 "BinaryTree::writeMapped|ERROR: unable to write database");
+      outfile.close();
+      return true;
+    }
+
+    //! @brief converts the trained tree into an immutable, pointer-free database in memory: inner
+    //! nodes hold only their split bit and the offset of their child pair, leafs reference
+    //! contiguous descriptor blocks (same layout as writeMapped, no file involved). The tree is
+    //! not modified and can be cleared afterwards, e.g. once mapping is finished and only
+    //! localization queries follow
+    //! @returns frozen database (answers match, getNumberOfMatches and getScorePerImage)
+    std::unique_ptr<Mapped> freeze() const {
+      std::vector<uint64_t> image;
+      _serializeMapped(image);
+      std::unique_ptr<Mapped> database(new Mapped());
+      if (!database->open(std::move(image))) {
+        throw std::runtime_error("BinaryTree::freeze|ERROR: invalid frozen image");
+      }
+      return database;
+    }
+
     //! ds load database from disk
     bool read(const std::string& file_path) {
       // ds open file for reading
@@ -1024,9 +1434,10 @@ namespace srrg_hbst {
       for (size_t i = 0; i < _header.number_of_training_entries; ++i) {
         uint64_t identifier = 0;
         GUARDED_IO(infile, read, reinterpret_cast<char*>(&identifier), sizeof(identifier), "");
-        _added_identifiers_train.insert(identifier);
+        _insertIdentifier(identifier);
       }
       assert(_added_identifiers_train.size() == _header.number_of_training_entries);
+      _publishIdentifiers();
 
       // ds leaf buffer (static to allow easy escapes without requiring deallocation)
       // ds TODO use more compact data structure(s)
@@ -1145,9 +1556,10 @@ namespace srrg_hbst {
             // ds populate matchables of the leaf
             assert(current->matchables.empty());
             current->matchables.reserve(descriptors.size());
+            _matchable_pool.reserve(descriptors.size());
             for (size_t index_descriptor = 0; index_descriptor < descriptors.size();
                  ++index_descriptor) {
-              current->matchables.emplace_back(new Matchable(
+              current->_addMatchable(_matchable_pool.create(
                 objects_per_descriptor[index_descriptor], descriptors[index_descriptor]));
             }
             current->_header = std::move(leaf_header);
@@ -1167,14 +1579,16 @@ namespace srrg_hbst {
 
           // ds spawn leafs if necessary (we have a complete tree)
           if (!current->right) {
-            current->right                = new Node();
-            current->right->_header.depth = current->_header.depth + 1;
-            current->right->parent        = current;
+            Node* right          = new Node();
+            right->_header.depth = current->_header.depth + 1;
+            right->parent        = current;
+            current->right       = right;
           }
           if (!current->left) {
-            current->left                = new Node();
-            current->left->_header.depth = current->_header.depth + 1;
-            current->left->parent        = current;
+            Node* left          = new Node();
+            left->_header.depth = current->_header.depth + 1;
+            left->parent        = current;
+            current->left       = left;
           }
 
           // ds traverse tree
@@ -1193,219 +1607,829 @@ namespace srrg_hbst {
                   << std::endl;
         return false;
       }
+      _indexMatchables(_matchables);
+      _attachImageSlots();
       return true;
     }
 
     // ds helpers
   protected:
-#ifdef SRRG_MERGE_DESCRIPTORS
-    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
+    //! @brief knn multi-matching function
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] sparse_ if set, entries are only created for images with matches
+    //! @param[in] budget_ multi-probe budget per query matchable (default: query path only)
+    void _match(const MatchableVector& matchables_query_,
+                MatchVectorMap& matches_,
+                const uint32_t& maximum_distance_matching_,
+                const bool& sparse_,
+                const ProbeBudget& budget_ = ProbeBudget()) const {
+      if (matchables_query_.empty()) {
+        return;
+      }
+      const EpochReclaimer::Guard guard(_getReclaimer());
+      const std::set<uint64_t>& identifiers = _getIdentifiers();
+      if (identifiers.empty()) {
+        return;
+      }
+
+      // ds prepare match vector map for all ids in the tree (dense mode only)
+      matches_.clear();
+      if (!sparse_) {
+        for (const uint64_t identifier_tree : identifiers) {
+          matches_.insert(std::make_pair(identifier_tree, MatchVector()));
+
+          // ds preallocate space to speed up match addition
+          matches_.at(identifier_tree).reserve(matchables_query_.size());
+        }
+      }
+
+      // ds for each descriptor (in parallel ranges if a thread pool is set) - best match storage is
+      // reused for all query descriptors of a range
+      const size_t number_of_ranges = _getNumberOfQueryRanges(matchables_query_.size());
+      std::vector<MatchAccumulator> best_matches_per_range(
+        number_of_ranges, MatchAccumulator(identifiers.size()));
+      std::vector<MatchVectorMap> matches_per_range(number_of_ranges > 1 ? number_of_ranges : 0);
+      std::vector<std::vector<Probe>> probes_per_range(
+        budget_.maximum_number_of_leafs > 1 ? number_of_ranges : 0);
+      std::vector<QueryStatistics> statistics_per_range(number_of_ranges);
+      _forEachQuery(
+        matchables_query_,
+        number_of_ranges,
+        [&](const size_t& index_range, const Matchable* matchable_query) {
+          MatchAccumulator& best_matches = best_matches_per_range[index_range];
+          MatchVectorMap& matches =
+            number_of_ranges > 1 ? matches_per_range[index_range] : matches_;
+          QueryStatistics& statistics = statistics_per_range[index_range];
+          statistics.addQuery();
+
+          // ds multi-probe search: best matches over all leafs within the budget
+          if (budget_.maximum_number_of_leafs > 1) {
+            best_matches.reset();
+            _matchMultiProbe(matchable_query,
+                             maximum_distance_matching_,
+                             budget_,
+                             probes_per_range[index_range],
+                             best_matches,
+                             statistics);
+            for (size_t index = 0; index < best_matches.size(); ++index) {
+              matches[best_matches.identifier(index)].push_back(best_matches.match(index));
+            }
+            return;
+          }
+
+          // ds traverse tree to find this descriptor
+          const Node* node_current = _root;
+          while (node_current) {
+            // ds if this node has leaves (is splittable)
+            if (node_current->has_leafs) {
+              // ds check the split bit and go deeper
+              if (matchable_query->descriptor[node_current->index_split_bit]) {
+                node_current = node_current->right;
+              } else {
+                node_current = node_current->left;
+              }
+            } else {
+              // ds obtain best matches in the current leaf via brute-force search
+              best_matches.reset();
+              const LeafCounts counts = _matchExhaustive(
+                matchable_query, node_current, maximum_distance_matching_, best_matches);
+              statistics.addLeaf(node_current->getDepth() + 1,
+                                 node_current->getDepth(),
+                                 node_current->matchables.size(),
+                                 counts.number_of_comparisons,
+                                 counts.number_of_matches);
+
+              // ds register all matches in the output structure
+              for (size_t index = 0; index < best_matches.size(); ++index) {
+                matches[best_matches.identifier(index)].push_back(best_matches.match(index));
+              }
+              break;
+            }
+          }
+        });
+      _recordStatistics(statistics_per_range);
+
+      // ds merge range results in query order
+      for (const MatchVectorMap& matches : matches_per_range) {
+        for (const typename MatchVectorMap::value_type& matches_per_image : matches) {
+          MatchVector& matches_merged = matches_[matches_per_image.first];
+          matches_merged.insert(
+            matches_merged.end(), matches_per_image.second.begin(), matches_per_image.second.end());
+        }
+      }
+    }
+
+    //! @brief subtree queued for the multi-probe search
+    struct Probe {
+      Probe(const Node* node_, const uint32_t& number_of_disagreeing_bits_) :
+        node(node_),
+        number_of_disagreeing_bits(number_of_disagreeing_bits_) {
+      }
+
+      //! @brief heap order: fewest disagreeing split bits first, deeper subtrees on ties
+      bool operator<(const Probe& other_) const {
+        if (number_of_disagreeing_bits != other_.number_of_disagreeing_bits) {
+          return number_of_disagreeing_bits > other_.number_of_disagreeing_bits;
+        }
+        return node->getDepth() < other_.node->getDepth();
+      }
+      const Node* node;
+      uint32_t number_of_disagreeing_bits;
+    };
+
+    //! @brief retrieves best matches over the leaf of the query path and the closest sibling
+    //! subtrees (see matchMultiProbe)
     //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
     //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
+    //! @param[in] budget_ maximum number of leafs and descriptor comparisons
+    //! @param[in,out] probes_ probe queue storage (reused for all queries of a range)
+    //! @param[in,out] best_matches_ best match search storage (reset by the caller)
+    //! @param[in,out] statistics_ traversal counters
+    void _matchMultiProbe(const Matchable* matchable_query_,
                           const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_) const {
-      ObjectType object_query =
-        std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
+                          const ProbeBudget& budget_,
+                          std::vector<Probe>& probes_,
+                          MatchAccumulator& best_matches_,
+                          QueryStatistics& statistics_) const {
+      const Node* root = _root;
+      if (!root) {
+        return;
+      }
+      probes_.clear();
+      probes_.push_back(Probe(root, 0));
+      uint32_t number_of_leafs       = 0;
+      uint64_t number_of_comparisons = 0;
+      while (!probes_.empty()) {
+        std::pop_heap(probes_.begin(), probes_.end());
+        const Probe probe = probes_.back();
+        probes_.pop_back();
+
+        // ds follow the query bits to a leaf and queue the siblings along the way - siblings are
+        // skipped if their descriptors cannot lie within the matching distance
+        const Node* node_current                  = probe.node;
+        const uint32_t number_of_disagreeing_bits = probe.number_of_disagreeing_bits + 1;
+        uint64_t number_of_nodes                  = 1;
+        while (node_current->has_leafs) {
+          const bool bit = matchable_query_->descriptor[node_current->index_split_bit];
+          if (number_of_disagreeing_bits < maximum_distance_matching_) {
+            probes_.push_back(
+              Probe(bit ? node_current->left : node_current->right, number_of_disagreeing_bits));
+            std::push_heap(probes_.begin(), probes_.end());
+          }
+          node_current = bit ? node_current->right : node_current->left;
+          ++number_of_nodes;
+        }
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
+        // ds obtain best matches in the current leaf via brute-force search
+        const LeafCounts counts = _matchExhaustive(
+          matchable_query_, node_current, maximum_distance_matching_, best_matches_);
+        number_of_comparisons += counts.number_of_comparisons;
+        statistics_.addLeaf(number_of_nodes,
+                            node_current->getDepth(),
+                            node_current->matchables.size(),
+                            counts.number_of_comparisons,
+                            counts.number_of_matches);
+
+        // ds stop if the budget is spent
+        if (++number_of_leafs >= budget_.maximum_number_of_leafs ||
+            (budget_.maximum_number_of_comparisons > 0 &&
+             number_of_comparisons >= budget_.maximum_number_of_comparisons)) {
+          break;
+        }
+      }
+    }
 
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
-          // ds for every reference in this matchable
-          for (const ObjectMapElement& object : matchable_reference->objects) {
-            const uint64_t& identifer_tree_reference = object.first;
+    //! @brief matches and integrates matchables of a new image (see matchAndAdd)
+    //! @param[in] sparse_ if set, match entries are only created for images with matches
+    void _matchAndAdd(const MatchableVector& matchables_,
+                      MatchVectorMap& matches_,
+                      const uint32_t maximum_distance_matching_,
+                      const SplittingStrategy& train_mode_,
+                      const bool& sparse_) {
+      if (matchables_.empty()) {
+        return;
+      }
+      const uint64_t identifier_image_query = matchables_.front()->_image_identifier;
 
-            try {
-              // ds update match if current is better than the current best - will jump to addition
-              // if no best is available
-              Match& best_match_so_far              = best_matches_.at(identifer_tree_reference);
-              const real_type& best_distance_so_far = best_match_so_far.distance;
-              assert(best_distance_so_far >= 0);
-              if (distance < best_distance_so_far) {
-                assert(best_match_so_far.matchable_references.size() >= 1);
-                assert(best_match_so_far.object_references.size() >= 1);
-
-                // ds replace the best with this match on the spot - we don't have to update the
-                // query information
-                best_match_so_far.matchable_references =
-                  std::move(std::vector<const Matchable*>(1, matchable_reference));
-                best_match_so_far.object_references =
-                  std::move(std::vector<ObjectType>(1, object.second));
-                best_match_so_far.distance = distance;
-                assert(best_match_so_far.matchable_references.size() == 1);
-                assert(best_match_so_far.object_references.size() == 1);
-              }
+      // ds check if we have to build an initial tree first
+      if (!_root) {
+        _insertIdentifier(identifier_image_query);
+        assert(_added_identifiers_train.size() == 1);
+        _publishIdentifiers();
+        _root = new Node(matchables_);
+        _attachImageSlots();
+        assert(_matchables.empty());
+        _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+        _indexMatchables(matchables_);
+        _header.number_of_matchables_compressed   = matchables_.size();
+        _header.number_of_matchables_uncompressed = matchables_.size();
+        _header.number_of_training_entries        = 1;
+        return;
+      }
 
-              // ds if the match is equal to the last (multiple candidates)
-              else if (distance == best_distance_so_far) {
-                // ds add the candidate - we don't have to update the distance since its the same as
-                // the best
-                best_match_so_far.matchable_references.push_back(matchable_reference);
-                best_match_so_far.object_references.push_back(object.second);
-                assert(best_match_so_far.matchable_references.size() > 1);
-                assert(best_match_so_far.object_references.size() > 1);
-              }
-            } catch (const std::out_of_range& /*exception*/) {
-              // ds add a new match
-              best_matches_.insert(std::make_pair(
-                identifer_tree_reference,
-                Match(
-                  matchable_query_, matchable_reference, object_query, object.second, distance)));
+      // ds prepare match vector map for all ids in the tree (dense mode only)
+      matches_.clear();
+      if (!sparse_) {
+        for (const uint64_t identifier_tree : _added_identifiers_train) {
+          matches_.insert(std::make_pair(identifier_tree, MatchVector()));
+
+          // ds preallocate space to speed up match addition
+          matches_.at(identifier_tree).reserve(matchables_.size());
+        }
+      }
+
+      // ds prepare node/matchable list to integrate (and leafs that only absorbed merges)
+      _trainables.resize(matchables_.size());
+      std::set<Node*> leafs_merged;
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+      // ds maximum_distance_for_merge must always be smaller than maximum_distance_matching_
+      assert(maximum_distance_for_merge < maximum_distance_matching_);
+
+      // ds matches to merge (descriptor distance == SRRG_MERGE_DESCRIPTORS)
+      _merged_matchables.clear();
+      _merged_matchables.reserve(matchables_.size());
+
+      // ds currently we allow merging maximally once per reference matchable
+      std::set<const Matchable*> merged_reference_matchables;
+#endif
+
+      // ds best match storage reused for all query descriptors
+      MatchAccumulator best_matches(_added_identifiers_train.size());
+      std::vector<QueryStatistics> statistics(1);
+
+      // ds for each descriptor
+      uint64_t index_trainable = 0;
+      for (Matchable* matchable_query : matchables_) {
+        statistics.front().addQuery();
+        // ds traverse tree to find this descriptor
+        Node* node_current = _root;
+        while (node_current) {
+          // ds if this node has leaves (is splittable)
+          if (node_current->has_leafs) {
+            // ds check the split bit and go deeper
+            if (matchable_query->descriptor[node_current->index_split_bit]) {
+              node_current = node_current->right;
+            } else {
+              node_current = node_current->left;
+            }
+          } else {
+            // ds obtain best matches in the current leaf via brute-force search - bookkeeping
+            // matches to merge (distance == 0)
+            best_matches.reset();
+#ifdef SRRG_MERGE_DESCRIPTORS
+            Matchable* matchable_reference = nullptr;
+            const LeafCounts counts        = _matchExhaustive(matchable_query,
+                                                       node_current,
+                                                       maximum_distance_matching_,
+                                                       best_matches,
+                                                       matchable_reference);
+#else
+            const LeafCounts counts = _matchExhaustive(
+              matchable_query, node_current, maximum_distance_matching_, best_matches);
+#endif
+            statistics.front().addLeaf(node_current->getDepth() + 1,
+                                       node_current->getDepth(),
+                                       node_current->matchables.size(),
+                                       counts.number_of_comparisons,
+                                       counts.number_of_matches);
+
+            // ds register all matches in the output structure
+            for (size_t index = 0; index < best_matches.size(); ++index) {
+              matches_[best_matches.identifier(index)].push_back(best_matches.match(index));
+            }
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+            // ds if we can merge the query matchable into the reference (merging modifies shared
+            // ds references and is therefore disabled for concurrent reading)
+            if (matchable_reference && !_concurrent_reading &&
+                merged_reference_matchables.count(matchable_reference) == 0) {
+              assert(matchable_query->objects.size() == 1);
+
+              // ds bookkeep matchable for merge
+              _merged_matchables.emplace_back(MatchableMerge(
+                matchable_query, matchable_query->objects.begin()->second, matchable_reference));
+              merged_reference_matchables.insert(matchable_reference);
+
+              // ds leaf needs to be updated, merged or not
+              ++node_current->_header.number_of_matchables_uncompressed;
+              node_current->_addSetBitCounts(matchable_reference);
+              leafs_merged.insert(node_current);
+            } else {
+#endif
+              // ds bookkeep matchable for addition
+              _trainables[index_trainable].node      = node_current;
+              _trainables[index_trainable].matchable = matchable_query;
+              ++index_trainable;
+#ifdef SRRG_MERGE_DESCRIPTORS
             }
+#endif
+            break;
+          }
+        }
+      }
+      _trainables.resize(index_trainable);
+      _recordStatistics(statistics);
+#ifdef SRRG_MERGE_DESCRIPTORS
+
+      // ds merge matchables
+      for (MatchableMerge& mergable : _merged_matchables) {
+        assert(mergable.reference != mergable.query);
+
+        // ds perform merge
+        mergable.reference->mergeSingle(mergable.query);
+        _matchables_per_image[mergable.query->_image_identifier].push_back(mergable.reference);
+
+        // ds free query (!) recall that the tree takes ownership of the matchables
+        _freeMatchable(mergable.query);
+      }
+      _number_of_merged_matchables_last_training = _merged_matchables.size();
+      _merged_matchables.clear();
+#endif
+
+      // ds the new image becomes visible to concurrent readers before its matchables
+      _insertIdentifier(identifier_image_query);
+      _publishIdentifiers();
+      ++_header.number_of_training_entries;
+
+      // ds integrate new matchables: add and spawn leaves if requested
+      _integrateTrainables(train_mode_, leafs_merged);
+
+      // ds insert new matchables
+      MatchableVector& matchables_image = _matchables_per_image[identifier_image_query];
+      for (const Trainable& trainable : _trainables) {
+        _matchables.emplace_back(trainable.matchable);
+        matchables_image.emplace_back(trainable.matchable);
+      }
+      _header.number_of_matchables_compressed += _trainables.size();
+      _header.number_of_matchables_uncompressed += matchables_.size();
+    }
+
+    //! @brief adds the current trainables to their leafs and spawns the touched leafs - with
+    //! concurrent reading enabled the leafs are not modified: updated copies replace them and the
+    //! old leafs are reclaimed once no reader can hold them anymore
+    //! @param[in] train_mode_ splitting strategy for the touched leafs
+    //! @param[in] leafs_merged_ additional leafs to update (absorbed merged matchables)
+    void _integrateTrainables(const SplittingStrategy& train_mode_,
+                              const std::set<Node*>& leafs_merged_) {
+      // ds leafs are filled and split in parallel if possible (random splitting draws from the
+      // ds shared generator and leaf copies are published one by one)
+      const size_t number_of_tasks = _getNumberOfQueryRanges(_trainables.size());
+      if (number_of_tasks > 1 && !_concurrent_reading &&
+          train_mode_ != SplittingStrategy::SplitRandomUniform) {
+        _integrateTrainablesParallel(train_mode_, leafs_merged_, number_of_tasks);
+        return;
+      }
+
+      // ds collect touched leafs in the order they are touched (not by address: random splitting
+      // ds draws from the generator leaf by leaf, hence the order must be reproducible)
+      std::vector<Node*> leafs_to_update(leafs_merged_.begin(), leafs_merged_.end());
+      std::set<Node*> leafs_touched(leafs_merged_);
+      for (const Trainable& trainable : _trainables) {
+        if (leafs_touched.insert(trainable.node).second) {
+          leafs_to_update.push_back(trainable.node);
+        }
+      }
+      if (!_concurrent_reading) {
+        for (const Trainable& trainable : _trainables) {
+          ++trainable.node->_header.number_of_matchables_uncompressed;
+          trainable.node->_addMatchable(trainable.matchable);
+        }
+        for (Node* leaf : leafs_to_update) {
+          leaf->spawnLeafs(train_mode_);
+        }
+        return;
+      }
+
+      // ds fill private copies of the touched leafs (in insertion order)
+      std::map<Node*, Node*> leaf_copies;
+      for (Node* leaf : leafs_to_update) {
+        leaf_copies.insert(std::make_pair(leaf, leaf->_copyLeaf()));
+      }
+      for (const Trainable& trainable : _trainables) {
+        Node* leaf_copy = leaf_copies.at(trainable.node);
+        ++leaf_copy->_header.number_of_matchables_uncompressed;
+        leaf_copy->_addMatchable(trainable.matchable);
+      }
+
+      // ds split the copies before publishing them in place of the old leafs
+      for (Node* leaf_old : leafs_to_update) {
+        Node* leaf_new = leaf_copies.at(leaf_old);
+        leaf_new->spawnLeafs(train_mode_);
+        if (!leaf_old->parent) {
+          _root = leaf_new;
+        } else if (leaf_old->parent->left == leaf_old) {
+          leaf_old->parent->left = leaf_new;
+        } else {
+          leaf_old->parent->right = leaf_new;
+        }
+        _reclaimer.retire(leaf_old);
+      }
+      _reclaimer.synchronize();
+    }
+
+    //! @brief builds a tree on matchables_: recursively without thread pool, otherwise the nodes
+    //! up to bulk_build_depth are split level by level (one task per node) and the subtrees below
+    //! are built as independent tasks - each task splits with its own generator, seeded in node
+    //! order from the shared one, so random splitting is reproducible for any number of threads
+    //! @param[in] matchables_ matchables of the root
+    //! @param[in] bit_mask_ bits available for splitting
+    //! @param[in] train_mode_ splitting strategy
+    //! @return root node (owned by the caller)
+    Node* _buildTree(const MatchableVector& matchables_,
+                     const Descriptor& bit_mask_,
+                     const SplittingStrategy& train_mode_) const {
+      if (!_thread_pool || train_mode_ == SplittingStrategy::DoNothing) {
+        return new Node(matchables_, bit_mask_, train_mode_);
+      }
+      Node* root = new Node(nullptr, 0, matchables_, bit_mask_);
+      std::vector<Node*> nodes(1, root);
+      std::vector<std::mt19937> random_number_generators;
+      for (uint32_t depth = 0; depth <= bulk_build_depth && !nodes.empty(); ++depth) {
+        const bool recursive = (depth == bulk_build_depth);
+        random_number_generators.clear();
+        for (size_t index = 0; index < nodes.size(); ++index) {
+          random_number_generators.emplace_back(Node::random_number_generator());
+        }
+        _thread_pool->run(nodes.size(), [&](const size_t& index_node) {
+          nodes[index_node]->_spawnLeafs(
+            train_mode_, random_number_generators[index_node], recursive);
+        });
+
+        // ds continue with the leafs spawned on this level
+        std::vector<Node*> leafs;
+        leafs.reserve(2 * nodes.size());
+        for (const Node* node : nodes) {
+          if (node->has_leafs) {
+            leafs.push_back(node->right);
+            leafs.push_back(node->left);
           }
         }
+        nodes.swap(leafs);
+      }
+      return root;
+    }
+
+    //! @brief parallel variant of _integrateTrainables: every leaf is owned by exactly one task,
+    //! which appends its trainables (in insertion order) and splits it - no locking required
+    void _integrateTrainablesParallel(const SplittingStrategy& train_mode_,
+                                      const std::set<Node*>& leafs_merged_,
+                                      const size_t& number_of_tasks_) {
+      const auto get_task = [&number_of_tasks_](const Node* leaf_) {
+        // ds fibonacci hashing to spread aligned addresses
+        const uint64_t address = reinterpret_cast<uintptr_t>(leaf_);
+        return static_cast<size_t>((address * 0x9E3779B97F4A7C15ULL) >> 32) % number_of_tasks_;
+      };
+
+      // ds stable bucketing of the trainables by owning task
+      std::vector<size_t> index_begin_per_task(number_of_tasks_ + 1, 0);
+      for (const Trainable& trainable : _trainables) {
+        ++index_begin_per_task[get_task(trainable.node) + 1];
+      }
+      std::partial_sum(
+        index_begin_per_task.begin(), index_begin_per_task.end(), index_begin_per_task.begin());
+      std::vector<size_t> index_next_per_task(index_begin_per_task.begin(),
+                                              index_begin_per_task.end() - 1);
+      std::vector<const Trainable*> trainables_per_task(_trainables.size());
+      for (const Trainable& trainable : _trainables) {
+        trainables_per_task[index_next_per_task[get_task(trainable.node)]++] = &trainable;
+      }
+
+      // ds fill and split the leafs of each task
+      _thread_pool->run(number_of_tasks_, [&](const size_t& index_task) {
+        std::set<Node*> leafs_to_update;
+        for (Node* leaf : leafs_merged_) {
+          if (get_task(leaf) == index_task) {
+            leafs_to_update.insert(leaf);
+          }
+        }
+        for (size_t index = index_begin_per_task[index_task];
+             index < index_begin_per_task[index_task + 1];
+             ++index) {
+          Node* leaf = trainables_per_task[index]->node;
+          ++leaf->_header.number_of_matchables_uncompressed;
+          leaf->_addMatchable(trainables_per_task[index]->matchable);
+          leafs_to_update.insert(leaf);
+        }
+        for (Node* leaf : leafs_to_update) {
+          leaf->spawnLeafs(train_mode_);
+        }
+      });
+    }
+
+    //! @brief registers a trained image identifier (insertion order and slot)
+    void _insertIdentifier(const uint64_t& identifier_) {
+      _identifiers_inserted.push_back(identifier_);
+      if (!_added_identifiers_train.insert(identifier_).second) {
+        return;
+      }
+      uint32_t slot = _image_slots.identifier_per_slot.size();
+      if (_image_slots.slots_free.empty()) {
+        _image_slots.identifier_per_slot.push_back(identifier_);
+      } else {
+        slot = _image_slots.slots_free.back();
+        _image_slots.slots_free.pop_back();
+        _image_slots.identifier_per_slot[slot] = identifier_;
+      }
+      _image_slots.slot_per_identifier.insert(std::make_pair(identifier_, slot));
+    }
+
+    //! @brief lets the leafs look up the image slots of this tree (after building a new root)
+    void _attachImageSlots() {
+      if (_root) {
+        _root.load()->_setSlotPerIdentifier(&_image_slots.slot_per_identifier);
+      }
+    }
+
+    //! @brief unregisters a trained image identifier, releasing its slot
+    //! @return false if the identifier was not registered
+    bool _eraseIdentifier(const uint64_t& identifier_) {
+      if (_added_identifiers_train.erase(identifier_) == 0) {
+        return false;
       }
+      typename std::unordered_map<uint64_t, uint32_t>::iterator iterator =
+        _image_slots.slot_per_identifier.find(identifier_);
+      _image_slots.slots_free.push_back(iterator->second);
+      _image_slots.slot_per_identifier.erase(iterator);
+      return true;
+    }
+
+    //! @brief unregisters all trained image identifiers
+    void _clearIdentifiers() {
+      _added_identifiers_train.clear();
+      _identifiers_inserted.clear();
+      _image_slots = ImageSlots();
+    }
+
+    //! @brief reclaimer to register readers with (nullptr if concurrent reading is disabled)
+    EpochReclaimer* _getReclaimer() const {
+      return _concurrent_reading ? &_reclaimer : nullptr;
+    }
+
+    //! @brief image identifiers visible to readers (the published snapshot for concurrent
+    //! reading, to be called within a reader guard)
+    const std::set<uint64_t>& _getIdentifiers() const {
+      return _concurrent_reading ? _identifiers_snapshot.load()->identifiers
+                                 : _added_identifiers_train;
+    }
+
+    //! @brief publishes a copy of the current image identifiers for concurrent readers
+    void _publishIdentifiers() {
+      if (!_concurrent_reading) {
+        return;
+      }
+      const IdentifierSnapshot* identifiers_old = _identifiers_snapshot.exchange(
+        new IdentifierSnapshot{_added_identifiers_train, _image_slots});
+      if (identifiers_old) {
+        _reclaimer.retire(identifiers_old);
+      }
+    }
+
+    //! @brief number of contiguous query ranges processed in parallel (1 without thread pool)
+    size_t _getNumberOfQueryRanges(const size_t& number_of_queries_) const {
+      if (!_thread_pool || _thread_pool->size() == 1) {
+        return 1;
+      }
+
+      // ds a few ranges per thread for load balancing, while keeping ranges reasonably large
+      const size_t number_of_ranges =
+        std::min(number_of_queries_ / std::max(minimum_number_of_queries_per_range, size_t(1)),
+                 4 * _thread_pool->size());
+      return std::max(number_of_ranges, size_t(1));
+    }
+
+    //! @brief calls function_(index_range, matchable_query) for all query matchables, splitting
+    //! the queries into number_of_ranges_ contiguous ranges processed by the thread pool
+    template <typename Function_>
+    void _forEachQuery(const MatchableVector& matchables_query_,
+                       const size_t& number_of_ranges_,
+                       Function_ function_) const {
+      _forEachIndex(matchables_query_.size(),
+                    number_of_ranges_,
+                    [&](const size_t& index_range, const size_t& index_query) {
+                      function_(index_range, matchables_query_[index_query]);
+                    });
+    }
+
+    //! @brief calls function_(index_range, index) for all indices in [0, number_of_indices_),
+    //! split into number_of_ranges_ contiguous ranges processed by the thread pool
+    template <typename Function_>
+    void _forEachIndex(const size_t& number_of_indices_,
+                       const size_t& number_of_ranges_,
+                       Function_ function_) const {
+      if (number_of_ranges_ <= 1) {
+        for (size_t index = 0; index < number_of_indices_; ++index) {
+          function_(0, index);
+        }
+        return;
+      }
+      _thread_pool->run(number_of_ranges_, [&](const size_t& index_range) {
+        const size_t index_begin = number_of_indices_ * index_range / number_of_ranges_;
+        const size_t index_end   = number_of_indices_ * (index_range + 1) / number_of_ranges_;
+        for (size_t index = index_begin; index < index_end; ++index) {
+          function_(index_range, index);
+        }
+      });
     }
 
+    //! @brief registers matchables of the tree with their images (see _matchables_per_image)
+    void _indexMatchables(const MatchableVector& matchables_) {
+      for (Matchable* matchable : matchables_) {
+        for (const ObjectMapElement& object : matchable->objects) {
+          _matchables_per_image[object.first].push_back(matchable);
+        }
+      }
+    }
+
+    //! @brief drops removed matchables from the bookkeeping and frees them
+    void _compactMatchables() {
+      if (_matchables_removed.empty()) {
+        return;
+      }
+      const std::set<const Matchable*> matchables_removed(_matchables_removed.begin(),
+                                                          _matchables_removed.end());
+      size_t number_of_matchables = 0;
+      for (Matchable* matchable : _matchables) {
+        if (matchables_removed.count(matchable) == 0) {
+          _matchables[number_of_matchables] = matchable;
+          ++number_of_matchables;
+        }
+      }
+      _matchables.resize(number_of_matchables);
+      for (const Matchable* matchable : _matchables_removed) {
+        _freeMatchable(matchable);
+      }
+      _matchables_removed.clear();
+    }
+
+    //! @brief removes the oldest images until the retention bounds are satisfied
+    void _applyRetention() {
+      if (_maximum_number_of_images == 0 && _maximum_identifier_age == 0) {
+        return;
+      }
+      while (!_identifiers_inserted.empty()) {
+        const uint64_t identifier_oldest = _identifiers_inserted.front();
+
+        // ds skip images that have already been removed
+        if (_added_identifiers_train.count(identifier_oldest) == 0) {
+          _identifiers_inserted.pop_front();
+          continue;
+        }
+        const bool exceeds_size = _maximum_number_of_images > 0 &&
+                                  _added_identifiers_train.size() > _maximum_number_of_images;
+        const uint64_t identifier_latest = _identifiers_inserted.back();
+        const bool exceeds_age           = _maximum_identifier_age > 0 &&
+                                 identifier_latest > identifier_oldest &&
+                                 identifier_latest - identifier_oldest > _maximum_identifier_age;
+        if (!exceeds_size && !exceeds_age) {
+          return;
+        }
+        _identifiers_inserted.pop_front();
+        remove(identifier_oldest);
+      }
+    }
+
+    //! @brief frees a matchable owned by the tree: pool slots are recycled, others deleted
+    void _freeMatchable(const Matchable* matchable_) {
+      if (!_matchable_pool.recycle(matchable_)) {
+        delete matchable_;
+      }
+    }
+
+    //! @brief counters of an exhaustive leaf search
+    struct LeafCounts {
+      uint64_t number_of_comparisons = 0; // references compared (see Node::scan)
+      uint64_t number_of_matches     = 0; // references within the matching distance
+    };
+
+#ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief retrieves best matches (BF search) for provided matchables for all image indices
     //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
+    //! @param[in] leaf_ leaf whose matchables are scanned
     //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
+    //! @param[in,out] best_matches_ best match search storage (reset by the caller): image id,
+    //! match candidate
+    //! @returns number of references compared and within the matching distance
+    LeafCounts _matchExhaustive(const Matchable* matchable_query_,
+                                const Node* leaf_,
+                                const uint32_t& maximum_distance_matching_,
+                                MatchAccumulator& best_matches_) const {
+      Matchable* matchable_reference_for_merge = nullptr;
+      return _matchExhaustive(matchable_query_,
+                              leaf_,
+                              maximum_distance_matching_,
+                              best_matches_,
+                              matchable_reference_for_merge);
+    }
+
+    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
+    //! @param[in] matchable_query_
+    //! @param[in] leaf_ leaf whose matchables are scanned
+    //! @param[in] maximum_distance_matching_
+    //! @param[in,out] best_matches_ best match search storage (reset by the caller): image id,
+    //! match candidate
     //! @param[in,out] matchable_reference_for_merge_ reference matchable with distance == 0
     //! (matchable merge candidate)
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
-                          const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_,
-                          Matchable*& matchable_reference_for_merge_) const {
+    //! @returns number of references compared and within the matching distance
+    LeafCounts _matchExhaustive(const Matchable* matchable_query_,
+                                const Node* leaf_,
+                                const uint32_t& maximum_distance_matching_,
+                                MatchAccumulator& best_matches_,
+                                Matchable*& matchable_reference_for_merge_) const {
       ObjectType object_query =
         std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
+      // ds check current descriptors in this node (only references within the matching distance
+      // are visited)
+      LeafCounts counts;
+      counts.number_of_comparisons = leaf_->scan(
+        matchable_query_->descriptor,
+        maximum_distance_matching_,
+        [&](const uint32_t& index_reference, const uint32_t& distance) {
+          const Matchable* matchable_reference = leaf_->matchables[index_reference];
+          ++counts.number_of_matches;
 
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
           // ds for every reference in this matchable
           for (const ObjectMapElement& object : matchable_reference->objects) {
             const uint64_t& identifer_tree_reference = object.first;
 
-            try {
-              // ds update match if current is better than the current best - will jump to addition
-              // if no best is available
-              Match& best_match_so_far              = best_matches_.at(identifer_tree_reference);
-              const real_type& best_distance_so_far = best_match_so_far.distance;
-              assert(best_distance_so_far >= 0);
-              if (distance < best_distance_so_far) {
-                assert(best_match_so_far.matchable_references.size() >= 1);
-                assert(best_match_so_far.object_references.size() >= 1);
-
-                // ds replace the best with this match on the spot - we don't have to update the
-                // query information
-                best_match_so_far.matchable_references =
-                  std::move(std::vector<const Matchable*>(1, matchable_reference));
-                best_match_so_far.object_references =
-                  std::move(std::vector<ObjectType>(1, object.second));
-                best_match_so_far.distance = distance;
-                assert(best_match_so_far.matchable_references.size() == 1);
-                assert(best_match_so_far.object_references.size() == 1);
-              }
-
-              // ds if the match is equal to the last (multiple candidates)
-              else if (distance == best_distance_so_far) {
-                // ds add the candidate - we don't have to update the distance since its the same as
-                // the best
-                best_match_so_far.matchable_references.push_back(matchable_reference);
-                best_match_so_far.object_references.push_back(object.second);
-                assert(best_match_so_far.matchable_references.size() > 1);
-                assert(best_match_so_far.object_references.size() > 1);
-              }
-            } catch (const std::out_of_range& /*exception*/) {
-              // ds add a new match
-              best_matches_.insert(std::make_pair(
-                identifer_tree_reference,
-                Match(
-                  matchable_query_, matchable_reference, object_query, object.second, distance)));
-            }
+            best_matches_.add(identifer_tree_reference,
+                              matchable_query_,
+                              matchable_reference,
+                              object_query,
+                              object.second,
+                              distance);
           }
 
-          // ds if the matchable descriptors are identical - we can merge - note that
-          // maximum_distance_for_merge must always be smaller than maximum_distance_matching_
-          assert(maximum_distance_for_merge < maximum_distance_matching_);
+          // ds if the matchable descriptors are identical - we can merge
           if (distance <= maximum_distance_for_merge) {
             // ds behold the power of C++ (we want to keep the MatchableVector elements const)
             matchable_reference_for_merge_ = const_cast<Matchable*>(matchable_reference);
           }
-        }
-      }
+          return true;
+        });
+      return counts;
     }
 #else
     //! @brief retrieves best matches (BF search) for provided matchables for all image indices
     //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
+    //! @param[in] leaf_ leaf whose matchables are scanned
     //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
-                          const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_) const {
+    //! @param[in,out] best_matches_ best match search storage (reset by the caller): image id,
+    //! match candidate
+    //! @returns number of references compared and within the matching distance
+    LeafCounts _matchExhaustive(const Matchable* matchable_query_,
+                                const Node* leaf_,
+                                const uint32_t& maximum_distance_matching_,
+                                MatchAccumulator& best_matches_) const {
       ObjectType object_query =
         std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
-
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
-          const uint64_t& identifer_tree_reference = matchable_reference->_image_identifier;
+      // ds check current descriptors in this node (only references within the matching distance
+      // are visited, the reference matchable is only accessed for a hit)
+      LeafCounts counts;
+      counts.number_of_comparisons = leaf_->scan(
+        matchable_query_->descriptor,
+        maximum_distance_matching_,
+        [&](const uint32_t& index_reference, const uint32_t& distance) {
+          ++counts.number_of_matches;
+          const Matchable* matchable_reference     = leaf_->matchables[index_reference];
+          const uint64_t& identifer_tree_reference = leaf_->image_identifiers[index_reference];
           assert(matchable_reference->objects.find(identifer_tree_reference) !=
                  matchable_reference->objects.end());
-          ObjectType object_reference =
-            std::move(matchable_reference->objects.at(identifer_tree_reference));
-
-          try {
-            // ds update match if current is better than the current best - will jump to addition if
-            // no best is available
-            Match& best_match_so_far = best_matches_.at(identifer_tree_reference);
-            const real_type& best_distance_so_far = best_match_so_far.distance;
-            assert(best_distance_so_far >= 0);
-            if (distance < best_distance_so_far) {
-              assert(best_match_so_far.matchable_references.size() >= 1);
-              assert(best_match_so_far.object_references.size() >= 1);
-
-              // ds replace the best with this match on the spot - we don't have to update the query
-              // information
-              best_match_so_far.matchable_references =
-                std::move(std::vector<const Matchable*>(1, matchable_reference));
-              best_match_so_far.object_references =
-                std::move(std::vector<ObjectType>(1, object_reference));
-              best_match_so_far.distance = distance;
-              assert(best_match_so_far.matchable_references.size() == 1);
-              assert(best_match_so_far.object_references.size() == 1);
-            }
+          const ObjectType& object_reference =
+            matchable_reference->objects.at(identifer_tree_reference);
+
+          best_matches_.add(identifer_tree_reference,
+                            matchable_query_,
+                            matchable_reference,
+                            object_query,
+                            object_reference,
+                            distance);
+          return true;
+        });
+      return counts;
+    }
+#endif
 
-            // ds if the match is equal to the last (multiple candidates)
-            else if (distance == best_distance_so_far) {
-              // ds add the candidate - we don't have to update the distance since its the same as
-              // the best
-              best_match_so_far.matchable_references.push_back(matchable_reference);
-              best_match_so_far.object_references.push_back(object_reference);
-              assert(best_match_so_far.matchable_references.size() > 1);
-              assert(best_match_so_far.object_references.size() > 1);
-            }
-          } catch (const std::out_of_range& /*exception*/) {
-            // ds add a new match
-            best_matches_.insert(std::make_pair(
-              identifer_tree_reference,
-              Match(
-                matchable_query_, matchable_reference, object_query, object_reference, distance)));
-          }
-        }
+    //! @brief accumulates the traversal counters of a query call (no-op without
+    //! SRRG_HBST_STATISTICS)
+    //! @param[in] statistics_per_range_ counters of all query ranges of the call
+    void _recordStatistics(const std::vector<QueryStatistics>& statistics_per_range_) const {
+#ifdef SRRG_HBST_STATISTICS
+      BinaryQueryStatistics statistics_call;
+      for (const BinaryQueryStatistics& statistics : statistics_per_range_) {
+        statistics_call += statistics;
       }
-    }
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      _statistics += statistics_call;
+      _statistics_last_call = std::move(statistics_call);
+#else
+      (void)statistics_per_range_;
 #endif
+    }
 
     //! @brief recursively counts all leafs and descriptors stored in the tree (expensive)
     //! @param[in] starting node (only subtree will be evaluated)
@@ -1445,8 +2469,97 @@ namespace srrg_hbst {
       }
     }
 
+    //! @brief serializes the tree into the mapped layout (see MappedHeader)
+    //! @param[out] image_ database image (word storage, 8-byte aligned)
+    //! @returns number of valid bytes in image_ (the size of a mapped file)
+    uint64_t _serializeMapped(std::vector<uint64_t>& image_) const {
+      static_assert(std::is_trivially_copyable<ObjectType>::value,
+                    "mapped databases require trivially copyable objects");
+      using Object = MappedObject<ObjectType>;
+
+      // ds breadth first node layout, the children of a node are stored as adjacent pair - an
+      // ds empty tree is stored as a single empty leaf
+      std::vector<const Node*> nodes(1, _root);
+      std::vector<MappedNode> nodes_mapped(1);
+      MappedHeader header;
+      for (size_t index_node = 0; index_node < nodes.size(); ++index_node) {
+        const Node* node = nodes[index_node];
+        MappedNode& node_mapped = nodes_mapped[index_node];
+        if (node && node->has_leafs) {
+          node_mapped.index_first     = nodes.size();
+          node_mapped.index_split_bit = node->index_split_bit;
+          nodes.push_back(node->left);
+          nodes.push_back(node->right);
+          nodes_mapped.resize(nodes.size());
+        } else if (node) {
+          node_mapped.index_first       = header.number_of_entries;
+          node_mapped.number_of_entries = node->matchables.size();
+          header.number_of_entries += node->matchables.size();
+          for (const Matchable* matchable : node->matchables) {
+            header.number_of_objects += matchable->objects.size();
+          }
+        }
+      }
+
+      // ds section layout (the zero initialized image leaves all padding bytes zero)
+      header.descriptor_size_bits  = Matchable::descriptor_size_bits;
+      header.object_record_size    = sizeof(Object);
+      header.identifier            = _header.identifier;
+      header.number_of_identifiers = _added_identifiers_train.size();
+      header.number_of_nodes       = nodes_mapped.size();
+      header.computeOffsets(Node::descriptor_size_words);
+      image_.assign((header.file_size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+      char* data = reinterpret_cast<char*>(image_.data());
+
+      // ds header, identifiers and nodes
+      std::memcpy(data, &header, sizeof(header));
+      std::copy(_added_identifiers_train.begin(),
+                _added_identifiers_train.end(),
+                reinterpret_cast<uint64_t*>(data + header.offset_identifiers));
+      std::memcpy(data + header.offset_nodes,
+                  nodes_mapped.data(),
+                  nodes_mapped.size() * sizeof(MappedNode));
+
+      // ds descriptor words, object ranges and objects of all leafs in node order (descriptor
+      // ds words are already contiguous per leaf)
+      char* descriptor_words     = data + header.offset_descriptor_words;
+      uint64_t* object_ranges    = reinterpret_cast<uint64_t*>(data + header.offset_object_ranges);
+      char* objects              = data + header.offset_objects;
+      uint64_t number_of_objects = 0;
+      for (size_t index_node = 0; index_node < nodes.size(); ++index_node) {
+        if (!nodes[index_node] || nodes_mapped[index_node].index_split_bit >= 0) {
+          continue;
+        }
+        const Node* node = nodes[index_node];
+        std::memcpy(descriptor_words,
+                    node->descriptor_words.data(),
+                    node->descriptor_words.size() * sizeof(uint64_t));
+        descriptor_words += node->descriptor_words.size() * sizeof(uint64_t);
+        for (const Matchable* matchable : node->matchables) {
+          for (const ObjectMapElement& element : matchable->objects) {
+            // ds zero padding bytes for reproducible images
+            Object object;
+            std::memset(&object, 0, sizeof(Object));
+            object.image_identifier = element.first;
+            object.object           = element.second;
+            std::memcpy(objects + number_of_objects * sizeof(Object), &object, sizeof(Object));
+            ++number_of_objects;
+          }
+          *++object_ranges = number_of_objects;
+        }
+      }
+      return header.file_size;
+    }
+
     // ds public attributes
   public:
+    //! @brief minimum number of query matchables per range for parallel batch queries
+    static size_t minimum_number_of_queries_per_range;
+
+    //! @brief depth up to which a parallel tree build splits nodes level by level - the up to
+    //! 2^bulk_build_depth subtrees below are built as independent tasks
+    static uint32_t bulk_build_depth;
+
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief maximum allowed descriptor distance for merging two descriptors
     static uint32_t maximum_distance_for_merge;
@@ -1457,19 +2570,155 @@ namespace srrg_hbst {
     //! @brief serializable header carrying core attributes
     mutable Header _header;
 
-    //! @brief root node (e.g. starting point for similarity search)
-    Node* _root = nullptr;
+    //! @brief root node (e.g. starting point for similarity search) - atomic for concurrent
+    //! reading as a leaf root is replaced on update
+    std::atomic<Node*> _root{nullptr};
 
     //! @brief bookkeeping: all matchables contained in the tree
     MatchableVector _matchables;
     MatchableVector _matchables_to_train;
 
+    //! @brief bookkeeping: matchables holding an object of each image (merged matchables are
+    //! listed for each of their images) - locates the matchables to remove
+    std::unordered_map<uint64_t, MatchableVector> _matchables_per_image;
+
+    //! @brief removed matchables still contained in _matchables (freed on compaction)
+    MatchableVector _matchables_removed;
+
+    //! @brief retention policy: image insertion order and window bounds (0: unbounded)
+    std::deque<uint64_t> _identifiers_inserted;
+    size_t _maximum_number_of_images = 0;
+    uint64_t _maximum_identifier_age = 0;
+
+    //! @brief arena for matchables allocated through the tree (read, allocateMatchables)
+    MatchablePool _matchable_pool;
+
+    //! @brief optional thread pool for batch queries
+    std::shared_ptr<ThreadPool> _thread_pool;
+
+    //! @brief own generator for random splitting (nullptr: the node generator is used)
+    std::unique_ptr<std::mt19937> _random_number_generator;
+
+    //! @brief lends the own generator of a tree to the nodes for the scope of a training call
+    struct RandomNumberGeneratorScope {
+      RandomNumberGeneratorScope(std::mt19937* random_number_generator_) :
+        random_number_generator(random_number_generator_) {
+        if (random_number_generator) {
+          std::swap(*random_number_generator, Node::random_number_generator);
+        }
+      }
+      ~RandomNumberGeneratorScope() {
+        if (random_number_generator) {
+          std::swap(*random_number_generator, Node::random_number_generator);
+        }
+      }
+      std::mt19937* random_number_generator;
+    };
+
     //! @brief bookkeeping: integrated matchable train identifiers (unique)
     std::set<uint64_t> _added_identifiers_train;
 
+    //! @brief dense slots [0, number of slots) of the trained identifiers, maintained along with
+    //! them for scoring in flat arrays (slots of removed images are reused)
+    struct ImageSlots {
+      std::unordered_map<uint64_t, uint32_t> slot_per_identifier;
+      std::vector<uint64_t> identifier_per_slot;
+      std::vector<uint32_t> slots_free;
+
+      //! @brief slot of an image: the slot stored in a leaf if it still belongs to the image
+      //! (slots are reused after removals), otherwise looked up - number of slots if not found
+      uint32_t getSlot(const uint64_t& identifier_, const uint32_t& slot_leaf_) const {
+        if (slot_leaf_ < identifier_per_slot.size() &&
+            identifier_per_slot[slot_leaf_] == identifier_) {
+          return slot_leaf_;
+        }
+        const typename std::unordered_map<uint64_t, uint32_t>::const_iterator iterator =
+          slot_per_identifier.find(identifier_);
+        if (iterator == slot_per_identifier.end()) {
+          return identifier_per_slot.size();
+        }
+        return iterator->second;
+      }
+    };
+    ImageSlots _image_slots;
+
+    //! @brief scoring scratch of a query range: match counts and query stamps per image slot,
+    //! matched slots in order of first match - kept across calls (the stamp only increases and
+    //! the counts of the matched slots are reset on release) and grown with the number of slots
+    struct ScoreScratch {
+      std::vector<uint64_t> number_of_matches;
+      std::vector<uint64_t> stamps;
+      std::vector<uint32_t> slots_matched;
+      uint64_t stamp = 0;
+    };
+
+    //! @brief idle score scratches (one per concurrently scored query range at most)
+    struct ScoreScratchPool {
+      std::mutex mutex;
+      std::vector<std::unique_ptr<ScoreScratch>> scratches;
+    };
+    mutable ScoreScratchPool _score_scratch_pool;
+
+    //! @brief scoped lease of score scratches from the pool
+    class ScoreScratchLease {
+    public:
+      ScoreScratchLease(ScoreScratchPool& pool_,
+                        const size_t& number_of_scratches_,
+                        const size_t& number_of_slots_) :
+        _pool(pool_) {
+        _scratches.reserve(number_of_scratches_);
+        {
+          std::lock_guard<std::mutex> lock(_pool.mutex);
+          while (_scratches.size() < number_of_scratches_ && !_pool.scratches.empty()) {
+            _scratches.emplace_back(std::move(_pool.scratches.back()));
+            _pool.scratches.pop_back();
+          }
+        }
+        while (_scratches.size() < number_of_scratches_) {
+          _scratches.emplace_back(new ScoreScratch());
+        }
+        for (std::unique_ptr<ScoreScratch>& scratch : _scratches) {
+          if (scratch->stamps.size() < number_of_slots_) {
+            scratch->number_of_matches.resize(number_of_slots_, 0);
+            scratch->stamps.resize(number_of_slots_, 0);
+          }
+        }
+      }
+      ~ScoreScratchLease() {
+        for (std::unique_ptr<ScoreScratch>& scratch : _scratches) {
+          for (const uint32_t& slot : scratch->slots_matched) {
+            scratch->number_of_matches[slot] = 0;
+          }
+          scratch->slots_matched.clear();
+        }
+        std::lock_guard<std::mutex> lock(_pool.mutex);
+        for (std::unique_ptr<ScoreScratch>& scratch : _scratches) {
+          _pool.scratches.emplace_back(std::move(scratch));
+        }
+      }
+      ScoreScratch& operator[](const size_t& index_) const {
+        return *_scratches[index_];
+      }
+
+    private:
+      ScoreScratchPool& _pool;
+      std::vector<std::unique_ptr<ScoreScratch>> _scratches;
+    };
+
+    //! @brief trained identifiers and their slots as published for concurrent readers
+    struct IdentifierSnapshot {
+      std::set<uint64_t> identifiers;
+      ImageSlots image_slots;
+    };
+
     //! @brief bookkeeping: trainable matchables resulting from last matchAndAdd call
     std::vector<Trainable> _trainables;
 
+    //! @brief concurrent reading: mode, published identifiers and reclamation of replaced leafs
+    bool _concurrent_reading = false;
+    std::atomic<const IdentifierSnapshot*> _identifiers_snapshot{nullptr};
+    mutable EpochReclaimer _reclaimer;
+
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief bookkeeping: merged matchable pairs (query -> reference) resulting from last
     //! matchAndAdd call over Mergable.query one has access to the merged (=freed) matchable and can
@@ -1479,9 +2728,21 @@ namespace srrg_hbst {
     //! statistics
     size_t _number_of_merged_matchables_last_training = 0;
 #endif
+
+#ifdef SRRG_HBST_STATISTICS
+    //! @brief traversal counters: cumulative and of the last query call (queries may be issued
+    //! concurrently, each call accumulates once under the mutex)
+    mutable std::mutex _statistics_mutex;
+    mutable BinaryQueryStatistics _statistics;
+    mutable BinaryQueryStatistics _statistics_last_call;
+#endif
   };
 
 // ds default configuration
+  template <typename BinaryNodeType_>
+  size_t BinaryTree<BinaryNodeType_>::minimum_number_of_queries_per_range = 64;
+  template <typename BinaryNodeType_>
+  uint32_t BinaryTree<BinaryNodeType_>::bulk_build_depth = 6;
 #ifdef SRRG_MERGE_DESCRIPTORS
   template <typename BinaryNodeType_>
   uint32_t BinaryTree<BinaryNodeType_>::maximum_distance_for_merge = 0;
@@ -0,0 +1,227 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+#include "binary_tree.hpp"
+
+namespace srrg_hbst {
+
+  //! @class randomized forest: a number of independently (randomly) split trees over the same
+  //! matchables - a query descends all trees and the leaf hits are unioned per image, which
+  //! recovers matches lost to a single unfavorable partitioning without enlarging the leafs.
+  //! The matchables are shared (owned by the first tree), only the leaf descriptor storage is
+  //! replicated per tree. Each tree splits with its own generator, forked from the node generator
+  //! on construction (seed it before for reproducible forests, see Node::seedRandomNumberGenerator)
+  //! @param BinaryTreeType_ tree type (class) of the forest
+  template <typename BinaryTreeType_>
+  class BinaryTreeForest {
+    // ds exports
+  public:
+    using Tree             = BinaryTreeType_;
+    using Node             = typename Tree::Node;
+    using Matchable        = typename Tree::Matchable;
+    using MatchableVector  = typename Tree::MatchableVector;
+    using Match            = typename Tree::Match;
+    using MatchVector      = typename Tree::MatchVector;
+    using MatchVectorMap   = typename Tree::MatchVectorMap;
+    using MatchAccumulator = typename Tree::MatchAccumulator;
+    using ObjectType       = typename Tree::ObjectType;
+    static_assert(!Tree::Header::srrg_merge_descriptors,
+                  "a forest requires unmerged matchables (shared by all trees)");
+
+    // ds ctor/dtor
+  public:
+    //! @brief empty forest
+    //! @param[in] number_of_trees_ number of independent trees (at least one)
+    //! @param[in] thread_pool_ optional pool for batch queries (split into query ranges)
+    BinaryTreeForest(const size_t& number_of_trees_           = 4,
+                     std::shared_ptr<ThreadPool> thread_pool_ = nullptr) :
+      _thread_pool(thread_pool_) {
+      for (size_t index = 0; index < std::max(number_of_trees_, size_t(1)); ++index) {
+        _trees.emplace_back(new Tree(index));
+        _trees.back()->forkRandomNumberGenerator();
+      }
+    }
+
+    //! @brief the shared matchables are only released by the first tree
+    ~BinaryTreeForest() {
+      clear();
+    }
+
+    BinaryTreeForest(const BinaryTreeForest&) = delete;
+    BinaryTreeForest& operator=(const BinaryTreeForest&) = delete;
+
+    // ds access
+  public:
+    //! @brief number of images in the forest
+    size_t size() const {
+      return _trees.front()->size();
+    }
+
+    //! @brief number of trees
+    size_t numberOfTrees() const {
+      return _trees.size();
+    }
+
+    //! @brief tree access
+    const Tree& tree(const size_t& index_) const {
+      return *_trees[index_];
+    }
+
+#ifdef SRRG_HBST_HAS_OPENCV
+    //! @brief creates a matchable vector in the matchable pool of the forest (see
+    //! BinaryTree::allocateMatchables)
+    const MatchableVector allocateMatchables(const cv::Mat& descriptors_cv_,
+                                             const std::vector<ObjectType>& objects_,
+                                             const uint64_t& identifier_tree_ = 0) {
+      return _trees.front()->allocateMatchables(descriptors_cv_, objects_, identifier_tree_);
+    }
+#endif
+
+    //! @brief constructs a single matchable in the matchable pool of the forest
+    template <typename... Arguments_>
+    Matchable* allocateMatchable(Arguments_&&... arguments_) {
+      return _trees.front()->allocateMatchable(std::forward<Arguments_>(arguments_)...);
+    }
+
+    //! @brief adds an image to all trees - each tree draws its own split bits with random uniform
+    //! splitting (the deterministic strategies would build identical trees), the trees are trained
+    //! one after another since their generators are lent to the nodes while training
+    void add(const MatchableVector& matchables_) {
+      for (std::unique_ptr<Tree>& tree : _trees) {
+        tree->add(matchables_, SplittingStrategy::SplitRandomUniform);
+      }
+    }
+
+    //! @brief knn multi-matching function over all trees: for every query the union of the leafs
+    //! reached in the trees is searched (each reference is considered once)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains all available matches for all
+    //! training images added to the forest
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    void match(const MatchableVector& matchables_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      matches_.clear();
+      const std::set<uint64_t>& identifiers = _trees.front()->trainedIdentifiers();
+      if (matchables_query_.empty() || identifiers.empty()) {
+        return;
+      }
+      for (const uint64_t identifier_tree : identifiers) {
+        matches_[identifier_tree].reserve(matchables_query_.size());
+      }
+
+      // ds contiguous query ranges, processed in parallel if a thread pool is set
+      const size_t number_of_ranges =
+        _thread_pool ? std::min(_thread_pool->size(), matchables_query_.size()) : 1;
+      std::vector<MatchVectorMap> matches_per_range(number_of_ranges);
+      const auto match_range = [&](const size_t& index_range) {
+        MatchAccumulator best_matches(identifiers.size());
+        std::vector<const Matchable*> references;
+        const size_t index_begin = matchables_query_.size() * index_range / number_of_ranges;
+        const size_t index_end   = matchables_query_.size() * (index_range + 1) / number_of_ranges;
+        for (size_t index = index_begin; index < index_end; ++index) {
+          best_matches.reset();
+          references.clear();
+          _matchUnion(
+            matchables_query_[index], maximum_distance_matching_, references, best_matches);
+          for (size_t index_image = 0; index_image < best_matches.size(); ++index_image) {
+            matches_per_range[index_range][best_matches.identifier(index_image)].push_back(
+              best_matches.match(index_image));
+          }
+        }
+      };
+      if (number_of_ranges > 1) {
+        _thread_pool->run(number_of_ranges, match_range);
+      } else {
+        match_range(0);
+      }
+
+      // ds merge range results in query order
+      for (const MatchVectorMap& matches : matches_per_range) {
+        for (const typename MatchVectorMap::value_type& matches_per_image : matches) {
+          MatchVector& matches_merged = matches_[matches_per_image.first];
+          matches_merged.insert(
+            matches_merged.end(), matches_per_image.second.begin(), matches_per_image.second.end());
+        }
+      }
+    }
+
+    //! @brief clears all trees (matchables are released by the first tree only)
+    void clear(const bool& delete_matchables_ = true) {
+      for (size_t index = 1; index < _trees.size(); ++index) {
+        _trees[index]->clear(false);
+      }
+      _trees.front()->clear(delete_matchables_);
+    }
+
+    //! @brief thread pool used for batch queries (nullptr if serial)
+    void setThreadPool(std::shared_ptr<ThreadPool> thread_pool_) {
+      _thread_pool = thread_pool_;
+    }
+
+    // ds helpers
+  protected:
+    //! @brief descends all trees and registers the best matches per image over the reached leafs
+    //! @param[in] matchable_query_
+    //! @param[in] maximum_distance_matching_
+    //! @param[in,out] references_ references already considered for this query (reset by caller)
+    //! @param[in,out] best_matches_ best match search storage (reset by the caller)
+    void _matchUnion(const Matchable* matchable_query_,
+                     const uint32_t& maximum_distance_matching_,
+                     std::vector<const Matchable*>& references_,
+                     MatchAccumulator& best_matches_) const {
+      const ObjectType& object_query = matchable_query_->objects.begin()->second;
+      for (const std::unique_ptr<Tree>& tree : _trees) {
+        // ds traverse tree to find this descriptor
+        const Node* node_current = tree->root();
+        while (node_current && node_current->hasLeafs()) {
+          if (matchable_query_->descriptor[node_current->indexSplitBit()]) {
+            node_current = node_current->right;
+          } else {
+            node_current = node_current->left;
+          }
+        }
+        if (!node_current) {
+          continue;
+        }
+
+        // ds check descriptors in the leaf - references hit in a previous tree are skipped (hits
+        // within the matching distance are few, a linear lookup suffices)
+        const MatchableVector& matchables        = node_current->getMatchables();
+        const std::vector<uint64_t>& identifiers = node_current->getImageIdentifiers();
+        node_current->scan(
+          matchable_query_->descriptor,
+          maximum_distance_matching_,
+          [&](const uint32_t& index_reference, const uint32_t& distance) {
+            const Matchable* matchable_reference = matchables[index_reference];
+            if (std::find(references_.begin(), references_.end(), matchable_reference) !=
+                references_.end()) {
+              return true;
+            }
+            references_.push_back(matchable_reference);
+            const uint64_t& identifier_reference = identifiers[index_reference];
+            best_matches_.add(identifier_reference,
+                              matchable_query_,
+                              matchable_reference,
+                              object_query,
+                              matchable_reference->objects.at(identifier_reference),
+                              distance);
+            return true;
+          });
+      }
+    }
+
+    // ds attributes
+  protected:
+    //! @brief independent trees over the same matchables (the first one owns them)
+    std::vector<std::unique_ptr<Tree>> _trees;
+
+    //! @brief optional thread pool for batch queries
+    std::shared_ptr<ThreadPool> _thread_pool;
+  };
+
+} // namespace srrg_hbst
@@ -0,0 +1,449 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "binary_tree.hpp"
+
+namespace srrg_hbst {
+
+  //! @class append-only persistence for a streaming tree: every added image is appended to a
+  //! journal as a single checksummed record before it is integrated, a checkpoint (full
+  //! BinaryTree::write) compacts the journal - opening restores the checkpoint and replays the
+  //! journal, a torn last record is discarded (a crash loses at most the frame being written) -
+  //! explicit removals are journaled as well, removals by the tree retention are reproduced on
+  //! replay if the same retention is set on the tree before opening
+  //! @param BinaryTreeType_ tree type (class) to persist
+  template <typename BinaryTreeType_>
+  class BinaryTreeJournal {
+    // ds exports
+  public:
+    using Tree            = BinaryTreeType_;
+    using Matchable       = typename Tree::Matchable;
+    using MatchableVector = typename Tree::MatchableVector;
+    using MatchVectorMap  = typename Tree::MatchVectorMap;
+    using Descriptor      = typename Tree::Descriptor;
+    using ObjectType      = typename Tree::ObjectType;
+    static_assert(std::is_trivially_copyable<ObjectType>::value,
+                  "journaling requires trivially copyable objects");
+
+    //! @brief journal file header
+    struct Header {
+      char magic[8]                 = {'S', 'R', 'R', 'G', 'H', 'B', 'J', 'L'};
+      uint32_t version              = 1;
+      uint32_t descriptor_size_bits = Matchable::descriptor_size_bits;
+      uint32_t object_size          = sizeof(ObjectType);
+      uint32_t reserved             = 0;
+    };
+
+    //! @brief journaled operation
+    enum Operation : uint8_t { Add = 0, MatchAndAdd = 1, Train = 2, Remove = 3 };
+
+    //! @brief record header, followed by number_of_matchables (descriptor, object) entries
+    struct Record {
+      uint32_t marker               = record_marker;
+      uint8_t operation             = Operation::Add;
+      uint8_t train_mode            = 0;
+      uint16_t reserved             = 0;
+      uint32_t maximum_distance     = 0;
+      uint32_t number_of_matchables = 0;
+      uint64_t image_identifier     = 0;
+      uint64_t checksum             = 0; // ds over the record header (checksum = 0) and payload
+    };
+    static constexpr uint32_t record_marker = 0x524A4248; // ds "HBJR"
+
+    //! @brief bytes per journaled matchable
+    static constexpr size_t entry_size = Matchable::raw_descriptor_size_bytes + sizeof(ObjectType);
+
+    // ds ctor/dtor
+  public:
+    //! @brief binds the journal to a tree (which has to outlive the journal)
+    BinaryTreeJournal(Tree& tree_) : _tree(tree_) {
+    }
+
+    //! @brief closes the journal (without checkpoint)
+    ~BinaryTreeJournal() {
+      close();
+    }
+
+    BinaryTreeJournal(const BinaryTreeJournal&) = delete;
+    BinaryTreeJournal& operator=(const BinaryTreeJournal&) = delete;
+
+    // ds access
+  public:
+    //! @brief restores the tree from the checkpoint (if present) and the journal (if present) and
+    //! opens the journal for appending - the tree is cleared before
+    //! @param[in] file_path_journal_ append-only journal
+    //! @param[in] file_path_checkpoint_ compacted database (BinaryTree::write format)
+    //! @param[in] sync_to_disk_ if set every record is synchronized to the disk (power loss safe,
+    //! milliseconds per frame) - otherwise records are only flushed to the OS (process crash safe)
+    //! @returns false if the checkpoint or journal could not be opened or are incompatible
+    bool open(const std::string& file_path_journal_,
+              const std::string& file_path_checkpoint_,
+              const bool& sync_to_disk_ = false) {
+      close();
+      _file_path_journal    = file_path_journal_;
+      _file_path_checkpoint = file_path_checkpoint_;
+      _sync_to_disk         = sync_to_disk_;
+      _number_of_records    = 0;
+      _tree.clear(true);
+
+      // ds restore checkpoint
+      std::FILE* checkpoint = std::fopen(_file_path_checkpoint.c_str(), "rb");
+      if (checkpoint) {
+        std::fclose(checkpoint);
+        if (!_tree.read(_file_path_checkpoint)) {
+          std::cerr << "BinaryTreeJournal::open|ERROR: unable to read checkpoint: "
+                    << _file_path_checkpoint << std::endl;
+          return false;
+        }
+      }
+
+      // ds replay journal and discard a torn tail
+      uint64_t size_valid = 0;
+      if (!_replay(size_valid)) {
+        return false;
+      }
+      if (size_valid == 0) {
+        return _createJournal();
+      }
+      if (!_truncate(size_valid)) {
+        std::cerr << "BinaryTreeJournal::open|ERROR: unable to truncate journal: "
+                  << _file_path_journal << std::endl;
+        return false;
+      }
+      _journal = std::fopen(_file_path_journal.c_str(), "ab");
+      return _journal != nullptr;
+    }
+
+    //! @brief closes the journal file
+    void close() {
+      if (_journal) {
+        std::fclose(_journal);
+        _journal = nullptr;
+      }
+    }
+
+    //! @brief journals and adds matchables of a new image (see BinaryTree::add)
+    //! @returns false if the record could not be written (the tree is not modified)
+    bool add(const MatchableVector& matchables_,
+             const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      if (!_append(Operation::Add, matchables_, train_mode_, 0)) {
+        return false;
+      }
+      _tree.add(matchables_, train_mode_);
+      return true;
+    }
+
+    //! @brief journals, matches and adds matchables of a new image (see BinaryTree::matchAndAdd)
+    //! @returns false if the record could not be written (the tree is not modified)
+    bool matchAndAdd(const MatchableVector& matchables_,
+                     MatchVectorMap& matches_,
+                     const uint32_t maximum_distance_matching_ = 25,
+                     const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
+      if (!_append(Operation::MatchAndAdd, matchables_, train_mode_, maximum_distance_matching_)) {
+        return false;
+      }
+      _tree.matchAndAdd(matchables_, matches_, maximum_distance_matching_, train_mode_);
+      return true;
+    }
+
+    //! @brief journals and trains the tree (see BinaryTree::train)
+    //! @returns false if the record could not be written (the tree is not modified)
+    bool train(const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      if (!_append(Operation::Train, MatchableVector(), train_mode_, 0)) {
+        return false;
+      }
+      _tree.train(train_mode_);
+      return true;
+    }
+
+    //! @brief journals and removes an image (see BinaryTree::remove)
+    //! @returns false if the image is not contained in the tree or the record could not be written
+    //! (the tree is not modified)
+    //! @throws std::runtime_error if concurrent reading is enabled (nothing is journaled)
+    bool remove(const uint64_t& image_identifier_) {
+      if (_tree.concurrentReading()) {
+        throw std::runtime_error(
+          "BinaryTreeJournal::remove|ERROR: removal is not available for concurrent reading");
+      }
+      if (_tree.trainedIdentifiers().count(image_identifier_) == 0) {
+        return false;
+      }
+      if (!_append(Operation::Remove,
+                   MatchableVector(),
+                   SplittingStrategy::DoNothing,
+                   0,
+                   image_identifier_)) {
+        return false;
+      }
+      return _tree.remove(image_identifier_);
+    }
+
+    //! @brief writes a complete checkpoint of the tree and starts an empty journal (matchables
+    //! added without training are not part of a checkpoint and have to be trained before)
+    //! @returns false if the checkpoint could not be written (the journal is kept)
+    bool checkpoint() {
+      const std::string file_path_temporary = _file_path_checkpoint + ".tmp";
+      if (!_tree.write(file_path_temporary)) {
+        return false;
+      }
+
+      // ds replace the previous checkpoint - records that are already contained in the new
+      // ds checkpoint are skipped on replay if we crash before the journal is reset
+      close();
+#ifdef _WIN32
+      if (!MoveFileExA(file_path_temporary.c_str(),
+                       _file_path_checkpoint.c_str(),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+      if (std::rename(file_path_temporary.c_str(), _file_path_checkpoint.c_str()) != 0) {
+#endif
+        std::cerr << "BinaryTreeJournal::checkpoint|ERROR: unable to replace checkpoint: "
+                  << _file_path_checkpoint << std::endl;
+        _journal = std::fopen(_file_path_journal.c_str(), "ab");
+        return false;
+      }
+      _number_of_records = 0;
+      return _createJournal();
+    }
+
+    //! @brief number of records in the journal (since the last checkpoint)
+    size_t numberOfRecords() const {
+      return _number_of_records;
+    }
+
+    //! @brief true if the journal is open for appending
+    bool isOpen() const {
+      return _journal != nullptr;
+    }
+
+    // ds helpers
+  protected:
+    //! @brief appends a record for matchables_ and flushes it
+    //! @param[in] image_identifier_ image of the record if there are no matchables (removal)
+    bool _append(const Operation& operation_,
+                 const MatchableVector& matchables_,
+                 const SplittingStrategy& train_mode_,
+                 const uint32_t& maximum_distance_,
+                 const uint64_t& image_identifier_ = 0) {
+      if (!_journal) {
+        std::cerr << "BinaryTreeJournal::_append|ERROR: journal is not open" << std::endl;
+        return false;
+      }
+      if (matchables_.empty() && operation_ != Operation::Train &&
+          operation_ != Operation::Remove) {
+        return true;
+      }
+
+      // ds serialize record in a reused buffer (written with a single call)
+      Record record;
+      record.operation            = operation_;
+      record.train_mode           = static_cast<uint8_t>(train_mode_);
+      record.maximum_distance     = maximum_distance_;
+      record.number_of_matchables = matchables_.size();
+      record.image_identifier =
+        matchables_.empty() ? image_identifier_ : matchables_.front()->objects.begin()->first;
+      _buffer.resize(sizeof(Record) + matchables_.size() * entry_size);
+      char* entry = _buffer.data() + sizeof(Record);
+      for (const Matchable* matchable : matchables_) {
+        std::memcpy(entry, &matchable->descriptor, Matchable::raw_descriptor_size_bytes);
+        std::memcpy(entry + Matchable::raw_descriptor_size_bytes,
+                    &matchable->objects.begin()->second,
+                    sizeof(ObjectType));
+        entry += entry_size;
+      }
+      std::memcpy(_buffer.data(), &record, sizeof(Record));
+      record.checksum = _getChecksum(_buffer.data(), _buffer.size());
+      std::memcpy(_buffer.data(), &record, sizeof(Record));
+
+      // ds make the record durable before the tree is modified
+      if (std::fwrite(_buffer.data(), 1, _buffer.size(), _journal) != _buffer.size() ||
+          std::fflush(_journal) != 0) {
+        std::cerr << "BinaryTreeJournal::_append|ERROR: unable to write record" << std::endl;
+        return false;
+      }
+      if (_sync_to_disk) {
+#ifdef _WIN32
+        _commit(_fileno(_journal));
+#else
+        fsync(fileno(_journal));
+#endif
+      }
+      ++_number_of_records;
+      return true;
+    }
+
+    //! @brief replays all valid records of the journal (if present)
+    //! @param[out] size_valid_ size of the valid journal prefix in bytes (0 if no journal)
+    bool _replay(uint64_t& size_valid_) {
+      size_valid_         = 0;
+      std::FILE* journal = std::fopen(_file_path_journal.c_str(), "rb");
+      if (!journal) {
+        return true;
+      }
+      Header header;
+      const Header header_expected;
+      if (std::fread(&header, sizeof(Header), 1, journal) != 1) {
+        // ds torn header - start over
+        std::fclose(journal);
+        return true;
+      }
+      if (std::memcmp(&header, &header_expected, sizeof(Header)) != 0) {
+        std::cerr << "BinaryTreeJournal::open|ERROR: incompatible journal: " << _file_path_journal
+                  << std::endl;
+        std::fclose(journal);
+        return false;
+      }
+      size_valid_ = sizeof(Header);
+
+      // ds replay records until the end or the first incomplete/corrupted one
+      Record record;
+      while (std::fread(&record, sizeof(Record), 1, journal) == 1) {
+        const bool has_matchables =
+          record.operation != Operation::Train && record.operation != Operation::Remove;
+        if (record.marker != record_marker ||
+            (record.number_of_matchables > 0) != has_matchables) {
+          break;
+        }
+        _buffer.resize(sizeof(Record) + record.number_of_matchables * entry_size);
+        if (std::fread(_buffer.data() + sizeof(Record),
+                       entry_size,
+                       record.number_of_matchables,
+                       journal) != record.number_of_matchables) {
+          break;
+        }
+        const uint64_t checksum = record.checksum;
+        record.checksum         = 0;
+        std::memcpy(_buffer.data(), &record, sizeof(Record));
+        if (_getChecksum(_buffer.data(), _buffer.size()) != checksum) {
+          break;
+        }
+        size_valid_ += _buffer.size();
+        ++_number_of_records;
+
+        // ds images already contained in the checkpoint are skipped
+        if (record.operation == Operation::Train) {
+          _tree.train(static_cast<SplittingStrategy>(record.train_mode));
+        } else if (record.operation == Operation::Remove) {
+          _tree.remove(record.image_identifier);
+        } else if (_tree.trainedIdentifiers().count(record.image_identifier) == 0) {
+          _apply(record);
+        }
+      }
+      std::fclose(journal);
+      return true;
+    }
+
+    //! @brief recreates the matchables of a record in the tree and integrates them
+    void _apply(const Record& record_) {
+      MatchableVector matchables;
+      matchables.reserve(record_.number_of_matchables);
+      _tree.reserveMatchables(record_.number_of_matchables);
+      const char* entry = _buffer.data() + sizeof(Record);
+      for (uint32_t index = 0; index < record_.number_of_matchables; ++index) {
+        Descriptor descriptor;
+        ObjectType object;
+        std::memcpy(&descriptor, entry, Matchable::raw_descriptor_size_bytes);
+        std::memcpy(&object, entry + Matchable::raw_descriptor_size_bytes, sizeof(ObjectType));
+        matchables.emplace_back(
+          _tree.allocateMatchable(object, descriptor, record_.image_identifier));
+        entry += entry_size;
+      }
+      const SplittingStrategy train_mode = static_cast<SplittingStrategy>(record_.train_mode);
+      if (record_.operation == Operation::MatchAndAdd) {
+        MatchVectorMap matches;
+        _tree.matchAndAdd(matchables, matches, record_.maximum_distance, train_mode);
+      } else {
+        _tree.add(matchables, train_mode);
+      }
+    }
+
+    //! @brief starts an empty journal (overwriting)
+    bool _createJournal() {
+      close();
+      _journal = std::fopen(_file_path_journal.c_str(), "wb");
+      if (!_journal) {
+        std::cerr << "BinaryTreeJournal::open|ERROR: unable to create journal: "
+                  << _file_path_journal << std::endl;
+        return false;
+      }
+      const Header header;
+      if (std::fwrite(&header, sizeof(Header), 1, _journal) != 1 || std::fflush(_journal) != 0) {
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    //! @brief cuts the journal file to size_ bytes
+    bool _truncate(const uint64_t& size_) const {
+#ifdef _WIN32
+      int file = -1;
+      if (_sopen_s(&file, _file_path_journal.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, 0) != 0) {
+        return false;
+      }
+      const bool success = _chsize_s(file, size_) == 0;
+      _close(file);
+      return success;
+#else
+      return truncate(_file_path_journal.c_str(), size_) == 0;
+#endif
+    }
+
+    //! @brief 64-bit FNV-1a variant processing 8 bytes per step
+    static uint64_t _getChecksum(const char* data_, const size_t& size_) {
+      uint64_t checksum    = 0xcbf29ce484222325ULL;
+      const size_t size_64 = size_ / 8 * 8;
+      for (size_t index = 0; index < size_64; index += 8) {
+        uint64_t word;
+        std::memcpy(&word, data_ + index, 8);
+        checksum = (checksum ^ word) * 0x100000001b3ULL;
+      }
+      for (size_t index = size_64; index < size_; ++index) {
+        checksum = (checksum ^ static_cast<uint8_t>(data_[index])) * 0x100000001b3ULL;
+      }
+      return checksum;
+    }
+
+    // ds attributes
+  protected:
+    //! @brief persisted tree
+    Tree& _tree;
+
+    //! @brief file locations
+    std::string _file_path_journal;
+    std::string _file_path_checkpoint;
+
+    //! @brief journal opened for appending
+    std::FILE* _journal = nullptr;
+    bool _sync_to_disk  = false;
+
+    //! @brief number of valid records in the journal
+    size_t _number_of_records = 0;
+
+    //! @brief record serialization buffer
+    std::vector<char> _buffer;
+  };
+
+  template <typename BinaryTreeType_>
+  constexpr uint32_t BinaryTreeJournal<BinaryTreeType_>::record_marker;
+  template <typename BinaryTreeType_>
+  constexpr size_t BinaryTreeJournal<BinaryTreeType_>::entry_size;
+
+} // namespace srrg_hbst
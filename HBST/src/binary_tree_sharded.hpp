@@ -0,0 +1,328 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+#include "binary_tree.hpp"
+
+namespace srrg_hbst {
+
+  //! @class time-sharded database: a sequence of trees partitioned by image identifier range -
+  //! new images are added to the active (last) shard, which is frozen once it holds
+  //! maximum_number_of_images_per_shard images; frozen shards are never modified by insertion and
+  //! can be compacted or persisted independently (e.g. shard(index).write) - queries fan out
+  //! across the shards on the thread pool and results are merged per image
+  //! @param BinaryTreeType_ tree type (class) of the shards
+  template <typename BinaryTreeType_>
+  class BinaryTreeSharded {
+    // ds exports
+  public:
+    using Tree            = BinaryTreeType_;
+    using Matchable       = typename Tree::Matchable;
+    using MatchableVector = typename Tree::MatchableVector;
+    using MatchVectorMap  = typename Tree::MatchVectorMap;
+    using ObjectType      = typename Tree::ObjectType;
+
+    // ds ctor/dtor
+  public:
+    //! @brief empty database with a single active shard
+    //! @param[in] maximum_number_of_images_per_shard_ images after which a shard is frozen
+    //! @param[in] thread_pool_ optional pool for fanning out over the shards (must not be set as
+    //! thread pool of the shards themselves)
+    BinaryTreeSharded(const size_t& maximum_number_of_images_per_shard_ = 100,
+                      std::shared_ptr<ThreadPool> thread_pool_       = nullptr) :
+      _maximum_number_of_images_per_shard(std::max(maximum_number_of_images_per_shard_, size_t(1))),
+      _thread_pool(thread_pool_) {
+      _shards.emplace_back(new Tree(0));
+    }
+
+    BinaryTreeSharded(const BinaryTreeSharded&) = delete;
+    BinaryTreeSharded& operator=(const BinaryTreeSharded&) = delete;
+
+    // ds access
+  public:
+    //! @brief total number of images in all shards
+    size_t size() const {
+      size_t number_of_images = 0;
+      for (const std::unique_ptr<Tree>& shard : _shards) {
+        number_of_images += shard->size();
+      }
+      return number_of_images;
+    }
+
+    //! @brief number of shards (including the active one)
+    size_t numberOfShards() const {
+      return _shards.size();
+    }
+
+    //! @brief shard access (the last shard is the active one, all others are frozen)
+    const Tree& shard(const size_t& index_) const {
+      return *_shards[index_];
+    }
+    Tree& shard(const size_t& index_) {
+      return *_shards[index_];
+    }
+
+    //! @brief shard receiving new images
+    Tree& activeShard() {
+      return *_shards.back();
+    }
+
+#ifdef SRRG_HBST_HAS_OPENCV
+    //! @brief creates a matchable vector in the matchable pool of the active shard (see
+    //! BinaryTree::allocateMatchables) - to be added before the next freeze
+    const MatchableVector allocateMatchables(const cv::Mat& descriptors_cv_,
+                                             const std::vector<ObjectType>& objects_,
+                                             const uint64_t& identifier_tree_ = 0) {
+      return activeShard().allocateMatchables(descriptors_cv_, objects_, identifier_tree_);
+    }
+#endif
+
+    //! @brief constructs a single matchable in the matchable pool of the active shard
+    template <typename... Arguments_>
+    Matchable* allocateMatchable(Arguments_&&... arguments_) {
+      return activeShard().allocateMatchable(std::forward<Arguments_>(arguments_)...);
+    }
+
+    //! @brief adds an image to the active shard (see BinaryTree::add), which is frozen if full
+    void add(const MatchableVector& matchables_,
+             const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      activeShard().add(matchables_, train_mode_);
+      _freezeIfFull(train_mode_);
+    }
+
+    //! @brief knn multi-matching function over all shards
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains all available matches for all
+    //! images below identifier_end_
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] identifier_end_ only images with lower identifiers are matched - shards that
+    //! only contain later images are skipped (e.g. to exclude the most recent images)
+    void match(const MatchableVector& matchables_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_ = 25,
+               const uint64_t& identifier_end_ = std::numeric_limits<uint64_t>::max()) const {
+      _match(matchables_query_, matches_, maximum_distance_matching_, false, 0, identifier_end_);
+    }
+
+    //! @brief knn multi-matching function over all shards for images with at least one match
+    //! @param[in] maximum_number_of_images_ only the images with the most matches are kept (0: all)
+    //! @param[in] identifier_end_ only images with lower identifiers are matched (see match)
+    void matchSparse(const MatchableVector& matchables_query_,
+                     MatchVectorMap& matches_,
+                     const uint32_t& maximum_distance_matching_ = 25,
+                     const size_t& maximum_number_of_images_   = 0,
+                     const uint64_t& identifier_end_ = std::numeric_limits<uint64_t>::max()) const {
+      _match(matchables_query_,
+             matches_,
+             maximum_distance_matching_,
+             true,
+             maximum_number_of_images_,
+             identifier_end_);
+    }
+
+    //! @brief matches an image against all shards while adding it to the active shard (see
+    //! BinaryTree::matchAndAdd) - the frozen shards are queried concurrently
+    void matchAndAdd(const MatchableVector& matchables_,
+                     MatchVectorMap& matches_,
+                     const uint32_t maximum_distance_matching_ = 25,
+                     const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
+      _matchAndAdd(matchables_, matches_, maximum_distance_matching_, train_mode_, false, 0);
+    }
+
+    //! @brief sparse variant of matchAndAdd: matches_ only contains the images with matches
+    //! @param[in] maximum_number_of_images_ only the images with the most matches are kept (0: all)
+    void matchAndAddSparse(const MatchableVector& matchables_,
+                           MatchVectorMap& matches_,
+                           const uint32_t maximum_distance_matching_ = 25,
+                           const size_t& maximum_number_of_images_   = 0,
+                           const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      _matchAndAdd(matchables_,
+                   matches_,
+                   maximum_distance_matching_,
+                   train_mode_,
+                   true,
+                   maximum_number_of_images_);
+    }
+
+    //! @brief removes an image from its shard (see BinaryTree::remove) - frozen shards that
+    //! become empty are dropped
+    //! @return true if the image was contained in a shard
+    bool remove(const uint64_t& image_identifier_) {
+      for (size_t index = 0; index < _shards.size(); ++index) {
+        if (_shards[index]->trainedIdentifiers().count(image_identifier_)) {
+          _shards[index]->remove(image_identifier_);
+          if (_shards[index]->size() == 0 && index + 1 < _shards.size()) {
+            _shards.erase(_shards.begin() + index);
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    //! @brief freezes the active shard (pending matchables are trained) and opens a new one -
+    //! no effect if the active shard is empty
+    void freeze(const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      if (activeShard().size() == 0) {
+        return;
+      }
+      activeShard().train(train_mode_);
+      _shards.emplace_back(new Tree(_shards.size()));
+    }
+
+    //! @brief clears all shards, leaving a single empty active shard
+    void clear(const bool& delete_matchables_ = true) {
+      if (!delete_matchables_) {
+        for (std::unique_ptr<Tree>& shard : _shards) {
+          shard->clear(false);
+        }
+      }
+      _shards.clear();
+      _shards.emplace_back(new Tree(0));
+    }
+
+    //! @brief thread pool used for fanning out over the shards (nullptr if serial)
+    void setThreadPool(std::shared_ptr<ThreadPool> thread_pool_) {
+      _thread_pool = thread_pool_;
+    }
+
+    // ds helpers
+  protected:
+    //! @brief freezes the active shard once it reached the maximum number of images
+    void _freezeIfFull(const SplittingStrategy& train_mode_) {
+      if (activeShard().size() >= _maximum_number_of_images_per_shard) {
+        freeze(train_mode_);
+      }
+    }
+
+    //! @brief indices of the shards containing images below identifier_end_
+    std::vector<size_t> _getShardsToQuery(const uint64_t& identifier_end_) const {
+      std::vector<size_t> indices;
+      indices.reserve(_shards.size());
+      for (size_t index = 0; index < _shards.size(); ++index) {
+        const std::set<uint64_t>& identifiers = _shards[index]->trainedIdentifiers();
+        if (!identifiers.empty() && *identifiers.begin() < identifier_end_) {
+          indices.push_back(index);
+        }
+      }
+      return indices;
+    }
+
+    //! @brief calls function_(index) for all indices in [0, number_of_indices_) - one task per
+    //! index on the thread pool (if set)
+    template <typename Function_>
+    void _forEachShard(const size_t& number_of_indices_, Function_ function_) const {
+      if (!_thread_pool || _thread_pool->size() == 1 || number_of_indices_ <= 1) {
+        for (size_t index = 0; index < number_of_indices_; ++index) {
+          function_(index);
+        }
+        return;
+      }
+      _thread_pool->run(number_of_indices_, function_);
+    }
+
+    //! @brief moves the per shard results into matches_ (shards hold disjoint images)
+    static void _mergeMatches(std::vector<MatchVectorMap>& matches_per_shard_,
+                              MatchVectorMap& matches_,
+                              const size_t& maximum_number_of_images_) {
+      for (MatchVectorMap& matches : matches_per_shard_) {
+        for (typename MatchVectorMap::value_type& matches_per_image : matches) {
+          matches_[matches_per_image.first].swap(matches_per_image.second);
+        }
+      }
+      Tree::keepBestImages(matches_, maximum_number_of_images_);
+    }
+
+    //! @brief fans a query out over the shards with images below identifier_end_
+    void _match(const MatchableVector& matchables_query_,
+                MatchVectorMap& matches_,
+                const uint32_t& maximum_distance_matching_,
+                const bool& sparse_,
+                const size_t& maximum_number_of_images_,
+                const uint64_t& identifier_end_) const {
+      matches_.clear();
+      const std::vector<size_t> indices(_getShardsToQuery(identifier_end_));
+      std::vector<MatchVectorMap> matches_per_shard(indices.size());
+      _forEachShard(indices.size(), [&](const size_t& index) {
+        const Tree& shard = *_shards[indices[index]];
+        if (sparse_) {
+          shard.matchSparse(matchables_query_,
+                            matches_per_shard[index],
+                            maximum_distance_matching_,
+                            maximum_number_of_images_);
+        } else {
+          shard.match(matchables_query_, matches_per_shard[index], maximum_distance_matching_);
+        }
+
+        // ds drop the later images of a shard straddling the identifier bound
+        if (*shard.trainedIdentifiers().rbegin() >= identifier_end_) {
+          MatchVectorMap& matches = matches_per_shard[index];
+          for (auto iterator = matches.begin(); iterator != matches.end();) {
+            iterator = iterator->first >= identifier_end_ ? matches.erase(iterator) : ++iterator;
+          }
+        }
+      });
+      _mergeMatches(matches_per_shard, matches_, maximum_number_of_images_);
+    }
+
+    //! @brief queries the frozen shards concurrently to the matchAndAdd on the active shard -
+    //! with descriptor merging the active shard is processed afterwards, since merged query
+    //! matchables are released during its insertion
+    void _matchAndAdd(const MatchableVector& matchables_,
+                      MatchVectorMap& matches_,
+                      const uint32_t& maximum_distance_matching_,
+                      const SplittingStrategy& train_mode_,
+                      const bool& sparse_,
+                      const size_t& maximum_number_of_images_) {
+      matches_.clear();
+      const size_t index_active = _shards.size() - 1;
+      std::vector<MatchVectorMap> matches_per_shard(_shards.size());
+      const auto match_and_add = [&](const size_t& index) {
+        Tree& shard = *_shards[index];
+        if (index == index_active) {
+          if (sparse_) {
+            shard.matchAndAddSparse(matchables_,
+                                    matches_per_shard[index],
+                                    maximum_distance_matching_,
+                                    maximum_number_of_images_,
+                                    train_mode_);
+          } else {
+            shard.matchAndAdd(
+              matchables_, matches_per_shard[index], maximum_distance_matching_, train_mode_);
+          }
+        } else if (sparse_) {
+          shard.matchSparse(matchables_,
+                            matches_per_shard[index],
+                            maximum_distance_matching_,
+                            maximum_number_of_images_);
+        } else {
+          shard.match(matchables_, matches_per_shard[index], maximum_distance_matching_);
+        }
+      };
+#ifdef SRRG_MERGE_DESCRIPTORS
+      _forEachShard(index_active, match_and_add);
+      match_and_add(index_active);
+#else
+      _forEachShard(_shards.size(), match_and_add);
+#endif
+      _mergeMatches(matches_per_shard, matches_, maximum_number_of_images_);
+      _freezeIfFull(train_mode_);
+    }
+
+    // ds attributes
+  protected:
+    //! @brief shards in order of insertion (the last one is active)
+    std::vector<std::unique_ptr<Tree>> _shards;
+
+    //! @brief images after which the active shard is frozen
+    size_t _maximum_number_of_images_per_shard;
+
+    //! @brief optional thread pool for fanning out over the shards
+    std::shared_ptr<ThreadPool> _thread_pool;
+  };
+
+} // namespace srrg_hbst
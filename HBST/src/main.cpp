@@ -68,7 +68,7 @@ int32_t main() {
 
 		// ds obtain linked matchables
 		const HBSTTree::MatchableVector matchables(
-			HBSTTree::getMatchables(descriptors, keypoints, number_of_processed_images));
+			tree.allocateMatchables(descriptors, keypoints, number_of_processed_images));
 
 		// ds obtain matches against all inserted matchables (i.e. images so far) and integrate them
 		// simultaneously
@@ -81,7 +81,9 @@ int32_t main() {
 		//const double processing_duration_seconds = std::chrono::duration<double>(std::chrono::system_clock::now() - time_begin).count();
 
 
-		tree.matchAndAdd(matchables, matches_per_image, maximum_descriptor_distance);
+		// ds only images with matches are returned (all of them: the most similar images are the
+		// most recent ones, which are excluded from loop closing below)
+		tree.matchAndAddSparse(matchables, matches_per_image, maximum_descriptor_distance);
 		const double processing_duration_seconds = std::chrono::duration<double>(std::chrono::system_clock::now() - time_begin).count();
 		number_of_stored_descriptors += descriptors.rows;
 		++number_of_processed_images;
@@ -96,13 +98,16 @@ int32_t main() {
 			cv::circle(image_display, keypoint.pt, 2, cv::Scalar(255, 0, 0), -1);
 		}
 		*/
-		// ds for each match vector (i.e. matching results for each past image) of ALL past images
+		// ds for each match vector (i.e. matching results for each past image with matches)
 		if (number_of_processed_images > number_of_images_interspace) {
-			for (uint32_t image_number_reference = 0;
-				image_number_reference < number_of_processed_images - number_of_images_interspace - 1;
-				++image_number_reference) {
+			for (const auto& matches : matches_per_image) {
+				const uint64_t image_number_reference = matches.first;
+				if (image_number_reference >= number_of_processed_images - number_of_images_interspace - 1) {
+					continue;
+				}
+
 				// ds if we have sufficient matches
-				const uint32_t number_of_matches = matches_per_image[image_number_reference].size();
+				const uint32_t number_of_matches = matches.second.size();
 				if (number_of_matches > 30) {
 					// ds draw matched descriptors
 					//fout << "t1=" << number_of_processed_images << '\t' << "coincides with t2=" << image_number_reference << "\n";
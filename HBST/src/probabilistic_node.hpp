@@ -1,176 +1,181 @@
 #pragma once
+#include <Eigen/Core>
+
+#include "binary_node.hpp"
 #include "probabilistic_matchable.hpp"
-#include "srrg_hbst/types/binary_node.hpp"
 
 namespace srrg_hbst {
 
-  // ds Node template specialization for descriptors of type: CDescriptorBinaryProbabilistic
-  template <typename ProbabilisticMatchableType_, typename real_precision_ = double>
-  class ProbabilisticNode : public BinaryNode<ProbabilisticMatchableType_, real_precision_> {
+  //! @class node for descriptors with bit probabilities: a node is split on the available bit
+  //! with the highest probability variance. The statistics of the matchables are gathered once
+  //! into a contiguous matrix (one column per matchable) which is partitioned column-wise into
+  //! the leafs, hence the scattered matchables are only read at the root
+  //! @param ProbabilisticMatchableType_ matchable type carrying bit_probabilities
+  template <typename ProbabilisticMatchableType_, typename real_type_ = double>
+  class ProbabilisticNode : public BinaryNode<ProbabilisticMatchableType_, real_type_> {
     // ds readability
-    using Node = ProbabilisticNode<ProbabilisticMatchableType_, real_precision_>;
+    using Node = ProbabilisticNode<ProbabilisticMatchableType_, real_type_>;
 
-    // ds template forwarding
+    // ds exports
   public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-
-    typedef BinaryNode<ProbabilisticMatchableType_, real_precision_> BaseNode;
-    typedef ProbabilisticMatchableType_ Matchable;
-    typedef typename Matchable::Descriptor Descriptor;
-    typedef std::vector<Matchable*> MatchableVector;
-    typedef real_precision_ precision;
-    typedef BinaryMatch<Matchable, precision> Match;
-    typedef typename Matchable::BitStatisticsVector BitStatisticsVector;
+    using BaseNode            = BinaryNode<ProbabilisticMatchableType_, real_type_>;
+    using Matchable           = ProbabilisticMatchableType_;
+    using MatchableVector     = typename BaseNode::MatchableVector;
+    using Descriptor          = typename Matchable::Descriptor;
+    using real_type           = real_type_;
+    using Match               = typename BaseNode::Match;
+    using BitStatisticsVector = typename Matchable::BitStatisticsVector;
+    using statistics_type     = typename BitStatisticsVector::Scalar;
+
+    //! @brief contiguous bit statistics of a node (column-major, one column per matchable)
+    using BitStatisticsMatrix =
+      Eigen::Matrix<statistics_type, Matchable::descriptor_size_bits, Eigen::Dynamic>;
 
     // ds ctor/dtor
   public:
-    // ds access only through this constructor: no mask provided
+    //! @brief builds the tree over matchables_ (the split bits are selected by variance, the
+    //! train mode only exists for interface compatibility)
     ProbabilisticNode(const MatchableVector& matchables_,
                       const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
-      Node(0, matchables_, Descriptor().set(), train_mode_) {
-    }
-
-    // ds the default constructor is triggered by subclasses - the responsibility of attribute
-    // initialization is left to the subclass ds the default constructor is required, since we do not
-    // want to trigger the automatic leaf spawning of the baseclass in a subclass
-    ProbabilisticNode() {
+      ProbabilisticNode(nullptr, 0, matchables_, Descriptor().set()) {
+      spawnLeafs(train_mode_);
     }
 
-    // ds destructor: nothing to do (the leafs will be freed by the tree)
+    // ds destructor: nothing to do (the leafs are freed by the base)
     virtual ~ProbabilisticNode() {
     }
 
     // ds access
   public:
-    // ds implementing the new spawn leafs function to handle the modified descriptors
+    //! @brief splits this leaf recursively, gathering the bit statistics of its matchables
     virtual const bool spawnLeafs(const SplittingStrategy& train_mode_) override {
-      // ds buffer number of descriptors
-      const uint64_t number_of_matchables = this->matchables.size();
-
-      // ds if there are at least 2 descriptors (minimal split)
-      if (1 < number_of_matchables) {
-        assert(!this->has_leafs);
+      return _spawnLeafs(_getBitProbabilities(this->matchables), train_mode_);
+    }
 
-        // ds affirm initial situation
-        this->index_split_bit            = -1;
-        this->number_of_on_bits_total    = 0;
-        this->partitioning               = 1;
-        real_precision_ variance_maximum = 0;
+    // ds inner constructors (used for recursive tree building)
+  protected:
+    // ds only internally called: unsplit leaf (leafs are spawned by the caller)
+    ProbabilisticNode(Node* parent_,
+                      const uint64_t& depth_,
+                      const MatchableVector& matchables_,
+                      Descriptor bit_mask_) :
+      BaseNode(parent_, depth_, matchables_, bit_mask_) {
+    }
 
-        // ds variance computation statistics
-        BitStatisticsVector bit_probabilities_accumulated(BitStatisticsVector::Zero());
+    // ds helpers
+  protected:
+    //! @brief splits this leaf on the available bit with maximum probability variance
+    //! @param[in] bit_probabilities_ statistics of the leaf matchables in leaf order (consumed,
+    //! released before descending)
+    //! @param[in] train_mode_ forwarded to the leafs
+    //! @return true if leafs were spawned
+    const bool _spawnLeafs(BitStatisticsMatrix&& bit_probabilities_,
+                           const SplittingStrategy& train_mode_) {
+      assert(!this->has_leafs);
+      const uint64_t number_of_matchables = this->matchables.size();
+      assert(static_cast<uint64_t>(bit_probabilities_.cols()) == number_of_matchables);
+      this->_header.number_of_matchables_compressed = number_of_matchables;
 
-        // ds for all descriptors in this node (use base class descriptor)
-        for (const Matchable* matchable : this->matchables) {
-          // ds reduce accumulated probabilities (cast to the active descriptor)
-          bit_probabilities_accumulated += matchable->bit_probabilities;
+      // ds exit if there is no minimal split or the maximum depth is reached
+      if (number_of_matchables < 2 || this->_header.depth == BaseNode::maximum_depth) {
+        return false;
+      }
+      this->_flushSetBitCounts();
+
+      // ds affirm initial situation
+      this->index_split_bit         = -1;
+      this->number_of_on_bits_total = 0;
+      this->partitioning            = 1;
+
+      // ds single pass variance over all bits at once: the column sums and squared sums are
+      // ds computed relative to the first column (shifted data), which keeps constant bits at zero
+      // ds variance despite the reduced precision
+      const BitStatisticsVector shift(bit_probabilities_.col(0));
+      BitStatisticsVector sums(BitStatisticsVector::Zero());
+      BitStatisticsVector sums_squared(BitStatisticsVector::Zero());
+      for (Eigen::Index index = 1; index < bit_probabilities_.cols(); ++index) {
+        const BitStatisticsVector delta(bit_probabilities_.col(index) - shift);
+        sums += delta;
+        sums_squared += delta.cwiseAbs2();
+      }
+      const statistics_type normalizer = statistics_type(1) / number_of_matchables;
+      const BitStatisticsVector variances(sums_squared * normalizer -
+                                          (sums * normalizer).cwiseAbs2());
+
+      // ds select the available bit with maximum variance
+      statistics_type variance_maximum = 0;
+      for (uint32_t index_bit = 0; index_bit < Matchable::descriptor_size_bits; ++index_bit) {
+        if (this->bit_mask[index_bit] && variance_maximum < variances[index_bit]) {
+          variance_maximum      = variances[index_bit];
+          this->index_split_bit = index_bit;
         }
+      }
+      if (this->index_split_bit == -1) {
+        return false;
+      }
 
-        // ds get average
-        const BitStatisticsVector bit_probabilities_mean(bit_probabilities_accumulated /
-                                                         number_of_matchables);
-
-        // ds compute variance
-        for (uint32_t index_bit = 0; index_bit < Matchable::descriptor_size_bits; ++index_bit) {
-          // ds if this index is available in the mask
-          if (this->bit_mask[index_bit]) {
-            // ds buffers
-            real_precision_ variance_current = 0.0;
-
-            // ds for all descriptors in this node
-            for (const Matchable* matchable : this->matchables) {
-              // ds update variance value
-              const real_precision_ delta =
-                matchable->bit_probabilities[index_bit] - bit_probabilities_mean[index_bit];
-              variance_current += delta * delta;
-            }
-
-            // ds average
-            variance_current /= number_of_matchables;
-
-            // ds check if better
-            if (variance_maximum < variance_current) {
-              variance_maximum      = variance_current;
-              this->index_split_bit = index_bit;
-            }
-          }
-        }
+      // ds compute distance for this index (0.0 is perfect) and check if both leafs get data
+      this->partitioning = std::fabs(0.5 - this->_getSetBitFraction(this->index_split_bit));
+      this->number_of_on_bits_total = this->_getNumberOfSetBits(this->index_split_bit);
+      if (this->number_of_on_bits_total == 0 || 0.5 <= this->partitioning) {
+        return false;
+      }
 
-        // ds if best was found - we can spawn leaves
-        if (-1 != this->index_split_bit) {
-          // ds compute distance for this index (0.0 is perfect)
-          this->partitioning = std::fabs(
-            0.5 - this->_getSetBitFraction(
-                    this->index_split_bit, this->matchables, this->number_of_on_bits_total));
-
-          // ds check if we have enough data to split
-          if (0 < this->number_of_on_bits_total && 0.5 > this->partitioning) {
-            // ds enabled
-            this->has_leafs = true;
-
-            // ds get a mask copy
-            Descriptor mask(this->bit_mask);
-
-            // ds update mask for leafs
-            mask[this->index_split_bit] = 0;
-
-            // ds first we have to split the descriptors by the found index - preallocate vectors
-            // since we know how many ones we have
-            MatchableVector matchables_leaf_ones;
-            matchables_leaf_ones.reserve(this->number_of_on_bits_total);
-            MatchableVector matchables_leaf_zeroes;
-            matchables_leaf_zeroes.reserve(number_of_matchables - this->number_of_on_bits_total);
-
-            // ds loop over all descriptors and assing them to the new vectors
-            for (Matchable* matchable : this->matchables) {
-              // ds check if split bit is set
-              if (matchable->descriptor[this->index_split_bit]) {
-                matchables_leaf_ones.push_back(matchable);
-              } else {
-                matchables_leaf_zeroes.push_back(matchable);
-              }
-            }
-
-            // ds if there are elements for leaves
-            assert(0 < matchables_leaf_ones.size());
-            this->right = new Node(this->depth + 1, matchables_leaf_ones, mask, train_mode_);
-
-            assert(0 < matchables_leaf_zeroes.size());
-            this->left = new Node(this->depth + 1, matchables_leaf_zeroes, mask, train_mode_);
-
-            // ds worked
-            return true;
-          } else {
-            // ds split failed
-            return false;
-          }
+      // ds update mask for leafs
+      Descriptor bit_mask_leafs(this->bit_mask);
+      bit_mask_leafs[this->index_split_bit] = 0;
+
+      // ds partition matchables and their statistics columns by the split bit (read from the
+      // ds contiguous leaf storage)
+      const uint64_t number_of_zeros = number_of_matchables - this->number_of_on_bits_total;
+      MatchableVector matchables_ones(this->number_of_on_bits_total);
+      MatchableVector matchables_zeros(number_of_zeros);
+      BitStatisticsMatrix bit_probabilities_ones(Matchable::descriptor_size_bits,
+                                                 this->number_of_on_bits_total);
+      BitStatisticsMatrix bit_probabilities_zeros(Matchable::descriptor_size_bits,
+                                                  number_of_zeros);
+      const uint32_t index_split_word = this->index_split_bit / 64;
+      const uint64_t split_bit        = uint64_t(1) << (this->index_split_bit % 64);
+      uint64_t index_ones             = 0;
+      uint64_t index_zeros            = 0;
+      for (uint64_t index = 0; index < number_of_matchables; ++index) {
+        if (this->descriptor_words[index * BaseNode::descriptor_size_words + index_split_word] &
+            split_bit) {
+          matchables_ones[index_ones]            = this->matchables[index];
+          bit_probabilities_ones.col(index_ones) = bit_probabilities_.col(index);
+          ++index_ones;
         } else {
-          // ds split failed
-          return false;
+          matchables_zeros[index_zeros]            = this->matchables[index];
+          bit_probabilities_zeros.col(index_zeros) = bit_probabilities_.col(index);
+          ++index_zeros;
         }
-      } else {
-        // ds not enough descriptors to split
-        return false;
       }
+      assert(index_ones == this->number_of_on_bits_total);
+      assert(index_zeros == number_of_zeros);
+      bit_probabilities_.resize(Matchable::descriptor_size_bits, 0);
+
+      // ds this leaf becomes a regular node and hence does not carry matchables
+      this->has_leafs = true;
+      this->_clearLeafStorage();
+      this->_header.number_of_matchables_compressed = 0;
+
+      // ds build the subtrees
+      Node* leaf_ones = new Node(this, this->_header.depth + 1, matchables_ones, bit_mask_leafs);
+      leaf_ones->_spawnLeafs(std::move(bit_probabilities_ones), train_mode_);
+      this->right = leaf_ones;
+      Node* leaf_zeros = new Node(this, this->_header.depth + 1, matchables_zeros, bit_mask_leafs);
+      leaf_zeros->_spawnLeafs(std::move(bit_probabilities_zeros), train_mode_);
+      this->left = leaf_zeros;
+      return true;
     }
 
-    // ds inner constructors (used for recursive tree building)
-  protected:
-    // ds only internally called: without split order
-    ProbabilisticNode(const uint64_t& depth_,
-                      const MatchableVector& matchables_,
-                      Descriptor bit_mask_,
-                      const SplittingStrategy& train_mode_) {
-      // ds initialize subclass fields
-      this->depth      = depth_;
-      this->matchables = matchables_;
-      this->has_leafs  = false;
-      this->bit_mask   = bit_mask_;
-      this->right      = 0;
-      this->left       = 0;
-
-      // ds call recursive leaf spawner
-      spawnLeafs(train_mode_);
+    //! @brief gathers the bit probabilities of matchables_ into a contiguous matrix
+    static BitStatisticsMatrix _getBitProbabilities(const MatchableVector& matchables_) {
+      BitStatisticsMatrix bit_probabilities(Matchable::descriptor_size_bits, matchables_.size());
+      for (size_t index = 0; index < matchables_.size(); ++index) {
+        bit_probabilities.col(index) = matchables_[index]->bit_probabilities;
+      }
+      return bit_probabilities;
     }
   };
 } // namespace srrg_hbst
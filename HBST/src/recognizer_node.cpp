@@ -137,7 +137,7 @@ void callbackImage(const sensor_msgs::ImageConstPtr& image_) {
 
     // ds obtain linked matchables
     const Tree::MatchableVector matchables(
-      Tree::getMatchables(descriptors, keypoints, number_of_processed_images));
+      tree.allocateMatchables(descriptors, keypoints, number_of_processed_images));
 
     // ds obtain matches against all inserted matchables (i.e. images so far) and integrate them
     // simultaneously
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <thread>
 
+#include "srrg_hbst/types/binary_tree_forest.hpp"
+#include "srrg_hbst/types/probabilistic_node.hpp"
 #include "test_fixture.hpp"
 
 using namespace srrg_hbst;
@@ -93,3 +101,893 @@ TEST_F(HBST, SearchNoisy) {
   database.clear(true);
   ASSERT_EQ(database.size(), static_cast<size_t>(0));
 }
+
+TEST_F(HBST, SearchIdenticalPooled) {
+  // ds populate the database with copies of the training matchables allocated in its pool
+  Tree database;
+  std::vector<Tree::MatchableVector> matchables_pooled_per_image;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_pooled;
+    matchables_pooled.reserve(matchables_train.size());
+    database.reserveMatchables(matchables_train.size());
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      matchables_pooled.emplace_back(database.allocateMatchable(
+        matchable_train->objects.begin()->second,
+        matchable_train->descriptor,
+        matchable_train->objects.begin()->first));
+      delete matchable_train;
+    }
+
+    // ds matchables of one image are contiguous
+    ASSERT_EQ(matchables_pooled.back() - matchables_pooled.front(),
+              static_cast<std::ptrdiff_t>(matchables_pooled.size() - 1));
+    database.add(matchables_pooled, SplittingStrategy::SplitEven);
+    matchables_pooled_per_image.emplace_back(matchables_pooled);
+  }
+  matchables_train_per_image.clear();
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+  ASSERT_EQ(database.getMatchablePool().size(), static_cast<size_t>(10000));
+
+  // ds query database with identical matchables
+  for (size_t i = 0; i < 10; ++i) {
+    const Tree::MatchableVector& matchables_query = matchables_pooled_per_image[i];
+    Tree::MatchVectorMap matches;
+    database.match(matchables_query, matches, 1);
+    ASSERT_EQ(matches.size(), static_cast<size_t>(10));
+    ASSERT_EQ(matches[i].size(), matchables_query.size());
+  }
+
+  // ds clear database - releasing all pooled matchables at once
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+  ASSERT_EQ(database.getMatchablePool().size(), static_cast<size_t>(0));
+}
+
+// ds no fixture: the kernels do not need a tree (the fixture matchables would never be freed)
+TEST(HBSTDistance, Kernels) {
+  std::mt19937 random_number_generator(0);
+
+  // ds restores the automatic kernel selection, also if an assertion ends the test early
+  struct KernelGuard {
+    ~KernelGuard() {
+      HammingKernelDispatch<>::reset();
+    }
+  } kernel_guard;
+
+  // ds all kernels supported by this CPU must agree bit by bit with the bitset count
+  const std::vector<HammingKernel> kernels = {HammingKernel::Portable,
+                                              HammingKernel::Popcount,
+                                              HammingKernel::AVX2,
+                                              HammingKernel::AVX512};
+  for (const HammingKernel& kernel : kernels) {
+    if (!HammingKernelDispatch<>::set(kernel)) {
+      continue;
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+      std::bitset<128> a_128, b_128;
+      std::bitset<256> a_256, b_256;
+      std::bitset<512> a_512, b_512;
+      for (size_t j = 0; j < 512; ++j) {
+        a_512[j] = random_number_generator() % 2;
+        b_512[j] = random_number_generator() % 2;
+        if (j < 256) {
+          a_256[j] = a_512[j];
+          b_256[j] = b_512[j];
+        }
+        if (j < 128) {
+          a_128[j] = a_512[j];
+          b_128[j] = b_512[j];
+        }
+      }
+      ASSERT_EQ(BinaryMatchable128<size_t>::getDistance(a_128, b_128), (a_128 ^ b_128).count());
+      ASSERT_EQ(BinaryMatchable256<size_t>::getDistance(a_256, b_256), (a_256 ^ b_256).count());
+      ASSERT_EQ(BinaryMatchable512<size_t>::getDistance(a_512, b_512), (a_512 ^ b_512).count());
+    }
+
+    // ds thresholded block distances are exact below the bound and at least the bound otherwise
+    constexpr uint32_t number_of_words      = BinaryMatchable512<size_t>::descriptor_size_words;
+    constexpr uint32_t number_of_references = 300;
+    std::vector<uint64_t> words((number_of_references + 1) * number_of_words);
+    for (uint64_t& word : words) {
+      word = (uint64_t(random_number_generator()) << 32) | random_number_generator();
+    }
+    const uint64_t* query      = words.data();
+    const uint64_t* references = words.data() + number_of_words;
+    std::vector<uint32_t> distances(number_of_references);
+    std::vector<uint32_t> distances_bounded(number_of_references);
+    getHammingDistances<number_of_words>(
+      query, references, number_of_references, distances.data());
+    for (const uint32_t maximum_distance : {0, 25, 240, 256, 513}) {
+      getHammingDistancesBounded<number_of_words>(
+        query, references, number_of_references, maximum_distance, distances_bounded.data());
+      for (uint32_t j = 0; j < number_of_references; ++j) {
+        if (distances[j] < maximum_distance) {
+          ASSERT_EQ(distances_bounded[j], distances[j]);
+        } else {
+          ASSERT_GE(distances_bounded[j], maximum_distance);
+        }
+      }
+    }
+  }
+}
+
+// ds no fixture: the probabilistic node is built over its own matchables
+TEST(HBSTProbabilistic, SplitByVariance) {
+  using Matchable       = ProbabilisticMatchable<size_t, 256>;
+  using Node            = ProbabilisticNode<Matchable>;
+  using BaseNode        = Node::BaseNode;
+  using MatchableVector = Node::MatchableVector;
+  std::mt19937 random_number_generator(0);
+  std::uniform_real_distribution<float> uniform(0, 1);
+
+  // ds bit probabilities spread around 0.5 by a different amount for each bit
+  std::vector<float> spreads(256);
+  for (size_t index_bit = 0; index_bit < spreads.size(); ++index_bit) {
+    spreads[index_bit] = 0.05 + 0.9 * ((index_bit * 97) % 256) / 255.0;
+  }
+  // ds the node does not own its matchables
+  MatchableVector matchables;
+  std::vector<std::unique_ptr<Matchable>> matchables_owned;
+  for (size_t index = 0; index < 1000; ++index) {
+    Matchable::Descriptor descriptor;
+    Matchable::BitStatisticsVector bit_probabilities;
+    for (size_t index_bit = 0; index_bit < 256; ++index_bit) {
+      descriptor[index_bit]        = random_number_generator() % 2;
+      bit_probabilities[index_bit] =
+        0.5 + spreads[index_bit] * (uniform(random_number_generator) - 0.5);
+    }
+    matchables_owned.emplace_back(new Matchable(
+      index, descriptor, bit_probabilities, Matchable::BitStatisticsVector::Zero()));
+    matchables.push_back(matchables_owned.back().get());
+  }
+  const Node root(matchables);
+  ASSERT_TRUE(root.hasLeafs());
+
+  // ds every descriptor is reachable by descending on the split bits
+  for (const Matchable* matchable : matchables) {
+    const BaseNode* node = &root;
+    while (node->hasLeafs()) {
+      node = matchable->descriptor[node->indexSplitBit()] ? node->right.load() : node->left.load();
+      ASSERT_NE(node, nullptr);
+    }
+    const MatchableVector& matchables_leaf = node->getMatchables();
+    ASSERT_NE(std::find(matchables_leaf.begin(), matchables_leaf.end(), matchable),
+              matchables_leaf.end());
+  }
+
+  // ds the root is split on the bit with maximum probability variance (two pass reference)
+  std::vector<double> variances(256, 0);
+  for (size_t index_bit = 0; index_bit < variances.size(); ++index_bit) {
+    double mean = 0;
+    for (const Matchable* matchable : matchables) {
+      mean += matchable->bit_probabilities[index_bit];
+    }
+    mean /= matchables.size();
+    for (const Matchable* matchable : matchables) {
+      const double deviation = matchable->bit_probabilities[index_bit] - mean;
+      variances[index_bit] += deviation * deviation;
+    }
+    variances[index_bit] /= matchables.size();
+  }
+  const size_t index_bit_maximum =
+    std::max_element(variances.begin(), variances.end()) - variances.begin();
+  ASSERT_EQ(root.indexSplitBit(), static_cast<int32_t>(index_bit_maximum));
+}
+
+TEST_F(HBST, SearchSparse) {
+  // ds populate the database
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+
+  // ds sparse matching only reports images with matches - identical to the dense result
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  Tree::MatchVectorMap matches_dense;
+  Tree::MatchVectorMap matches_sparse;
+  database.match(matchables_query, matches_dense, 25);
+  database.matchSparse(matchables_query, matches_sparse, 25);
+  ASSERT_EQ(matches_dense.size(), static_cast<size_t>(10));
+  size_t number_of_matched_images = 0;
+  for (const auto& matches : matches_dense) {
+    if (matches.second.empty()) {
+      ASSERT_EQ(matches_sparse.count(matches.first), static_cast<size_t>(0));
+    } else {
+      ASSERT_EQ(matches_sparse.at(matches.first).size(), matches.second.size());
+      ++number_of_matched_images;
+    }
+  }
+  ASSERT_EQ(matches_sparse.size(), number_of_matched_images);
+  ASSERT_GT(number_of_matched_images, static_cast<size_t>(3));
+
+  // ds top 3 images by number of matches
+  Tree::MatchVectorMap matches_best;
+  database.matchSparse(matchables_query, matches_best, 25, 3);
+  ASSERT_EQ(matches_best.size(), static_cast<size_t>(3));
+  for (const auto& matches : matches_sparse) {
+    if (matches_best.count(matches.first) == 0) {
+      for (const auto& matches_kept : matches_best) {
+        ASSERT_GE(matches_kept.second.size(), matches.second.size());
+      }
+    }
+  }
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, SearchParallel) {
+  // ds populate the database
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+
+  // ds serial results
+  Tree::MatchVectorMap matches_serial;
+  Tree::MatchVector matches_best_serial;
+  Tree::MatchVector matches_lazy_serial;
+  database.match(matchables_query, matches_serial, 25);
+  database.match(matchables_query, matches_best_serial, 25);
+  database.matchLazy(matchables_query, matches_lazy_serial, 25);
+  const uint64_t number_of_matches_serial = database.getNumberOfMatches(matchables_query, 25);
+  const Tree::ScoreVector scores_serial   = database.getScorePerImage(matchables_query, false, 25);
+
+  // ds parallel results must be identical (including the order of matches)
+  database.setThreadPool(std::make_shared<ThreadPool>(4));
+  Tree::MatchVectorMap matches_parallel;
+  Tree::MatchVector matches_best_parallel;
+  Tree::MatchVector matches_lazy_parallel;
+  database.match(matchables_query, matches_parallel, 25);
+  database.match(matchables_query, matches_best_parallel, 25);
+  database.matchLazy(matchables_query, matches_lazy_parallel, 25);
+  ASSERT_EQ(database.getNumberOfMatches(matchables_query, 25), number_of_matches_serial);
+  const Tree::ScoreVector scores_parallel = database.getScorePerImage(matchables_query, false, 25);
+
+  ASSERT_EQ(matches_parallel.size(), matches_serial.size());
+  for (const auto& matches : matches_serial) {
+    const Tree::MatchVector& matches_image = matches_parallel.at(matches.first);
+    ASSERT_EQ(matches_image.size(), matches.second.size());
+    for (size_t j = 0; j < matches_image.size(); ++j) {
+      ASSERT_EQ(matches_image[j].matchable_query, matches.second[j].matchable_query);
+      ASSERT_EQ(matches_image[j].matchable_references, matches.second[j].matchable_references);
+      ASSERT_EQ(matches_image[j].distance, matches.second[j].distance);
+    }
+  }
+  ASSERT_EQ(matches_best_parallel.size(), matches_best_serial.size());
+  for (size_t j = 0; j < matches_best_parallel.size(); ++j) {
+    ASSERT_EQ(matches_best_parallel[j].matchable_query, matches_best_serial[j].matchable_query);
+    ASSERT_EQ(matches_best_parallel[j].distance, matches_best_serial[j].distance);
+  }
+  ASSERT_EQ(matches_lazy_parallel.size(), matches_lazy_serial.size());
+  for (size_t j = 0; j < matches_lazy_parallel.size(); ++j) {
+    ASSERT_EQ(matches_lazy_parallel[j].matchable_query, matches_lazy_serial[j].matchable_query);
+  }
+  ASSERT_EQ(scores_parallel.size(), scores_serial.size());
+  for (size_t j = 0; j < scores_parallel.size(); ++j) {
+    ASSERT_EQ(scores_parallel[j].identifier_reference, scores_serial[j].identifier_reference);
+    ASSERT_EQ(scores_parallel[j].number_of_matches, scores_serial[j].number_of_matches);
+  }
+
+  // ds partial selection of the best images (ties in favor of lower identifiers)
+  Tree::ScoreVector scores_best(scores_serial);
+  std::stable_sort(
+    scores_best.begin(), scores_best.end(), [](const Tree::Score& a, const Tree::Score& b) {
+      return a.number_of_matches > b.number_of_matches;
+    });
+  const Tree::ScoreVector scores_top = database.getScorePerImage(matchables_query, false, 25, 3);
+  ASSERT_EQ(scores_top.size(), static_cast<size_t>(3));
+  for (size_t j = 0; j < scores_top.size(); ++j) {
+    ASSERT_EQ(scores_top[j].identifier_reference, scores_best[j].identifier_reference);
+    ASSERT_EQ(scores_top[j].number_of_matches, scores_best[j].number_of_matches);
+  }
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, SearchConcurrent) {
+  // ds populate the database partially
+  Tree database;
+  database.setConcurrentReading(true);
+  ASSERT_THROW(database.setRetention(3), std::runtime_error);
+  Tree::MatchVectorMap matches_added;
+  for (size_t i = 0; i < 5; ++i) {
+    database.matchAndAdd(matchables_train_per_image[i], matches_added, 25);
+  }
+
+  // ds readers query the first image while the remaining images are added
+  std::atomic<bool> adding(true);
+  std::atomic<size_t> number_of_failed_queries(0);
+  std::vector<std::thread> readers;
+  for (size_t index_reader = 0; index_reader < 3; ++index_reader) {
+    readers.emplace_back([&]() {
+      const Tree::MatchableVector& matchables_query = matchables_train_per_image[0];
+      do {
+        Tree::MatchVectorMap matches;
+        database.match(matchables_query, matches, 1);
+        if (matches[0].size() != matchables_query.size() ||
+            database.getNumberOfMatches(matchables_query, 1) < matchables_query.size()) {
+          ++number_of_failed_queries;
+        }
+      } while (adding);
+    });
+  }
+  for (size_t i = 5; i < 10; ++i) {
+    database.matchAndAdd(matchables_train_per_image[i], matches_added, 25);
+  }
+  adding = false;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(number_of_failed_queries, static_cast<size_t>(0));
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+
+  // ds all images are complete after the writer finished
+  for (size_t i = 0; i < 10; ++i) {
+    const Tree::MatchableVector& matchables_query = matchables_train_per_image[i];
+    Tree::MatchVectorMap matches;
+    database.match(matchables_query, matches, 1);
+    ASSERT_EQ(matches.size(), static_cast<size_t>(10));
+    ASSERT_EQ(matches[i].size(), matchables_query.size());
+  }
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, TrainParallel) {
+  // ds build a serial and a parallel database from identical bulk imports
+  Tree database_serial;
+  Tree database_parallel;
+  database_parallel.setThreadPool(std::make_shared<ThreadPool>(4));
+  for (size_t i = 0; i < 10; ++i) {
+    Tree::MatchableVector matchables_copy;
+    matchables_copy.reserve(matchables_train_per_image[i].size());
+    for (const Tree::Matchable* matchable : matchables_train_per_image[i]) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+
+    // ds the first image creates the root, all others are inserted in a single training call
+    const SplittingStrategy train_mode =
+      (i == 0) ? SplittingStrategy::SplitEven : SplittingStrategy::DoNothing;
+    database_serial.add(matchables_train_per_image[i], train_mode);
+    database_parallel.add(matchables_copy, train_mode);
+  }
+  database_serial.train(SplittingStrategy::SplitEven);
+  database_parallel.train(SplittingStrategy::SplitEven);
+  ASSERT_EQ(database_parallel.size(), static_cast<size_t>(10));
+  ASSERT_EQ(database_parallel.numberOfMatchablesCompressed(),
+            database_serial.numberOfMatchablesCompressed());
+
+  // ds leafs must be filled in insertion order - resulting in identical matches
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  Tree::MatchVectorMap matches_serial;
+  Tree::MatchVectorMap matches_parallel;
+  database_serial.match(matchables_query, matches_serial, 25);
+  database_parallel.match(matchables_query, matches_parallel, 25);
+  ASSERT_EQ(matches_parallel.size(), matches_serial.size());
+  for (const auto& matches : matches_serial) {
+    const Tree::MatchVector& matches_image = matches_parallel.at(matches.first);
+    ASSERT_EQ(matches_image.size(), matches.second.size());
+    for (size_t j = 0; j < matches_image.size(); ++j) {
+      ASSERT_EQ(matches_image[j].object_query, matches.second[j].object_query);
+      ASSERT_EQ(matches_image[j].object_references, matches.second[j].object_references);
+      ASSERT_EQ(matches_image[j].distance, matches.second[j].distance);
+    }
+  }
+
+  // ds clear databases
+  database_serial.clear(true);
+  database_parallel.clear(true);
+  ASSERT_EQ(database_parallel.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, BuildParallel) {
+  // ds bulk import of all images, copied for each database
+  const auto get_matchables = [this]() {
+    Tree::MatchableVector matchables;
+    for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+      for (const Tree::Matchable* matchable : matchables_train) {
+        matchables.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                    matchable->descriptor,
+                                                    matchable->objects.begin()->first));
+      }
+    }
+    return matchables;
+  };
+  const auto assert_identical_matches = [this](const Tree& database_a_, const Tree& database_b_) {
+    ASSERT_EQ(database_a_.numberOfMatchablesCompressed(),
+              database_b_.numberOfMatchablesCompressed());
+    for (const Tree::MatchableVector& matchables_query : matchables_query_per_image) {
+      Tree::MatchVectorMap matches_a;
+      Tree::MatchVectorMap matches_b;
+      database_a_.match(matchables_query, matches_a, 25);
+      database_b_.match(matchables_query, matches_b, 25);
+      ASSERT_EQ(matches_a.size(), matches_b.size());
+      for (const auto& matches : matches_a) {
+        const Tree::MatchVector& matches_image = matches_b.at(matches.first);
+        ASSERT_EQ(matches_image.size(), matches.second.size());
+        for (size_t j = 0; j < matches_image.size(); ++j) {
+          ASSERT_EQ(matches_image[j].object_query, matches.second[j].object_query);
+          ASSERT_EQ(matches_image[j].object_references, matches.second[j].object_references);
+          ASSERT_EQ(matches_image[j].distance, matches.second[j].distance);
+        }
+      }
+    }
+  };
+
+  // ds deterministic splitting results in the same tree as the recursive construction
+  Tree database_serial(0, get_matchables(), SplittingStrategy::SplitEven);
+  Tree database_parallel(
+    0, get_matchables(), SplittingStrategy::SplitEven, std::make_shared<ThreadPool>(4));
+  assert_identical_matches(database_serial, database_parallel);
+
+  // ds random splitting is reproducible for any number of threads
+  Tree::Node::seedRandomNumberGenerator(0);
+  Tree database_random_single(
+    0, get_matchables(), SplittingStrategy::SplitRandomUniform, std::make_shared<ThreadPool>(1));
+  Tree::Node::seedRandomNumberGenerator(0);
+  Tree database_random_parallel(
+    0, get_matchables(), SplittingStrategy::SplitRandomUniform, std::make_shared<ThreadPool>(4));
+  assert_identical_matches(database_random_single, database_random_parallel);
+
+  // ds clear databases (the fixture training matchables were copied)
+  database_serial.clear(true);
+  database_parallel.clear(true);
+  database_random_single.clear(true);
+  database_random_parallel.clear(true);
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    for (const Tree::Matchable* matchable : matchables_train) {
+      delete matchable;
+    }
+  }
+}
+
+TEST_F(HBST, SearchMapped) {
+  // ds populate the database and store it in the mappable format
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  const std::string file_path = "test_search_mapped.hbst";
+  ASSERT_TRUE(database.writeMapped(file_path));
+
+  // ds the mapped database is queried in place and must be identical to the tree
+  Tree::Mapped database_mapped;
+  ASSERT_TRUE(database_mapped.open(file_path, true));
+  ASSERT_EQ(database_mapped.size(), database.size());
+  ASSERT_EQ(database_mapped.numberOfMatchables(), database.numberOfMatchablesCompressed());
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  ASSERT_EQ(database_mapped.getNumberOfMatches(matchables_query, 25),
+            database.getNumberOfMatches(matchables_query, 25));
+  Tree::MatchVectorMap matches;
+  Tree::MatchVectorMap matches_mapped;
+  database.match(matchables_query, matches, 25);
+  database_mapped.match(matchables_query, matches_mapped, 25);
+  ASSERT_EQ(matches_mapped.size(), matches.size());
+  for (const auto& matches_image : matches) {
+    const Tree::MatchVector& matches_image_mapped = matches_mapped.at(matches_image.first);
+    ASSERT_EQ(matches_image_mapped.size(), matches_image.second.size());
+    for (size_t j = 0; j < matches_image_mapped.size(); ++j) {
+      ASSERT_EQ(matches_image_mapped[j].object_query, matches_image.second[j].object_query);
+      ASSERT_EQ(matches_image_mapped[j].object_references,
+                matches_image.second[j].object_references);
+      ASSERT_EQ(matches_image_mapped[j].distance, matches_image.second[j].distance);
+    }
+  }
+  const Tree::ScoreVector scores = database.getScorePerImage(matchables_query, true, 25);
+  const Tree::ScoreVector scores_mapped =
+    database_mapped.getScorePerImage(matchables_query, true, 25);
+  ASSERT_EQ(scores_mapped.size(), scores.size());
+  for (size_t j = 0; j < scores.size(); ++j) {
+    ASSERT_EQ(scores_mapped[j].number_of_matches, scores[j].number_of_matches);
+  }
+
+  // ds the frozen in-memory layout is identical to the mapped file and outlives the tree
+  Tree database_copy;
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_copy;
+    for (const Tree::Matchable* matchable : matchables_train) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    database_copy.add(matchables_copy, SplittingStrategy::SplitEven);
+  }
+  const std::unique_ptr<Tree::Mapped> database_frozen = database_copy.freeze();
+  database_copy.clear(true);
+  ASSERT_TRUE(database_frozen->isOpen());
+  ASSERT_EQ(database_frozen->size(), database_mapped.size());
+  ASSERT_EQ(database_frozen->numberOfMatchables(), database_mapped.numberOfMatchables());
+  Tree::MatchVectorMap matches_frozen;
+  database_frozen->match(matchables_query, matches_frozen, 25);
+  ASSERT_EQ(matches_frozen.size(), matches_mapped.size());
+  for (const auto& matches_image : matches_mapped) {
+    const Tree::MatchVector& matches_image_frozen = matches_frozen.at(matches_image.first);
+    ASSERT_EQ(matches_image_frozen.size(), matches_image.second.size());
+    for (size_t j = 0; j < matches_image_frozen.size(); ++j) {
+      ASSERT_EQ(matches_image_frozen[j].object_references,
+                matches_image.second[j].object_references);
+      ASSERT_EQ(matches_image_frozen[j].distance, matches_image.second[j].distance);
+    }
+  }
+  database_mapped.close();
+
+  // ds files of a different layout are rejected
+  ASSERT_TRUE(database.write(file_path));
+  ASSERT_FALSE(database_mapped.open(file_path));
+  std::remove(file_path.c_str());
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, Remove) {
+  // ds keep copies of the training descriptors to query the remaining images
+  std::vector<Tree::MatchableVector> matchables_copy_per_image;
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_copy;
+    for (const Tree::Matchable* matchable : matchables_train) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    matchables_copy_per_image.emplace_back(matchables_copy);
+  }
+
+  // ds populate the database and remove every other image
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  for (uint64_t identifier = 1; identifier < 10; identifier += 2) {
+    ASSERT_TRUE(database.remove(identifier));
+  }
+  ASSERT_FALSE(database.remove(1));
+  ASSERT_EQ(database.size(), static_cast<size_t>(5));
+  ASSERT_EQ(database.numberOfMatchablesCompressed(), static_cast<size_t>(5000));
+
+  // ds the remaining images are still found completely, removed images not at all
+  for (uint64_t identifier = 0; identifier < 10; ++identifier) {
+    Tree::MatchVectorMap matches;
+    database.match(matchables_copy_per_image[identifier], matches, 1);
+    ASSERT_EQ(matches.size(), static_cast<size_t>(5));
+    ASSERT_EQ(matches.count(identifier), static_cast<size_t>(identifier % 2 == 0));
+    if (identifier % 2 == 0) {
+      ASSERT_EQ(matches.at(identifier).size(), static_cast<size_t>(1000));
+    }
+  }
+
+  // ds emptied leafs survive serialization
+  const std::string file_path = "database_removed.hbst";
+  ASSERT_TRUE(database.write(file_path));
+  Tree database_loaded;
+  ASSERT_TRUE(database_loaded.read(file_path));
+  ASSERT_EQ(database_loaded.size(), static_cast<size_t>(5));
+  ASSERT_EQ(database_loaded.numberOfMatchablesCompressed(), static_cast<size_t>(5000));
+  std::remove(file_path.c_str());
+  database_loaded.clear(true);
+
+  // ds removing all images empties the tree, which can be populated again
+  for (uint64_t identifier = 0; identifier < 10; identifier += 2) {
+    ASSERT_TRUE(database.remove(identifier));
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+  ASSERT_EQ(database.numberOfMatchablesCompressed(), static_cast<size_t>(0));
+
+  // ds sliding window: only the latest 3 images are kept
+  database.setRetention(3);
+  ASSERT_THROW(database.setConcurrentReading(true), std::runtime_error);
+  for (Tree::MatchableVector& matchables_copy : matchables_copy_per_image) {
+    database.add(matchables_copy, SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(3));
+  ASSERT_EQ(database.trainedIdentifiers(), std::set<uint64_t>({7, 8, 9}));
+  Tree::MatchVectorMap matches;
+  database.match(matchables_query_per_image[0], matches);
+  ASSERT_EQ(matches.size(), static_cast<size_t>(3));
+
+  // ds scores only cover the remaining images (their slots are reused)
+  const Tree::ScoreVector scores = database.getScorePerImage(matchables_query_per_image[0]);
+  ASSERT_EQ(scores.size(), static_cast<size_t>(3));
+  for (size_t j = 0; j < scores.size(); ++j) {
+    ASSERT_EQ(scores[j].identifier_reference, static_cast<uint64_t>(7 + j));
+    ASSERT_EQ(scores[j].number_of_matches, matches.at(7 + j).size());
+  }
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, SearchPivots) {
+  // ds populate one database without and one with pivot pruning (on copies of the matchables)
+  Tree database;
+  Tree database_pivots;
+  Tree::Node::minimum_leaf_size_for_pivots = 16;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_copy;
+    for (const Tree::Matchable* matchable : matchables_train) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    database_pivots.add(matchables_copy, SplittingStrategy::SplitEven);
+  }
+  Tree::Node::minimum_leaf_size_for_pivots = 0;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds pruning is exact: both databases return identical matches, also after removals
+  for (uint64_t identifier = 0; identifier < 3; ++identifier) {
+    for (const uint32_t maximum_distance : {10, 25, 50}) {
+      Tree::MatchVectorMap matches;
+      Tree::MatchVectorMap matches_pivots;
+      database.match(matchables_query_per_image[0], matches, maximum_distance);
+      database_pivots.match(matchables_query_per_image[0], matches_pivots, maximum_distance);
+      ASSERT_EQ(matches.size(), matches_pivots.size());
+      for (const Tree::MatchVectorMap::value_type& matches_image : matches) {
+        const Tree::MatchVector& matches_image_pivots = matches_pivots.at(matches_image.first);
+        ASSERT_EQ(matches_image.second.size(), matches_image_pivots.size());
+        for (size_t j = 0; j < matches_image_pivots.size(); ++j) {
+          ASSERT_EQ(matches_image.second[j].object_query, matches_image_pivots[j].object_query);
+          ASSERT_EQ(matches_image.second[j].object_references,
+                    matches_image_pivots[j].object_references);
+          ASSERT_EQ(matches_image.second[j].distance, matches_image_pivots[j].distance);
+        }
+      }
+    }
+    ASSERT_TRUE(database.remove(2 * identifier + 1));
+    ASSERT_TRUE(database_pivots.remove(2 * identifier + 1));
+  }
+
+  // ds clear databases
+  database.clear(true);
+  database_pivots.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, SearchPopcountOrder) {
+  // ds populate one database with unordered and one with popcount ordered leafs (on copies)
+  Tree database;
+  Tree database_ordered;
+  Tree::Node::minimum_leaf_size_for_popcount_order = 8;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_copy;
+    for (const Tree::Matchable* matchable : matchables_train) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    database_ordered.add(matchables_copy, SplittingStrategy::SplitEven);
+  }
+  Tree::Node::minimum_leaf_size_for_popcount_order = 0;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds the popcount window is exact: both databases return the same matches (in any order)
+  const auto sort_matches = [](Tree::MatchVector& matches_) {
+    for (Tree::Match& match : matches_) {
+      std::sort(match.object_references.begin(), match.object_references.end());
+    }
+    std::sort(matches_.begin(), matches_.end(), [](const Tree::Match& a_, const Tree::Match& b_) {
+      return a_.object_query < b_.object_query ||
+             (a_.object_query == b_.object_query && a_.object_references < b_.object_references);
+    });
+  };
+  for (uint64_t identifier = 0; identifier < 3; ++identifier) {
+    for (const uint32_t maximum_distance : {1, 10, 25, 50}) {
+      Tree::MatchVectorMap matches;
+      Tree::MatchVectorMap matches_ordered;
+      database.match(matchables_query_per_image[0], matches, maximum_distance);
+      database_ordered.match(matchables_query_per_image[0], matches_ordered, maximum_distance);
+      ASSERT_EQ(matches.size(), matches_ordered.size());
+      for (Tree::MatchVectorMap::value_type& matches_image : matches) {
+        Tree::MatchVector& matches_image_ordered = matches_ordered.at(matches_image.first);
+        ASSERT_EQ(matches_image.second.size(), matches_image_ordered.size());
+        sort_matches(matches_image.second);
+        sort_matches(matches_image_ordered);
+        for (size_t j = 0; j < matches_image_ordered.size(); ++j) {
+          ASSERT_EQ(matches_image.second[j].object_query, matches_image_ordered[j].object_query);
+          ASSERT_EQ(matches_image.second[j].object_references,
+                    matches_image_ordered[j].object_references);
+          ASSERT_EQ(matches_image.second[j].distance, matches_image_ordered[j].distance);
+        }
+      }
+    }
+    ASSERT_TRUE(database.remove(2 * identifier + 1));
+    ASSERT_TRUE(database_ordered.remove(2 * identifier + 1));
+  }
+
+  // ds clear databases
+  database.clear(true);
+  database_ordered.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+TEST_F(HBST, SearchNoisyMultiProbe) {
+  number_of_bits_to_flip = 10;
+
+  // ds populate the database
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+
+  // ds modify trained matchables slightly by flipping 10 arbitrary bits
+  freeMatchablesQuery();
+  matchables_query_per_image.reserve(matchables_train_per_image.size());
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_query;
+    matchables_query.reserve(matchables_train.size());
+    for (Tree::Matchable* matchable_train : matchables_train) {
+      Tree::Descriptor descriptor = matchable_train->descriptor;
+      flipBits(descriptor);
+      matchables_query.emplace_back(new Tree::Matchable(matchable_train->objects.begin()->second,
+                                                        descriptor,
+                                                        matchable_train->objects.begin()->first));
+    }
+    matchables_query_per_image.emplace_back(matchables_query);
+  }
+
+  for (size_t i = 0; i < 10; ++i) {
+    const Tree::MatchableVector& matchables_query = matchables_query_per_image[i];
+
+    // ds a budget of a single leaf corresponds to regular matching
+    Tree::MatchVectorMap matches;
+    database.match(matchables_query, matches, 10);
+    Tree::MatchVectorMap matches_single_probe;
+    database.matchMultiProbe(matchables_query, matches_single_probe, 10, Tree::ProbeBudget(1));
+    ASSERT_EQ(matches_single_probe.at(i).size(), matches.at(i).size());
+
+    // ds probing more leafs recovers matches lost due to invalid partitioning
+    Tree::MatchVectorMap matches_multi_probe;
+    database.matchMultiProbe(matchables_query, matches_multi_probe, 10, Tree::ProbeBudget(32));
+    ASSERT_GT(matches_multi_probe.at(i).size(), matches.at(i).size() + 150);
+    for (const Tree::Match& match : matches_multi_probe.at(i)) {
+      ASSERT_LT(match.distance, 10);
+    }
+
+    // ds without budget all references within the matching distance are found (exact pruning)
+    Tree::MatchVectorMap matches_unbounded;
+    database.matchMultiProbe(matchables_query,
+                             matches_unbounded,
+                             10,
+                             Tree::ProbeBudget(std::numeric_limits<uint32_t>::max()));
+    size_t number_of_matches_exhaustive = 0;
+    for (const Tree::Matchable* matchable_query : matchables_query) {
+      for (const Tree::Matchable* matchable_reference : matchables_train_per_image[i]) {
+        if (matchable_query->distance(matchable_reference) < 10) {
+          ++number_of_matches_exhaustive;
+          break;
+        }
+      }
+    }
+    ASSERT_EQ(matches_unbounded.at(i).size(), number_of_matches_exhaustive);
+    ASSERT_GE(matches_unbounded.at(i).size(), matches_multi_probe.at(i).size());
+
+    // ds an exhausted comparison budget stops probing
+    Tree::MatchVectorMap matches_limited;
+    database.matchMultiProbe(matchables_query, matches_limited, 10, Tree::ProbeBudget(32, 1));
+    ASSERT_EQ(matches_limited.at(i).size(), matches.at(i).size());
+  }
+
+  // ds clear database
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+}
+
+#ifndef SRRG_MERGE_DESCRIPTORS
+TEST_F(HBST, SearchNoisyForest) {
+  number_of_bits_to_flip = 10;
+
+  // ds copies of the training images for a single tree reference
+  std::vector<Tree::MatchableVector> matchables_copy_per_image;
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_copy;
+    for (const Tree::Matchable* matchable : matchables_train) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    matchables_copy_per_image.emplace_back(matchables_copy);
+  }
+
+  // ds populate a forest of randomized trees sharing the matchables and a single tree
+  Tree::Node::seedRandomNumberGenerator(0);
+  BinaryTreeForest<Tree> forest(4, std::make_shared<ThreadPool>(2));
+  Tree database;
+  for (size_t i = 0; i < 10; ++i) {
+    forest.add(matchables_train_per_image[i]);
+    database.add(matchables_copy_per_image[i], SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(forest.size(), static_cast<size_t>(10));
+  ASSERT_EQ(forest.numberOfTrees(), static_cast<size_t>(4));
+
+  // ds modify trained matchables slightly by flipping 10 arbitrary bits
+  freeMatchablesQuery();
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_query;
+    for (Tree::Matchable* matchable_train : matchables_train) {
+      Tree::Descriptor descriptor = matchable_train->descriptor;
+      flipBits(descriptor);
+      matchables_query.emplace_back(new Tree::Matchable(matchable_train->objects.begin()->second,
+                                                        descriptor,
+                                                        matchable_train->objects.begin()->first));
+    }
+    matchables_query_per_image.emplace_back(matchables_query);
+  }
+
+  // ds the union of the leafs recovers matches lost due to invalid partitioning in a single tree
+  for (size_t i = 0; i < 10; ++i) {
+    Tree::MatchVectorMap matches;
+    database.match(matchables_query_per_image[i], matches, 10);
+    Tree::MatchVectorMap matches_forest;
+    forest.match(matchables_query_per_image[i], matches_forest, 10);
+    ASSERT_EQ(matches_forest.size(), static_cast<size_t>(10));
+    ASSERT_GT(matches_forest.at(i).size(), matches.at(i).size() + 150);
+    for (const Tree::Match& match : matches_forest.at(i)) {
+      ASSERT_LT(match.distance, 10);
+      ASSERT_EQ(match.matchable_references.size(), match.object_references.size());
+    }
+  }
+
+  // ds clear databases (the forest releases the shared matchables once)
+  forest.clear(true);
+  ASSERT_EQ(forest.size(), static_cast<size_t>(0));
+  database.clear(true);
+}
+#endif
+
+TEST_F(HBST, Statistics) {
+  // ds populate the database
+  Tree database;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds the tree shape covers all leafs and stored matchables
+  const BinaryTreeShape shape = database.getShape();
+  ASSERT_EQ(shape.number_of_leafs, shape.number_of_inner_nodes + 1);
+  ASSERT_EQ(shape.number_of_matchables, database.numberOfMatchablesCompressed());
+  const std::vector<uint64_t>& depths = shape.depth_histogram;
+  const std::vector<uint64_t>& sizes  = shape.leaf_size_histogram;
+  ASSERT_EQ(std::accumulate(depths.begin(), depths.end(), uint64_t(0)), shape.number_of_leafs);
+  ASSERT_EQ(std::accumulate(sizes.begin(), sizes.end(), uint64_t(0)), shape.number_of_leafs);
+
+#ifdef SRRG_HBST_STATISTICS
+  // ds every query reaches exactly one leaf, compared references are either matches or rejected
+  const Tree::MatchableVector& matchables_query = matchables_train_per_image[0];
+  Tree::MatchVectorMap matches;
+  database.match(matchables_query, matches, 1);
+  const BinaryQueryStatistics statistics = database.getStatisticsLastCall();
+  ASSERT_EQ(statistics.number_of_queries, matchables_query.size());
+  ASSERT_EQ(statistics.number_of_leafs_visited, matchables_query.size());
+  ASSERT_EQ(statistics.number_of_matches + statistics.number_of_matches_rejected,
+            statistics.number_of_comparisons);
+  ASSERT_GE(statistics.number_of_matches, matches[0].size());
+  ASSERT_LE(statistics.maximum_depth, shape.maximum_depth);
+  ASSERT_LE(statistics.maximum_leaf_size, shape.maximum_leaf_size);
+
+  // ds scoring accumulates as well, until the counters are reset
+  database.getScorePerImage(matchables_query, false, 1);
+  ASSERT_EQ(database.getStatistics().number_of_queries, 2 * matchables_query.size());
+  database.resetStatistics();
+  ASSERT_EQ(database.getStatistics().number_of_queries, static_cast<uint64_t>(0));
+#endif
+
+  // ds clear database
+  database.clear(true);
+}
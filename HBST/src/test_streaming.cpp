@@ -1,6 +1,8 @@
 #include <fstream>
 #include <iostream>
 
+#include "srrg_hbst/types/binary_tree_journal.hpp"
+#include "srrg_hbst/types/binary_tree_sharded.hpp"
 #include "test_fixture.hpp"
 
 using namespace srrg_hbst;
@@ -71,3 +73,193 @@ TEST_F(HBST, Read) {
   // ds clear database
   database.clear(true);
 }
+
+TEST_F(HBST, Journal) {
+  const std::string file_path_journal    = "database.hbstj";
+  const std::string file_path_checkpoint = "database_checkpoint.hbst";
+  std::remove(file_path_journal.c_str());
+  std::remove(file_path_checkpoint.c_str());
+
+  // ds keep copies of the images streamed after the checkpoint for a reference database
+  std::vector<Tree::MatchableVector> matchables_after_checkpoint_per_image;
+  for (size_t i = 5; i < 10; ++i) {
+    Tree::MatchableVector matchables_copy;
+    matchables_copy.reserve(matchables_train_per_image[i].size());
+    for (const Tree::Matchable* matchable : matchables_train_per_image[i]) {
+      matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                       matchable->descriptor,
+                                                       matchable->objects.begin()->first));
+    }
+    matchables_after_checkpoint_per_image.emplace_back(matchables_copy);
+  }
+
+  // ds stream images into a journaled database with a checkpoint in between
+  {
+    Tree database;
+    BinaryTreeJournal<Tree> journal(database);
+    ASSERT_TRUE(journal.open(file_path_journal, file_path_checkpoint));
+    for (size_t i = 0; i < 10; ++i) {
+      ASSERT_TRUE(journal.add(matchables_train_per_image[i], SplittingStrategy::SplitEven));
+      if (i == 4) {
+        ASSERT_TRUE(journal.checkpoint());
+        ASSERT_EQ(journal.numberOfRecords(), static_cast<size_t>(0));
+      }
+    }
+    ASSERT_EQ(journal.numberOfRecords(), static_cast<size_t>(5));
+
+    // ds crash without final checkpoint
+    database.clear(true);
+  }
+
+  // ds a torn record at the end of the journal is discarded
+  {
+    std::ofstream journal_file(file_path_journal, std::ios::binary | std::ios::app);
+    const std::vector<char> record_torn(100, 1);
+    journal_file.write(record_torn.data(), record_torn.size());
+  }
+
+  // ds restore checkpoint and replay journal
+  Tree database;
+  BinaryTreeJournal<Tree> journal(database);
+  ASSERT_TRUE(journal.open(file_path_journal, file_path_checkpoint));
+  ASSERT_EQ(journal.numberOfRecords(), static_cast<size_t>(5));
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+
+  // ds reference: checkpoint loaded and remaining images added without journal
+  Tree database_reference;
+  ASSERT_TRUE(database_reference.read(file_path_checkpoint));
+  for (Tree::MatchableVector& matchables : matchables_after_checkpoint_per_image) {
+    database_reference.add(matchables, SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.numberOfMatchablesCompressed(),
+            database_reference.numberOfMatchablesCompressed());
+
+  // ds replay must reproduce the reference matches exactly
+  for (Tree::MatchableVector& matchables_query : matchables_query_per_image) {
+    Tree::MatchVectorMap match_vectors;
+    Tree::MatchVectorMap match_vectors_reference;
+    database.match(matchables_query, match_vectors);
+    database_reference.match(matchables_query, match_vectors_reference);
+    ASSERT_EQ(match_vectors.size(), static_cast<size_t>(10));
+    ASSERT_EQ(match_vectors.size(), match_vectors_reference.size());
+    for (const auto& matches : match_vectors_reference) {
+      const Tree::MatchVector& matches_image = match_vectors.at(matches.first);
+      ASSERT_EQ(matches_image.size(), matches.second.size());
+      for (size_t j = 0; j < matches_image.size(); ++j) {
+        ASSERT_EQ(matches_image[j].object_query, matches.second[j].object_query);
+        ASSERT_EQ(matches_image[j].object_references, matches.second[j].object_references);
+        ASSERT_EQ(matches_image[j].distance, matches.second[j].distance);
+      }
+    }
+  }
+
+  // ds removals are journaled and survive a restart (also of checkpointed images)
+  ASSERT_TRUE(journal.remove(2));
+  ASSERT_TRUE(journal.remove(7));
+  ASSERT_FALSE(journal.remove(7));
+  journal.close();
+  Tree database_restored;
+  BinaryTreeJournal<Tree> journal_restored(database_restored);
+  ASSERT_TRUE(journal_restored.open(file_path_journal, file_path_checkpoint));
+  ASSERT_EQ(journal_restored.numberOfRecords(), static_cast<size_t>(7));
+  ASSERT_EQ(database_restored.size(), static_cast<size_t>(8));
+  ASSERT_EQ(database_restored.trainedIdentifiers().count(2), static_cast<size_t>(0));
+  ASSERT_EQ(database_restored.trainedIdentifiers().count(7), static_cast<size_t>(0));
+
+  // ds clear databases and files
+  journal_restored.close();
+  database_restored.clear(true);
+  database.clear(true);
+  database_reference.clear(true);
+  std::remove(file_path_journal.c_str());
+  std::remove(file_path_checkpoint.c_str());
+}
+
+TEST_F(HBST, Sharded) {
+  // ds copies of the training images for the reference databases and streaming
+  const auto copy_images = [this]() {
+    std::vector<Tree::MatchableVector> matchables_copy_per_image;
+    for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+      Tree::MatchableVector matchables_copy;
+      matchables_copy.reserve(matchables_train.size());
+      for (const Tree::Matchable* matchable : matchables_train) {
+        matchables_copy.emplace_back(new Tree::Matchable(matchable->objects.begin()->second,
+                                                         matchable->descriptor,
+                                                         matchable->objects.begin()->first));
+      }
+      matchables_copy_per_image.emplace_back(matchables_copy);
+    }
+    return matchables_copy_per_image;
+  };
+  const std::vector<Tree::MatchableVector> matchables_reference_per_image(copy_images());
+  const std::vector<Tree::MatchableVector> matchables_stream_per_image(copy_images());
+
+  // ds populate a sharded database with 3 images per shard and the corresponding references
+  BinaryTreeSharded<Tree> database(3, std::make_shared<ThreadPool>(4));
+  std::vector<std::unique_ptr<Tree>> databases_reference;
+  for (size_t i = 0; i < 10; ++i) {
+    database.add(matchables_train_per_image[i], SplittingStrategy::SplitEven);
+    if (i % 3 == 0) {
+      databases_reference.emplace_back(new Tree());
+    }
+    databases_reference.back()->add(matchables_reference_per_image[i],
+                                    SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+  ASSERT_EQ(database.numberOfShards(), static_cast<size_t>(4));
+  ASSERT_EQ(database.shard(1).trainedIdentifiers(), std::set<uint64_t>({3, 4, 5}));
+
+  // ds fanned out queries are merged per image
+  for (const Tree::MatchableVector& matchables_query : matchables_query_per_image) {
+    Tree::MatchVectorMap match_vectors;
+    database.match(matchables_query, match_vectors);
+    ASSERT_EQ(match_vectors.size(), static_cast<size_t>(10));
+    for (const std::unique_ptr<Tree>& database_reference : databases_reference) {
+      Tree::MatchVectorMap match_vectors_reference;
+      database_reference->match(matchables_query, match_vectors_reference);
+      for (const auto& matches : match_vectors_reference) {
+        const Tree::MatchVector& matches_image = match_vectors.at(matches.first);
+        ASSERT_EQ(matches_image.size(), matches.second.size());
+        for (size_t j = 0; j < matches_image.size(); ++j) {
+          ASSERT_EQ(matches_image[j].object_references, matches.second[j].object_references);
+          ASSERT_EQ(matches_image[j].distance, matches.second[j].distance);
+        }
+      }
+    }
+
+    // ds recent images are excluded, the last shard is not queried
+    database.match(matchables_query, match_vectors, 25, 5);
+    ASSERT_EQ(match_vectors.size(), static_cast<size_t>(5));
+    ASSERT_EQ(match_vectors.count(5), static_cast<size_t>(0));
+    database.matchSparse(matchables_query, match_vectors, 25, 2);
+    ASSERT_EQ(match_vectors.size(), static_cast<size_t>(2));
+  }
+
+  // ds images are removed from their shards, empty frozen shards are dropped
+  for (uint64_t identifier = 0; identifier < 3; ++identifier) {
+    ASSERT_TRUE(database.remove(identifier));
+  }
+  ASSERT_FALSE(database.remove(0));
+  ASSERT_EQ(database.size(), static_cast<size_t>(7));
+  ASSERT_EQ(database.numberOfShards(), static_cast<size_t>(3));
+
+  // ds streaming: every image is matched against all previous ones
+  database.clear(true);
+  ASSERT_EQ(database.size(), static_cast<size_t>(0));
+  for (size_t i = 0; i < 10; ++i) {
+    Tree::MatchVectorMap match_vectors;
+    database.matchAndAdd(matchables_stream_per_image[i], match_vectors);
+    ASSERT_EQ(match_vectors.size(), i);
+    for (const auto& matches : match_vectors) {
+      ASSERT_LT(matches.first, i);
+    }
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+  ASSERT_EQ(database.numberOfShards(), static_cast<size_t>(4));
+
+  // ds clear databases
+  database.clear(true);
+  for (std::unique_ptr<Tree>& database_reference : databases_reference) {
+    database_reference->clear(true);
+  }
+}
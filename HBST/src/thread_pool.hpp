@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace srrg_hbst {
+
+  //! @class fixed size thread pool for blocking, data parallel batch jobs: a job consists of a
+  //! number of independent tasks which are claimed by the workers and the calling thread
+  class ThreadPool {
+    // ds ctor/dtor
+  public:
+    //! @brief spawns the workers
+    //! @param[in] number_of_threads_ total number of threads working on a job (including the
+    //! calling thread), 0 for the hardware concurrency
+    ThreadPool(const size_t& number_of_threads_ = 0) {
+      size_t number_of_threads = number_of_threads_;
+      if (number_of_threads == 0) {
+        number_of_threads = std::max(std::thread::hardware_concurrency(), 1u);
+      }
+      _workers.reserve(number_of_threads - 1);
+      for (size_t index_worker = 1; index_worker < number_of_threads; ++index_worker) {
+        _workers.emplace_back(&ThreadPool::_runWorker, this);
+      }
+    }
+
+    //! @brief stops and joins all workers
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _terminate = true;
+      }
+      _condition_work.notify_all();
+      for (std::thread& worker : _workers) {
+        worker.join();
+      }
+    }
+
+    //! @brief workers are bound to this instance
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // ds access
+  public:
+    //! @brief total number of threads working on a job
+    size_t size() const {
+      return _workers.size() + 1;
+    }
+
+    //! @brief calls function_(index_task) for all tasks in [0, number_of_tasks_) and blocks until
+    //! all tasks are completed - tasks must not run jobs on the same pool
+    //! @param[in] number_of_tasks_
+    //! @param[in] function_ task function (called concurrently)
+    void run(const size_t& number_of_tasks_, const std::function<void(const size_t&)>& function_) {
+      if (number_of_tasks_ == 0) {
+        return;
+      }
+      if (_workers.empty() || number_of_tasks_ == 1) {
+        for (size_t index_task = 0; index_task < number_of_tasks_; ++index_task) {
+          function_(index_task);
+        }
+        return;
+      }
+
+      // ds one job at a time
+      std::lock_guard<std::mutex> lock_job(_mutex_job);
+      {
+        // ds wait until workers that are late for the previous job left it before replacing it
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition_completed.wait(lock, [this] { return _number_of_workers_active == 0; });
+        _function        = &function_;
+        _number_of_tasks = number_of_tasks_;
+        _number_of_tasks_completed.store(0);
+        _index_next_task.store(0);
+        ++_job;
+      }
+      _condition_work.notify_all();
+
+      // ds participate and wait for the remaining tasks
+      _work();
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition_completed.wait(
+        lock, [this] { return _number_of_tasks_completed.load() == _number_of_tasks; });
+    }
+
+    // ds helpers
+  protected:
+    void _runWorker() {
+      uint64_t job = 0;
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _condition_work.wait(lock, [this, &job] { return _terminate || _job != job; });
+          if (_terminate) {
+            return;
+          }
+          job = _job;
+          ++_number_of_workers_active;
+        }
+        _work();
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          --_number_of_workers_active;
+          if (_number_of_workers_active == 0) {
+            _condition_completed.notify_all();
+          }
+        }
+      }
+    }
+
+    void _work() {
+      while (true) {
+        const size_t index_task = _index_next_task.fetch_add(1);
+        if (index_task >= _number_of_tasks) {
+          return;
+        }
+        (*_function)(index_task);
+        if (_number_of_tasks_completed.fetch_add(1) + 1 == _number_of_tasks) {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _condition_completed.notify_all();
+        }
+      }
+    }
+
+    // ds attributes
+  protected:
+    //! @brief worker threads (the calling thread is the additional thread)
+    std::vector<std::thread> _workers;
+
+    //! @brief current job (only modified while no worker is active)
+    const std::function<void(const size_t&)>* _function = nullptr;
+    size_t _number_of_tasks                              = 0;
+    uint64_t _job                                        = 0;
+    std::atomic<size_t> _index_next_task{0};
+    std::atomic<size_t> _number_of_tasks_completed{0};
+    size_t _number_of_workers_active = 0;
+
+    //! @brief synchronization
+    std::mutex _mutex_job;
+    std::mutex _mutex;
+    std::condition_variable _condition_work;
+    std::condition_variable _condition_completed;
+    bool _terminate = false;
+  };
+
+} // namespace srrg_hbst